@@ -123,6 +123,30 @@ public:
      */
     virtual bool
     process_memref(const memref_t &memref) = 0;
+    /**
+     * Operates on \p count consecutive trace entries of the serial stream, which
+     * is equivalent to calling process_memref() on each of them in order, as the
+     * default implementation does.  The analyzer delivers entries in batches
+     * through this routine: tools can override it to process a batch in a tight
+     * loop, hoisting per-entry overhead out of it.  The return value indicates
+     * whether all entries were processed successfully.
+     *
+     * When several tools are run together, each batch is handed to every tool in
+     * turn, so one tool processes a whole batch before the next tool sees its
+     * first entry.  Tools that share state or interleave their output must not
+     * rely on being called entry by entry in lockstep.  On a failure, the
+     * analyzer stops once the failing tool returns, so the tools before it may
+     * already have processed the entries of the batch past the failing one.
+     */
+    virtual bool
+    process_memref_batch(const memref_t *memrefs, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            if (!process_memref(memrefs[i]))
+                return false;
+        }
+        return true;
+    }
     /**
      * This routine reports the results of the trace analysis.
      * It should leave the i/o state in a default format (std::dec) to support
@@ -211,6 +235,23 @@ public:
     {
         return false;
     }
+    /**
+     * The parallel counterpart of process_memref_batch(): operates on \p count
+     * consecutive trace entries of the shard identified by \p shard_data.  The
+     * default implementation calls parallel_shard_memref() on each entry in order.
+     * Batches are handed to the tools in turn, with the same ordering and error
+     * behavior as described for process_memref_batch().
+     */
+    virtual bool
+    parallel_shard_memref_batch(void *shard_data, const memref_t *memrefs,
+                                size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            if (!parallel_shard_memref(shard_data, memrefs[i]))
+                return false;
+        }
+        return true;
+    }
     /** Returns a description of the last error for this shard. */
     virtual std::string
     parallel_shard_error(void *shard_data)
@@ -30,6 +30,11 @@
  * DAMAGE.
  */
 
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
 #include <thread>
 #include "analysis_tool.h"
@@ -41,8 +46,33 @@
 #ifdef HAS_SNAPPY
 #    include "reader/snappy_file_reader.h"
 #endif
+#ifdef HAS_MMAP
+#    include "reader/mmap_file_reader.h"
+#endif
 #include "common/utils.h"
 
+// The number of entries handed to each tool at once.  Each tool makes a pass
+// over the batch in turn, so it should stay cache-resident.
+static const size_t MEMREF_BATCH_SIZE = 1024;
+
+// Sets *size to the size in bytes of the file at path.  Returns false if the
+// file cannot be examined.
+static bool
+get_file_size(const std::string &path, uint64_t *size)
+{
+#ifdef WINDOWS
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+#endif
+    *size = static_cast<uint64_t>(st.st_size);
+    return true;
+}
+
 #ifdef HAS_ZLIB
 // Even if the file is uncompressed, zlib's gzip interface is faster than
 // file_reader_t's fstream in our measurements, so we always use it when
@@ -58,6 +88,7 @@ analyzer_t::analyzer_t()
     , tools_(NULL)
     , parallel_(true)
     , worker_count_(0)
+    , next_shard_(0)
 {
     /* Nothing else: child class needs to initialize. */
 }
@@ -95,6 +126,12 @@ get_reader(const std::string &path, int verbosity)
             }
         }
     }
+#endif
+#ifdef HAS_MMAP
+    // Uncompressed files are mapped and read in place, avoiding a copy and a
+    // library call per entry.
+    if (mmap_file_reader_supports(path))
+        return std::unique_ptr<reader_t>(new mmap_file_reader_t(path, verbosity));
 #endif
     // No snappy support, or didn't find a .sz file, try the default reader.
     return std::unique_ptr<reader_t>(new default_file_reader_t(path, verbosity));
@@ -133,20 +170,22 @@ analyzer_t::init_file_reader(const std::string &trace_path, int verbosity)
             }
             thread_data_.push_back(analyzer_shard_data_t(
                 static_cast<int>(thread_data_.size()), std::move(reader), path));
+            // A shard whose size is unknown keeps size 0 and is scheduled last.
+            if (!get_file_size(path, &thread_data_.back().size))
+                VPRINT(this, 1, "Failed to get the size of %s\n", path.c_str());
             VPRINT(this, 2, "Opened reader for %s\n", path.c_str());
         }
-        // Like raw2trace, we use a simple round-robin static work assigment.  This
-        // could be improved later with dynamic work queue for better load balancing.
+        // Shard sizes are typically very uneven, so rather than a static
+        // assignment, idle workers claim the next shard from a shared queue.
+        // Starting with the largest avoids ending on one big shard.
         if (worker_count_ <= 0)
             worker_count_ = std::thread::hardware_concurrency();
-        worker_tasks_.resize(worker_count_);
-        int worker = 0;
-        for (size_t i = 0; i < thread_data_.size(); ++i) {
-            VPRINT(this, 2, "Worker %d assigned trace shard %zd\n", worker, i);
-            worker_tasks_[worker].push_back(&thread_data_[i]);
-            thread_data_[i].worker = worker;
-            worker = (worker + 1) % worker_count_;
-        }
+        for (analyzer_shard_data_t &tdata : thread_data_)
+            shard_queue_.push_back(&tdata);
+        std::stable_sort(shard_queue_.begin(), shard_queue_.end(),
+                         [](const analyzer_shard_data_t *a, const analyzer_shard_data_t *b) {
+                             return a->size > b->size;
+                         });
     } else {
         parallel_ = false;
         serial_trace_iter_ = get_reader(trace_path, verbosity);
@@ -168,6 +207,7 @@ analyzer_t::analyzer_t(const std::string &trace_path, analysis_tool_t **tools,
     , tools_(tools)
     , parallel_(true)
     , worker_count_(worker_count)
+    , next_shard_(0)
 {
     for (int i = 0; i < num_tools; ++i) {
         if (tools_[i] == NULL || !*tools_[i]) {
@@ -195,6 +235,7 @@ analyzer_t::analyzer_t(const std::string &trace_path)
     // This external-iterator interface does not support parallel analysis.
     , parallel_(false)
     , worker_count_(0)
+    , next_shard_(0)
 {
     if (!init_file_reader(trace_path))
         success_ = false;
@@ -231,57 +272,81 @@ analyzer_t::start_reading()
     return true;
 }
 
-void
-analyzer_t::process_tasks(std::vector<analyzer_shard_data_t *> *tasks)
+bool
+analyzer_t::process_shard(analyzer_shard_data_t *tdata, std::vector<void *> &worker_data)
 {
-    if (tasks->empty()) {
-        VPRINT(this, 1, "Worker has no tasks\n");
-        return;
+    VPRINT(this, 1, "Worker %d starting on trace shard %d\n", tdata->worker,
+           tdata->index);
+    if (!tdata->iter->init()) {
+        tdata->error = "Failed to read from trace" + tdata->trace_file;
+        return false;
     }
-    VPRINT(this, 1, "Worker %d assigned %zd task(s)\n", (*tasks)[0]->worker,
-           tasks->size());
-    std::vector<void *> worker_data(num_tools_);
+    std::vector<void *> shard_data(num_tools_);
     for (int i = 0; i < num_tools_; ++i)
-        worker_data[i] = tools_[i]->parallel_worker_init((*tasks)[0]->worker);
-    for (analyzer_shard_data_t *tdata : *tasks) {
-        VPRINT(this, 1, "Worker %d starting on trace shard %d\n", tdata->worker,
-               tdata->index);
-        if (!tdata->iter->init()) {
-            tdata->error = "Failed to read from trace" + tdata->trace_file;
-            return;
-        }
-        std::vector<void *> shard_data(num_tools_);
-        for (int i = 0; i < num_tools_; ++i)
-            shard_data[i] = tools_[i]->parallel_shard_init(tdata->index, worker_data[i]);
-        VPRINT(this, 1, "shard_data[0] is %p\n", shard_data[0]);
-        for (; *tdata->iter != *trace_end_; ++(*tdata->iter)) {
-            for (int i = 0; i < num_tools_; ++i) {
-                const memref_t &memref = **tdata->iter;
-                if (!tools_[i]->parallel_shard_memref(shard_data[i], memref)) {
-                    tdata->error = tools_[i]->parallel_shard_error(shard_data[i]);
-                    VPRINT(this, 1,
-                           "Worker %d hit shard memref error %s on trace shard %d\n",
-                           tdata->worker, tdata->error.c_str(), tdata->index);
-                    return;
-                }
-            }
-        }
-        VPRINT(this, 1, "Worker %d finished trace shard %d\n", tdata->worker,
-               tdata->index);
+        shard_data[i] = tools_[i]->parallel_shard_init(tdata->index, worker_data[i]);
+    VPRINT(this, 1, "shard_data[0] is %p\n", shard_data[0]);
+    std::vector<memref_t> batch(MEMREF_BATCH_SIZE);
+    size_t count;
+    while ((count = tdata->iter->read_batch(batch.data(), batch.size())) > 0) {
         for (int i = 0; i < num_tools_; ++i) {
-            if (!tools_[i]->parallel_shard_exit(shard_data[i])) {
+            if (!tools_[i]->parallel_shard_memref_batch(shard_data[i], batch.data(),
+                                                        count)) {
                 tdata->error = tools_[i]->parallel_shard_error(shard_data[i]);
-                VPRINT(this, 1, "Worker %d hit shard exit error %s on trace shard %d\n",
+                VPRINT(this, 1, "Worker %d hit shard memref error %s on trace shard %d\n",
                        tdata->worker, tdata->error.c_str(), tdata->index);
-                return;
+                return false;
             }
         }
     }
+    VPRINT(this, 1, "Worker %d finished trace shard %d\n", tdata->worker, tdata->index);
+    for (int i = 0; i < num_tools_; ++i) {
+        if (!tools_[i]->parallel_shard_exit(shard_data[i])) {
+            tdata->error = tools_[i]->parallel_shard_error(shard_data[i]);
+            VPRINT(this, 1, "Worker %d hit shard exit error %s on trace shard %d\n",
+                   tdata->worker, tdata->error.c_str(), tdata->index);
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+analyzer_t::process_tasks(int worker)
+{
+    // As with the static assignment this replaced, a worker that never gets a
+    // shard never has parallel_worker_init() called.
+    std::vector<void *> worker_data;
+    analyzer_shard_data_t *first = nullptr;
+    while (true) {
+        size_t next = next_shard_.fetch_add(1, std::memory_order_relaxed);
+        if (next >= shard_queue_.size())
+            break;
+        analyzer_shard_data_t *tdata = shard_queue_[next];
+        tdata->worker = worker;
+        if (first == nullptr) {
+            first = tdata;
+            worker_data.resize(num_tools_);
+            for (int i = 0; i < num_tools_; ++i)
+                worker_data[i] = tools_[i]->parallel_worker_init(worker);
+        }
+        auto start = std::chrono::steady_clock::now();
+        bool ok = process_shard(tdata, worker_data);
+        worker_busy_seconds_[worker] +=
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                .count();
+        ++worker_shard_count_[worker];
+        if (!ok)
+            return;
+    }
+    if (first == nullptr) {
+        VPRINT(this, 1, "Worker %d has no tasks\n", worker);
+        return;
+    }
     for (int i = 0; i < num_tools_; ++i) {
         const std::string error = tools_[i]->parallel_worker_exit(worker_data[i]);
         if (!error.empty()) {
-            (*tasks)[0]->error = error;
-            VPRINT(this, 1, "Worker %d hit worker exit error %s\n", (*tasks)[0]->worker,
+            first->error = error;
+            VPRINT(this, 1, "Worker %d hit worker exit error %s\n", worker,
                    error.c_str());
             return;
         }
@@ -295,12 +360,17 @@ analyzer_t::run()
     if (!parallel_) {
         if (!start_reading())
             return false;
-        for (; *serial_trace_iter_ != *trace_end_; ++(*serial_trace_iter_)) {
+        std::vector<memref_t> batch(MEMREF_BATCH_SIZE);
+        size_t count;
+        while ((count = serial_trace_iter_->read_batch(batch.data(), batch.size())) >
+               0) {
+            // Each tool takes the whole batch before the next one: see
+            // analysis_tool_t::process_memref_batch() for what that means for
+            // ordering across tools and on errors.
             for (int i = 0; i < num_tools_; ++i) {
-                memref_t memref = **serial_trace_iter_;
                 // We short-circuit and exit on an error to avoid confusion over
                 // the results and avoid wasted continued work.
-                if (!tools_[i]->process_memref(memref)) {
+                if (!tools_[i]->process_memref_batch(batch.data(), count)) {
                     error_string_ = tools_[i]->get_error_string();
                     return false;
                 }
@@ -315,12 +385,26 @@ analyzer_t::run()
     std::vector<std::thread> threads;
     VPRINT(this, 1, "Creating %d worker threads\n", worker_count_);
     threads.reserve(worker_count_);
-    for (int i = 0; i < worker_count_; ++i) {
-        threads.emplace_back(
-            std::thread(&analyzer_t::process_tasks, this, &worker_tasks_[i]));
-    }
+    next_shard_ = 0;
+    worker_busy_seconds_.assign(worker_count_, 0.);
+    worker_shard_count_.assign(worker_count_, 0);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < worker_count_; ++i)
+        threads.emplace_back(std::thread(&analyzer_t::process_tasks, this, i));
     for (std::thread &thread : threads)
         thread.join();
+    if (verbosity_ >= 1) {
+        double elapsed =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                .count();
+        std::cerr << output_prefix_ << " Worker busy time over " << elapsed << "s:\n";
+        for (int i = 0; i < worker_count_; ++i) {
+            std::cerr << output_prefix_ << "   worker " << i << ": "
+                      << worker_busy_seconds_[i] << "s ("
+                      << (elapsed > 0 ? 100. * worker_busy_seconds_[i] / elapsed : 0.)
+                      << "%) on " << worker_shard_count_[i] << " shard(s)\n";
+        }
+    }
     for (auto &tdata : thread_data_) {
         if (!tdata.error.empty()) {
             error_string_ = tdata.error;
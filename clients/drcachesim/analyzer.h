@@ -43,6 +43,7 @@
  * @brief DrMemtrace top-level trace analysis driver.
  */
 
+#include <atomic>
 #include <iterator>
 #include <memory>
 #include <string>
@@ -116,6 +117,7 @@ protected:
                               const std::string &trace_file)
             : index(index)
             , worker(0)
+            , size(0)
             , iter(std::move(iter))
             , trace_file(trace_file)
         {
@@ -124,6 +126,7 @@ protected:
         {
             index = src.index;
             worker = src.worker;
+            size = src.size;
             iter = std::move(src.iter);
             trace_file = std::move(src.trace_file);
             error = std::move(src.error);
@@ -131,6 +134,9 @@ protected:
 
         int index;
         int worker;
+        // The trace file size, used to schedule large shards first, or 0 if
+        // it is unknown.
+        uint64_t size;
         std::unique_ptr<reader_t> iter;
         std::string trace_file;
         std::string error;
@@ -149,8 +155,12 @@ protected:
     bool
     start_reading();
 
+    // Run by each worker thread: claims shards from shard_queue_ until none are
+    // left.
     void
-    process_tasks(std::vector<analyzer_shard_data_t *> *tasks);
+    process_tasks(int worker);
+    bool
+    process_shard(analyzer_shard_data_t *tdata, std::vector<void *> &worker_data);
 
     bool success_;
     std::string error_string_;
@@ -161,7 +171,13 @@ protected:
     analysis_tool_t **tools_;
     bool parallel_;
     int worker_count_;
-    std::vector<std::vector<analyzer_shard_data_t *>> worker_tasks_;
+    // Shards are handed out dynamically, largest first, as workers become free:
+    // next_shard_ indexes shard_queue_.
+    std::vector<analyzer_shard_data_t *> shard_queue_;
+    std::atomic<size_t> next_shard_;
+    // Per-worker time spent processing shards, and the shard count.
+    std::vector<double> worker_busy_seconds_;
+    std::vector<int> worker_shard_count_;
     int verbosity_ = 0;
     const char *output_prefix_ = "[analyzer]";
 };
@@ -39,6 +39,7 @@
 #include "tracer/raw2trace_directory.h"
 #include "tracer/raw2trace.h"
 #include "reader/file_reader.h"
+#include "reader/read_ahead.h"
 #ifdef HAS_ZLIB
 #    include "reader/compressed_file_reader.h"
 #endif
@@ -206,6 +207,11 @@ analyzer_multi_t::analyzer_multi_t( sdt_probe_t *probe_list )
         if (!init_file_reader(op_infile.get_value(), op_verbose.get_value()))
             success_ = false;
     }
+    // Each parallel worker already decompresses its own shard, and funneling
+    // them all through the shared read-ahead pool would cap decompression at
+    // the pool's size.  The readers set up read-ahead on their first read, so
+    // it is not too late to decide here.
+    read_ahead_file_t::set_jobs(parallel_ ? 0 : op_read_ahead_jobs.get_value());
     // We can't call serial_trace_iter_->init() here as it blocks for ipc_reader_t.
 }
 
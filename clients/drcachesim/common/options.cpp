@@ -87,6 +87,16 @@ droption_t<int> op_jobs(
     "negative value sets the job count to the number of hardware threads, "
     "with a cap of 16.");
 
+droption_t<unsigned int> op_read_ahead_jobs(
+    DROPTION_SCOPE_FRONTEND, "read_ahead_jobs", 2,
+    "Threads decompressing trace files ahead of analysis",
+    "When reading gzip- or snappy-compressed trace files, this many background threads "
+    "decompress each file a bounded number of chunks ahead of the analysis threads, "
+    "which then only copy out already-decompressed data.  The threads are shared by all "
+    "files.  0 disables read-ahead and decompresses on the analysis threads.  Read-ahead "
+    "is not used when -jobs analyzes the files in parallel, as each worker thread then "
+    "decompresses its own file.");
+
 droption_t<std::string> op_module_file(
     DROPTION_SCOPE_ALL, "module_file", "", "Path to modules.log for opcode_mix tool",
     "The opcode_mix tool needs the modules.log file (generated by the offline "
@@ -109,6 +119,16 @@ droption_t<std::string> op_funclist_file(
     "directory as the trace file, or a raw/ subdirectory below the trace file, this "
     "parameter can be omitted.");
 
+droption_t<std::string> op_vm_maps_file(
+    DROPTION_SCOPE_ALL, "vm_maps_file", "",
+    "Path to the virtual memory map snapshot for the simulators",
+    "The cache and TLB simulators locate the traced application's code segment using "
+    "the snapshot of its virtual memory map that was recorded at process exit during "
+    "offline tracing.  This data is stored in its own separate file in the raw/ "
+    "subdirectory.  If the file is named vm_maps.bin and is in the same directory as "
+    "the trace file, or a raw/ subdirectory below the trace file, this parameter can "
+    "be omitted.  For online simulation the live /proc map of the process is used.");
+
 droption_t<unsigned int> op_num_cores(DROPTION_SCOPE_FRONTEND, "cores", 4,
                                       "Number of cores",
                                       "Specifies the number of cores to simulate.");
@@ -144,6 +164,53 @@ droption_t<bool> op_cache_line_utilization(
     );
 
 
+droption_t<bool> op_flat_block_storage(
+    DROPTION_SCOPE_FRONTEND, "flat_block_storage", false,
+    "Store simulated cache and TLB blocks in flat per-set arrays",
+    "By default each simulated cache or TLB block is a separately allocated object.  "
+    "This option instead keeps the tags, replacement counters and valid bits of each "
+    "set in contiguous arrays, with line utilization bitmaps in a separate array, which "
+    "speeds up lookups in large, highly associative caches and TLBs.  The tags of a set "
+    "are then compared with SIMD instructions where the processor supports them.");
+
+droption_t<unsigned int> op_l1_jobs(
+    DROPTION_SCOPE_FRONTEND, "l1_jobs", 0,
+    "Number of threads simulating the private L1 caches",
+    "By default the cache simulator runs every cache on the analysis thread.  A non-zero "
+    "value instead simulates the private L1 caches of the cores on up to this many "
+    "worker threads, one core's caches per thread at a time, while the analysis thread "
+    "replays their misses on the shared last-level cache in trace order.  The results "
+    "are identical to those of a serial simulation.  Not supported with -coherence.  "
+    "With -warmup_fraction the warmup is detected at the granularity of a batch of "
+    "references rather than of a single reference.");
+
+droption_t<bool> op_region_stats(
+    DROPTION_SCOPE_FRONTEND, "region_stats", false,
+    "Attribute accesses and LLC misses to memory mappings",
+    "Attributes every simulated reference and every last-level cache hit and miss to "
+    "the mapping of the traced process that it touches: each mmap, shared library, "
+    "anonymous region and thread stack in the process's memory map.  The table, sorted "
+    "by LLC misses, is written to region_stats.txt in -stats_dir.  Offline this needs "
+    "the memory map snapshot recorded by the tracer (see -vm_maps_file).");
+
+droption_t<std::string> op_page_stats_sizes(
+    DROPTION_SCOPE_FRONTEND, "page_stats_sizes", "4K,64K,1M",
+    "Page sizes to report page usage stats for",
+    "A comma-separated list of power-of-two page sizes, each at least 4K, with a K, M or "
+    "G suffix, for which to write page usage stats (e.g., 4K,16K,64K,1M,2M).  Only 4KiB "
+    "pages are tracked while simulating; each larger size is derived from them when the "
+    "stats are written, so adding sizes does not slow down simulation.");
+
+droption_t<std::string> op_stats_format(
+    DROPTION_SCOPE_FRONTEND, "stats_format", "text",
+    "Format of the page usage, line utilization and miss dumps",
+    "Specifies how the page usage files, the per-cache line utilization histograms "
+    "and the -LL_miss_file are written: \"text\" (the default, .dat files), "
+    "\"binary\" (.bin files) or, when built with zlib, \"binary_gz\" (.bin.gz files).  "
+    "The miss file keeps the path it is given.  The binary formats are "
+    "versioned, with packed bitmaps and varint counters, and are much smaller and "
+    "faster to write.  The stats2text tool converts them back into the text format.");
+
 droption_t<unsigned int> op_line_size(
     DROPTION_SCOPE_FRONTEND, "line_size", 64, "Cache line size",
     "Specifies the cache line size, which is assumed to be identical for L1 and L2 "
@@ -185,11 +252,67 @@ droption_t<std::string> op_LL_miss_file(
     "If non-empty, when running the cache simulator, requests that "
     "every last-level cache miss be written to a file at the specified path. Each miss "
     "is written in text format as a <program counter, address> pair. If this tool is "
-    "linked with zlib, the file is written in gzip-compressed format. If non-empty, when "
+    "linked with zlib, the file is written in gzip-compressed format. With a binary "
+    "-stats_format, each miss is instead a delta-encoded <program counter, address, "
+    "type, thread, timestamp> record, where the timestamp counts the cache's accesses; "
+    "stats2text prints these as text. The misses are written by a background thread. "
+    "If non-empty, when "
     "running the cache miss analyzer, requests that prefetching hints based on the miss "
     "analysis be written to the specified file. Each hint is written in text format as a "
     "<program counter, stride, locality level> tuple.");
 
+droption_t<std::string> op_checkpoint_out(
+    DROPTION_SCOPE_FRONTEND, "checkpoint_out", "",
+    "Path to save the cache simulator's state to",
+    "If non-empty, the cache simulator writes the state of the whole hierarchy to this "
+    "path once, at the point picked by -checkpoint_at.  The state covers the blocks "
+    "with their replacement counters and used bytes, the stats, the page usage and "
+    "-region_stats counters, the coherence directory and the thread to core mappings, "
+    "and is restored with -checkpoint_in.");
+
+droption_t<std::string> op_checkpoint_at(
+    DROPTION_SCOPE_FRONTEND, "checkpoint_at", "warmup",
+    "When to write -checkpoint_out: warmup or start",
+    "Picks when -checkpoint_out is written: 'warmup' once the caches are warmed up by "
+    "-warmup_refs or -warmup_fraction, after the stats are reset, or 'start' once the "
+    "first instruction at the recording start point given by -sdt_start has been "
+    "simulated.");
+
+droption_t<std::string> op_checkpoint_in(
+    DROPTION_SCOPE_FRONTEND, "checkpoint_in", "",
+    "Path to restore the cache simulator's state from",
+    "If non-empty, the cache simulator starts from the state saved by -checkpoint_out "
+    "rather than from empty caches.  The cache hierarchy must have the same caches "
+    "with the same geometry, while options that do not change the state, such as "
+    "the prefetcher, may differ.  The references consumed before the checkpoint are "
+    "dropped without being simulated, replacing -skip_refs, so the same trace must be "
+    "given.  A checkpoint taken after warmup skips the warmup, and one taken during "
+    "-warmup_refs resumes the remaining count.  The remaining -sim_refs count is "
+    "restored as well, replacing -sim_refs.  -region_stats must be given to both runs "
+    "or to neither.");
+
+droption_t<unsigned int> op_LL_sample_ratio(
+    DROPTION_SCOPE_FRONTEND, "LL_sample_ratio", 1,
+    "Simulate one in this many last-level cache sets",
+    "When above 1, the last-level cache, and each -LL_sweep configuration, only "
+    "simulates one in this many of its sets and drops the lines that map to the others, "
+    "cutting its memory and time by about this factor.  Must be a power of 2 no larger "
+    "than the number of sets.  The reported hits and misses are those of the sampled "
+    "sets; the stats add the estimated total misses and a 95% confidence interval for "
+    "the miss rate.  Warmup by -warmup_fraction uses the sampled sets.");
+
+droption_t<std::string> op_LL_sweep(
+    DROPTION_SCOPE_FRONTEND, "LL_sweep", "",
+    "Extra last-level cache configurations to simulate in the same pass",
+    "A comma-separated list of size:assoc[:policy] last-level cache configurations, "
+    "e.g., 1M:8,2M:16,4M:16:FIFO, to simulate alongside -LL_size and -LL_assoc.  Sizes "
+    "take an optional K, M or G suffix and must be below 2G; the associativity defaults "
+    "to -LL_assoc and the policy to -replace_policy when omitted.  Every configuration "
+    "sees exactly the requests the regular last-level cache sees, so its results match "
+    "a separate run with that geometry, while the trace and the L1 caches are processed "
+    "once.  A table of the hits and misses of each configuration is written to "
+    "LL_sweep.txt in -stats_dir.");
+
 droption_t<bool> op_L0_filter(
     DROPTION_SCOPE_CLIENT, "L0_filter", false,
     "Filter out first-level cache hits during tracing",
@@ -225,6 +348,14 @@ droption_t<bool> op_coherence(
     DROPTION_SCOPE_FRONTEND, "coherence", false, "Model coherence for private caches",
     "Writes to cache lines will invalidate other private caches that hold that line.");
 
+droption_t<bytesize_t> op_coherence_directory_entries(
+    DROPTION_SCOPE_FRONTEND, "coherence_directory_entries", 0,
+    "Bound on the coherence directory size",
+    "By default -coherence tracks the sharers of every line held in a private cache.  "
+    "A non-zero value instead models a sparse directory of this many entries: adding "
+    "a line to a full directory evicts another line's entry and invalidates that line "
+    "in every private cache holding it.");
+
 droption_t<bool> op_use_physical(
     DROPTION_SCOPE_CLIENT, "use_physical", false, "Use physical addresses if possible",
     "If available, the default virtual addresses will be translated to physical.  "
@@ -297,10 +428,10 @@ droption_t<bool> op_online_instr_types(
 
 droption_t<std::string> op_replace_policy(
     DROPTION_SCOPE_FRONTEND, "replace_policy", REPLACE_POLICY_LRU,
-    "Cache replacement policy (LRU, LFU, FIFO)",
+    "Cache replacement policy (LRU, LFU, FIFO, PLRU)",
     "Specifies the replacement policy for "
     "caches. Supported policies: LRU (Least Recently Used), LFU (Least Frequently Used), "
-    "FIFO (First-In-First-Out).");
+    "FIFO (First-In-First-Out), PLRU (tree Pseudo-LRU).");
 
 droption_t<std::string> op_data_prefetcher(
     DROPTION_SCOPE_FRONTEND, "data_prefetcher", PREFETCH_POLICY_NEXTLINE,
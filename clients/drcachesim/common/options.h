@@ -39,6 +39,7 @@
 #define REPLACE_POLICY_LRU "LRU"
 #define REPLACE_POLICY_LFU "LFU"
 #define REPLACE_POLICY_FIFO "FIFO"
+#define REPLACE_POLICY_PLRU "PLRU"
 #define PREFETCH_POLICY_NEXTLINE "nextline"
 #define PREFETCH_POLICY_NONE "none"
 #define CPU_CACHE "cache"
@@ -70,12 +71,18 @@ extern droption_t<std::string>  op_indir;
 extern droption_t<std::string>  op_module_file;
 extern droption_t<std::string>  op_alt_module_dir;
 extern droption_t<std::string>  op_funclist_file;
+extern droption_t<std::string>  op_vm_maps_file;
 extern droption_t<unsigned int> op_num_cores;
 extern droption_t<std::string>  op_stats_dir;
 extern droption_t<std::string>  op_sdt_record_start;
 extern droption_t<std::string>  op_sdt_record_stop;
 extern droption_t<std::string>  op_sdt_binary;
 extern droption_t<bool>         op_cache_line_utilization;
+extern droption_t<bool>         op_flat_block_storage;
+extern droption_t<unsigned int> op_l1_jobs;
+extern droption_t<bool>         op_region_stats;
+extern droption_t<std::string>  op_page_stats_sizes;
+extern droption_t<std::string>  op_stats_format;
 extern droption_t<unsigned int> op_line_size;
 extern droption_t<bytesize_t> op_L1I_size;
 extern droption_t<bytesize_t> op_L1D_size;
@@ -84,11 +91,17 @@ extern droption_t<unsigned int> op_L1D_assoc;
 extern droption_t<bytesize_t> op_LL_size;
 extern droption_t<unsigned int> op_LL_assoc;
 extern droption_t<std::string> op_LL_miss_file;
+extern droption_t<std::string> op_LL_sweep;
+extern droption_t<unsigned int> op_LL_sample_ratio;
+extern droption_t<std::string> op_checkpoint_out;
+extern droption_t<std::string> op_checkpoint_at;
+extern droption_t<std::string> op_checkpoint_in;
 extern droption_t<bytesize_t> op_L0I_size;
 extern droption_t<bool> op_L0_filter;
 extern droption_t<bytesize_t> op_L0D_size;
 extern droption_t<bool> op_instr_only_trace;
 extern droption_t<bool> op_coherence;
+extern droption_t<bytesize_t> op_coherence_directory_entries;
 extern droption_t<bool> op_use_physical;
 extern droption_t<unsigned int> op_virt2phys_freq;
 extern droption_t<bool> op_cpu_scheduling;
@@ -111,6 +124,7 @@ extern droption_t<std::string> op_simulator_type;
 extern droption_t<unsigned int> op_verbose;
 extern droption_t<bool> op_show_func_trace;
 extern droption_t<int> op_jobs;
+extern droption_t<unsigned int> op_read_ahead_jobs;
 extern droption_t<bool> op_test_mode;
 extern droption_t<std::string> op_test_mode_name;
 extern droption_t<bool> op_disable_optimizations;
@@ -564,4 +564,11 @@ typedef union {
  */
 #define DRMEMTRACE_FUNCTION_LIST_FILENAME "funclist.log"
 
+/**
+ * The name of the file in -offline mode where a snapshot of the traced process's
+ * virtual memory map (its /proc/self/maps at exit) is written.  It is consumed by
+ * the cache simulator in place of reading /proc for a process that no longer exists.
+ */
+#define DRMEMTRACE_VM_MAPS_FILENAME "vm_maps.bin"
+
 #endif /* _TRACE_ENTRY_H_ */
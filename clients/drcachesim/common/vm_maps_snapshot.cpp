@@ -0,0 +1,363 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "vm_maps_snapshot.h"
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+#include <map>
+
+static const char VM_MAPS_SNAPSHOT_MAGIC[4] = { 'V', 'M', 'M', 'P' };
+
+namespace {
+
+/* Writes varints into a fixed-size buffer, remembering whether it overflowed. */
+class snapshot_writer_t {
+public:
+    snapshot_writer_t(char *out, size_t size)
+        : cur_(out)
+        , end_(out + size)
+    {
+    }
+    void
+    put_bytes(const char *bytes, size_t len)
+    {
+        if (len > static_cast<size_t>(end_ - cur_)) {
+            cur_ = end_;
+            overflow_ = true;
+            return;
+        }
+        memcpy(cur_, bytes, len);
+        cur_ += len;
+    }
+    void
+    put_varint(uint64_t val)
+    {
+        do {
+            char byte = static_cast<char>(val & 0x7f);
+            val >>= 7;
+            if (val != 0)
+                byte |= 0x80;
+            put_bytes(&byte, 1);
+        } while (val != 0);
+    }
+    char *
+    cur() const
+    {
+        return cur_;
+    }
+    bool
+    overflow() const
+    {
+        return overflow_;
+    }
+
+private:
+    char *cur_;
+    char *end_;
+    bool overflow_ = false;
+};
+
+class snapshot_parser_t {
+public:
+    snapshot_parser_t(const char *data, size_t size)
+        : cur_(data)
+        , end_(data + size)
+    {
+    }
+    bool
+    get_varint(uint64_t *val)
+    {
+        *val = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (cur_ == end_)
+                return false;
+            const uint8_t byte = static_cast<uint8_t>(*cur_++);
+            *val |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+    bool
+    get_string(std::string *str)
+    {
+        uint64_t len;
+        if (!get_varint(&len) || len > static_cast<uint64_t>(end_ - cur_))
+            return false;
+        str->assign(cur_, static_cast<size_t>(len));
+        cur_ += len;
+        return true;
+    }
+    bool
+    get_magic()
+    {
+        if (end_ - cur_ < static_cast<ptrdiff_t>(sizeof(VM_MAPS_SNAPSHOT_MAGIC)) ||
+            memcmp(cur_, VM_MAPS_SNAPSHOT_MAGIC, sizeof(VM_MAPS_SNAPSHOT_MAGIC)) != 0)
+            return false;
+        cur_ += sizeof(VM_MAPS_SNAPSHOT_MAGIC);
+        return true;
+    }
+    bool
+    at_end() const
+    {
+        return cur_ == end_;
+    }
+    // Whether the next snapshot starts here.  The first byte of a record is
+    // its perms and flags, which are never the first byte of the magic.
+    bool
+    at_magic() const
+    {
+        return end_ - cur_ >= static_cast<ptrdiff_t>(sizeof(VM_MAPS_SNAPSHOT_MAGIC)) &&
+            memcmp(cur_, VM_MAPS_SNAPSHOT_MAGIC, sizeof(VM_MAPS_SNAPSHOT_MAGIC)) == 0;
+    }
+
+private:
+    const char *cur_;
+    const char *end_;
+};
+
+/* The address deltas are zigzag-encoded in case a map is ever not sorted. */
+uint64_t
+zigzag(int64_t val)
+{
+    return (static_cast<uint64_t>(val) << 1) ^ static_cast<uint64_t>(val >> 63);
+}
+
+int64_t
+unzigzag(uint64_t val)
+{
+    return static_cast<int64_t>(val >> 1) ^ -static_cast<int64_t>(val & 1);
+}
+
+/* Parses a number in the given base from [*pos, end), advancing *pos. */
+bool
+parse_number(const char **pos, const char *end, unsigned base, uint64_t *val)
+{
+    const char *start = *pos;
+    *val = 0;
+    for (; *pos < end; ++*pos) {
+        const char c = **pos;
+        unsigned digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (base == 16 && c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (base == 16 && c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            break;
+        *val = *val * base + digit;
+    }
+    return *pos > start;
+}
+
+bool
+expect_char(const char **pos, const char *end, char c)
+{
+    if (*pos == end || **pos != c)
+        return false;
+    ++*pos;
+    return true;
+}
+
+void
+skip_spaces(const char **pos, const char *end)
+{
+    while (*pos < end && **pos == ' ')
+        ++*pos;
+}
+
+/* Parses one "start-end perms offset major:minor inode pathname" line. */
+bool
+parse_maps_line(const char *line, const char *end, vm_maps_region_t *region,
+                const char **path, size_t *path_len)
+{
+    const char *pos = line;
+    uint64_t major, minor;
+    if (!parse_number(&pos, end, 16, &region->start) || !expect_char(&pos, end, '-') ||
+        !parse_number(&pos, end, 16, &region->end) || !expect_char(&pos, end, ' '))
+        return false;
+    if (end - pos < 4)
+        return false;
+    region->perms = 0;
+    if (pos[0] == 'r')
+        region->perms |= VM_MAPS_PERM_READ;
+    if (pos[1] == 'w')
+        region->perms |= VM_MAPS_PERM_WRITE;
+    if (pos[2] == 'x')
+        region->perms |= VM_MAPS_PERM_EXECUTE;
+    if (pos[3] == 's')
+        region->perms |= VM_MAPS_PERM_SHARED;
+    pos += 4;
+    skip_spaces(&pos, end);
+    if (!parse_number(&pos, end, 16, &region->offset))
+        return false;
+    skip_spaces(&pos, end);
+    if (!parse_number(&pos, end, 16, &major) || !expect_char(&pos, end, ':') ||
+        !parse_number(&pos, end, 16, &minor))
+        return false;
+    region->dev_major = static_cast<uint32_t>(major);
+    region->dev_minor = static_cast<uint32_t>(minor);
+    skip_spaces(&pos, end);
+    if (!parse_number(&pos, end, 10, &region->inode))
+        return false;
+    skip_spaces(&pos, end);
+    *path = pos;
+    *path_len = end - pos;
+    return true;
+}
+
+} // namespace
+
+size_t
+vm_maps_snapshot_max_size(const char *bin_path, size_t maps_size)
+{
+    // Every field of a record takes no more varint bytes than the shortest
+    // possible maps line has characters, and paths are copied verbatim.
+    return sizeof(VM_MAPS_SNAPSHOT_MAGIC) + 3 * 10 + strlen(bin_path) + 4 * maps_size;
+}
+
+size_t
+vm_maps_snapshot_encode(uint64_t pid, const char *bin_path, const char *maps_text,
+                        size_t maps_size, char *out, size_t out_size)
+{
+    snapshot_writer_t writer(out, out_size);
+    writer.put_bytes(VM_MAPS_SNAPSHOT_MAGIC, sizeof(VM_MAPS_SNAPSHOT_MAGIC));
+    writer.put_varint(VM_MAPS_SNAPSHOT_VERSION);
+    writer.put_varint(pid);
+    const size_t bin_path_len = strlen(bin_path);
+    writer.put_varint(bin_path_len);
+    writer.put_bytes(bin_path, bin_path_len);
+
+    const char *text_end = maps_text + maps_size;
+    const char *prev_path = nullptr;
+    size_t prev_path_len = 0;
+    uint64_t prev_end = 0;
+    for (const char *line = maps_text; line < text_end;) {
+        const char *eol = static_cast<const char *>(memchr(line, '\n', text_end - line));
+        if (eol == nullptr)
+            eol = text_end;
+        vm_maps_region_t region;
+        const char *path;
+        size_t path_len;
+        if (parse_maps_line(line, eol, &region, &path, &path_len)) {
+            const bool same_path = prev_path != nullptr && path_len == prev_path_len &&
+                memcmp(path, prev_path, path_len) == 0;
+            writer.put_varint(region.perms | (same_path ? VM_MAPS_SAME_PATH : 0));
+            writer.put_varint(zigzag(static_cast<int64_t>(region.start - prev_end)));
+            writer.put_varint(region.end - region.start);
+            writer.put_varint(region.offset);
+            writer.put_varint(region.dev_major);
+            writer.put_varint(region.dev_minor);
+            writer.put_varint(region.inode);
+            if (!same_path) {
+                writer.put_varint(path_len);
+                writer.put_bytes(path, path_len);
+            }
+            prev_path = path;
+            prev_path_len = path_len;
+            prev_end = region.end;
+        }
+        line = eol + 1;
+    }
+    if (writer.overflow())
+        return 0;
+    return writer.cur() - out;
+}
+
+bool
+vm_maps_snapshot_decode(const char *data, size_t size, uint64_t *pid,
+                        std::string *bin_path, std::vector<vm_maps_region_t> *regions)
+{
+    snapshot_parser_t parser(data, size);
+    std::vector<std::vector<vm_maps_region_t>> snapshots;
+    do {
+        uint64_t version, snapshot_pid;
+        std::string snapshot_bin_path;
+        if (!parser.get_magic() || !parser.get_varint(&version) ||
+            version != VM_MAPS_SNAPSHOT_VERSION || !parser.get_varint(&snapshot_pid) ||
+            !parser.get_string(&snapshot_bin_path))
+            return false;
+        if (snapshots.empty()) {
+            *pid = snapshot_pid;
+            *bin_path = snapshot_bin_path;
+        } else if (snapshot_pid != *pid)
+            return false;
+        snapshots.emplace_back();
+        std::vector<vm_maps_region_t> &snapshot = snapshots.back();
+        uint64_t prev_end = 0;
+        while (!parser.at_end() && !parser.at_magic()) {
+            uint64_t flags, delta, length, major, minor;
+            vm_maps_region_t region;
+            if (!parser.get_varint(&flags) || !parser.get_varint(&delta) ||
+                !parser.get_varint(&length) || !parser.get_varint(&region.offset) ||
+                !parser.get_varint(&major) || !parser.get_varint(&minor) ||
+                !parser.get_varint(&region.inode))
+                return false;
+            region.perms = static_cast<uint32_t>(flags & ~VM_MAPS_SAME_PATH);
+            region.start = prev_end + static_cast<uint64_t>(unzigzag(delta));
+            region.end = region.start + length;
+            region.dev_major = static_cast<uint32_t>(major);
+            region.dev_minor = static_cast<uint32_t>(minor);
+            if ((flags & VM_MAPS_SAME_PATH) != 0) {
+                if (snapshot.empty())
+                    return false;
+                region.pathname = snapshot.back().pathname;
+            } else if (!parser.get_string(&region.pathname))
+                return false;
+            prev_end = region.end;
+            snapshot.push_back(region);
+        }
+    } while (!parser.at_end());
+
+    // The latest snapshot wins.  An earlier region is kept only where nothing
+    // later was mapped over it, which recovers what was unmapped in between.
+    std::map<uint64_t, uint64_t> taken; // Start to end.
+    regions->clear();
+    for (auto snapshot = snapshots.rbegin(); snapshot != snapshots.rend(); ++snapshot) {
+        for (const vm_maps_region_t &region : *snapshot) {
+            auto next = taken.lower_bound(region.start);
+            if (next != taken.end() && next->first < region.end)
+                continue;
+            if (next != taken.begin() && std::prev(next)->second > region.start)
+                continue;
+            taken.emplace(region.start, region.end);
+            regions->push_back(region);
+        }
+    }
+    std::sort(regions->begin(), regions->end(),
+              [](const vm_maps_region_t &a, const vm_maps_region_t &b) {
+                  return a.start < b.start;
+              });
+    return true;
+}
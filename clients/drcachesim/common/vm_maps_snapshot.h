@@ -0,0 +1,102 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* vm_maps_snapshot: a compact binary encoding of a process's virtual memory map.
+ *
+ * The tracer records the text of /proc/self/maps in DRMEMTRACE_VM_MAPS_FILENAME
+ * so that the simulators can locate the traced application's segments without
+ * reading /proc for a process that is long gone.  It takes a snapshot at attach,
+ * before each module is unloaded and at exit, and appends them to the file in
+ * that order, so mappings gone by exit are still found in an earlier snapshot.
+ *
+ * The encoding is the 4-byte magic "VMMP" followed by LEB128 varints:
+ *   version, pid, bin_path length, bin_path bytes,
+ * and then one record per mapping until the end of the data:
+ *   perms | flags, start - previous end, end - start, offset, dev major, dev minor,
+ *   inode, and, unless VM_MAPS_SAME_PATH is set, pathname length and bytes.
+ * Mappings are sorted and most share their path with the previous one, so a
+ * typical record is a handful of bytes.  The next snapshot, if any, starts with
+ * the magic again.
+ */
+
+#ifndef _VM_MAPS_SNAPSHOT_H_
+#define _VM_MAPS_SNAPSHOT_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define VM_MAPS_SNAPSHOT_VERSION 1
+
+/* The perms bits match vm_maps_entry_t::page_permissions. */
+enum {
+    VM_MAPS_PERM_READ = 0x1,
+    VM_MAPS_PERM_WRITE = 0x2,
+    VM_MAPS_PERM_EXECUTE = 0x4,
+    VM_MAPS_PERM_SHARED = 0x8,
+    VM_MAPS_SAME_PATH = 0x10,
+};
+
+struct vm_maps_region_t {
+    uint64_t start = 0;
+    uint64_t end = 0; /* Exclusive, as in /proc/<pid>/maps. */
+    uint64_t offset = 0;
+    uint64_t inode = 0;
+    uint32_t perms = 0;
+    uint32_t dev_major = 0;
+    uint32_t dev_minor = 0;
+    std::string pathname;
+};
+
+/* Returns an upper bound on the encoded size of a maps file of maps_size bytes. */
+size_t
+vm_maps_snapshot_max_size(const char *bin_path, size_t maps_size);
+
+/* Encodes the text of a /proc/<pid>/maps file into out.  This does not allocate
+ * memory so that the tracer can call it at exit.  Returns the number of bytes
+ * written, or 0 if out_size is too small.
+ */
+size_t
+vm_maps_snapshot_encode(uint64_t pid, const char *bin_path, const char *maps_text,
+                        size_t maps_size, char *out, size_t out_size);
+
+/* Decodes one or more snapshots produced by vm_maps_snapshot_encode() and laid
+ * end to end, merging them into one sorted map.  Where mappings overlap, the
+ * later snapshot's are used.  Returns false if the data is not a valid sequence
+ * of snapshots of one process.
+ */
+bool
+vm_maps_snapshot_decode(const char *data, size_t size, uint64_t *pid,
+                        std::string *bin_path, std::vector<vm_maps_region_t> *regions);
+
+#endif /* _VM_MAPS_SNAPSHOT_H_ */
@@ -37,6 +37,8 @@ template <>
 /* clang-format on */
 file_reader_t<gzFile>::~file_reader_t<gzFile>()
 {
+    // Stop the fills before closing their files.
+    read_ahead_.clear();
     for (auto file : input_files_)
         gzclose(file);
     delete[] thread_eof_;
@@ -59,7 +61,19 @@ bool
 file_reader_t<gzFile>::read_next_thread_entry(size_t thread_index,
                                               OUT trace_entry_t *entry, OUT bool *eof)
 {
-    int len = gzread(input_files_[thread_index], (char *)entry, sizeof(*entry));
+    if (!read_ahead_initialized_) {
+        init_read_ahead([this](size_t index) {
+            gzFile file = input_files_[index];
+            return [file](void *buf, size_t size) {
+                return gzread(file, buf, (unsigned int)size);
+            };
+        });
+    }
+    int len;
+    if (read_ahead_.empty())
+        len = gzread(input_files_[thread_index], (char *)entry, sizeof(*entry));
+    else
+        len = read_ahead_[thread_index]->read(entry, sizeof(*entry));
     // Returns less than asked-for for end of file, or –1 for error.
     if (len < (int)sizeof(*entry)) {
         *eof = (len >= 0);
@@ -268,7 +268,7 @@ config_reader_t::configure_cache(cache_params_t &cache)
             }
         } else if (param == "replace_policy") {
             // Cache replacement policy: REPLACE_POLICY_LRU (default),
-            // REPLACE_POLICY_LFU or REPLACE_POLICY_FIFO.
+            // REPLACE_POLICY_LFU, REPLACE_POLICY_FIFO or REPLACE_POLICY_PLRU.
             if (!(*fin_ >> cache.replace_policy)) {
                 ERRMSG("Error reading cache replace_policy from "
                        "the configuration file\n");
@@ -277,7 +277,8 @@ config_reader_t::configure_cache(cache_params_t &cache)
             if (cache.replace_policy != REPLACE_POLICY_NON_SPECIFIED &&
                 cache.replace_policy != REPLACE_POLICY_LRU &&
                 cache.replace_policy != REPLACE_POLICY_LFU &&
-                cache.replace_policy != REPLACE_POLICY_FIFO) {
+                cache.replace_policy != REPLACE_POLICY_FIFO &&
+                cache.replace_policy != REPLACE_POLICY_PLRU) {
                 ERRMSG("Unknown replacement policy: %s\n", cache.replace_policy.c_str());
                 return false;
             }
@@ -40,11 +40,15 @@
 
 #include <string.h>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include <queue>
+#include <utility>
 #include <vector>
 #include "reader.h"
 #include "memref.h"
 #include "directory_iterator.h"
+#include "read_ahead.h"
 #include "trace_entry.h"
 
 #ifndef ZHEX64_FORMAT_STRING
@@ -104,6 +108,13 @@ protected:
     read_next_thread_entry(size_t thread_index, OUT trace_entry_t *entry,
                            OUT bool *eof) override;
 
+    // Returns the next entry from the specified thread, or nullptr with *eof set
+    // as for read_next_thread_entry().  The entry stays valid until the next call.
+    // By default it is read into entry_copy_: readers that can point straight into
+    // their input specialize this to avoid the copy.
+    trace_entry_t *
+    read_next_thread_entry_ptr(size_t thread_index, OUT bool *eof);
+
     virtual bool
     open_single_file(const std::string &path);
 
@@ -132,7 +143,8 @@ protected:
                     continue;
                 // Skip the auxiliary files.
                 if (fname == DRMEMTRACE_MODULE_LIST_FILENAME ||
-                    fname == DRMEMTRACE_FUNCTION_LIST_FILENAME)
+                    fname == DRMEMTRACE_FUNCTION_LIST_FILENAME ||
+                    fname == DRMEMTRACE_VM_MAPS_FILENAME)
                     continue;
                 VPRINT(this, 2, "Found file %s\n", fname.c_str());
                 if (!open_single_file(input_path_ + DIRSEP + fname)) {
@@ -214,32 +226,17 @@ protected:
         // a single interleaved stream in timestamp order.
         // When a thread file runs out we leave its times_[] entry as 0 and its file at
         // eof.
+        // Every thread waiting to run is in time_heap_, keyed by its next timestamp
+        // and then its index, so picking the next one costs O(log threads).
         while (thread_count_ > 0) {
             if (index_ >= input_files_.size()) {
+                if (!read_first_timestamps())
+                    return nullptr;
                 // Pick the next thread by looking for the smallest timestamp.
-                uint64_t min_time = 0xffffffffffffffff;
                 size_t next_index = 0;
-                for (size_t i = 0; i < times_.size(); ++i) {
-                    if (times_[i] == 0 && !thread_eof_[i]) {
-                        if (!read_next_thread_entry(i, &timestamps_[i],
-                                                    &thread_eof_[i])) {
-                            ERRMSG("Failed to read from input file #%zu\n", i);
-                            return nullptr;
-                        }
-                        if (timestamps_[i].type != TRACE_TYPE_MARKER &&
-                            timestamps_[i].size != TRACE_MARKER_TYPE_TIMESTAMP) {
-                            ERRMSG("Missing timestamp entry in input file #%zu\n", i);
-                            return nullptr;
-                        }
-                        times_[i] = timestamps_[i].addr;
-                        VPRINT(this, 3,
-                               "Thread #%zu timestamp is @0x" ZHEX64_FORMAT_STRING "\n",
-                               i, times_[i]);
-                    }
-                    if (times_[i] != 0 && times_[i] < min_time) {
-                        min_time = times_[i];
-                        next_index = i;
-                    }
+                if (!time_heap_.empty()) {
+                    next_index = time_heap_.top().second;
+                    time_heap_.pop();
                 }
                 VPRINT(this, 2,
                        "Next thread in timestamp order is #%zu @0x" ZHEX64_FORMAT_STRING
@@ -262,7 +259,9 @@ protected:
                 return &entry_copy_;
             }
             VPRINT(this, 4, "About to read thread #%zu\n", index_);
-            if (!read_next_thread_entry(index_, &entry_copy_, &thread_eof_[index_])) {
+            trace_entry_t *entry =
+                read_next_thread_entry_ptr(index_, &thread_eof_[index_]);
+            if (entry == nullptr) {
                 if (thread_eof_[index_]) {
                     VPRINT(this, 2, "Thread #%zu at eof\n", index_);
                     --thread_count_;
@@ -279,21 +278,69 @@ protected:
                     return nullptr;
                 }
             }
-            if (entry_copy_.type == TRACE_TYPE_MARKER &&
-                entry_copy_.size == TRACE_MARKER_TYPE_TIMESTAMP) {
+            if (entry->type == TRACE_TYPE_MARKER &&
+                entry->size == TRACE_MARKER_TYPE_TIMESTAMP) {
                 VPRINT(this, 3, "Thread #%zu timestamp 0x" ZHEX64_FORMAT_STRING "\n",
-                       index_, (uint64_t)entry_copy_.addr);
-                times_[index_] = entry_copy_.addr;
-                timestamps_[index_] = entry_copy_;
+                       index_, (uint64_t)entry->addr);
+                times_[index_] = entry->addr;
+                timestamps_[index_] = *entry;
+                if (times_[index_] != 0)
+                    time_heap_.emplace(times_[index_], index_);
                 index_ = input_files_.size(); // Request thread scan.
                 continue;
             }
-            return &entry_copy_;
+            return entry;
         }
         return nullptr;
     }
 
 private:
+    // Reads the timestamp that starts each thread's first chunk, once.
+    bool
+    read_first_timestamps()
+    {
+        if (first_timestamps_read_)
+            return true;
+        first_timestamps_read_ = true;
+        for (size_t i = 0; i < times_.size(); ++i) {
+            if (times_[i] != 0 || thread_eof_[i])
+                continue;
+            if (!read_next_thread_entry(i, &timestamps_[i], &thread_eof_[i])) {
+                ERRMSG("Failed to read from input file #%zu\n", i);
+                return false;
+            }
+            if (timestamps_[i].type != TRACE_TYPE_MARKER &&
+                timestamps_[i].size != TRACE_MARKER_TYPE_TIMESTAMP) {
+                ERRMSG("Missing timestamp entry in input file #%zu\n", i);
+                return false;
+            }
+            times_[i] = timestamps_[i].addr;
+            VPRINT(this, 3, "Thread #%zu timestamp is @0x" ZHEX64_FORMAT_STRING "\n", i,
+                   times_[i]);
+            if (times_[i] != 0)
+                time_heap_.emplace(times_[i], i);
+        }
+        return true;
+    }
+
+    // Starts decompressing every input file ahead of the reader on the
+    // read_ahead_file_t pool, unless it is disabled, in which case read_ahead_
+    // stays empty.  fill_for returns the fill function for one file.  Called
+    // on the first read, once all files are open.
+    void
+    init_read_ahead(std::function<read_ahead_file_t::fill_func_t(size_t)> fill_for)
+    {
+        read_ahead_initialized_ = true;
+        if (!read_ahead_file_t::enabled())
+            return;
+        size_t chunk_size = read_ahead_file_t::chunk_size_for(
+            input_files_.size(), read_ahead_file_t::DEFAULT_DEPTH);
+        for (size_t i = 0; i < input_files_.size(); ++i) {
+            read_ahead_.emplace_back(new read_ahead_file_t(
+                fill_for(i), chunk_size, read_ahead_file_t::DEFAULT_DEPTH));
+        }
+    }
+
     std::string input_path_;
     std::vector<std::string> input_path_list_;
     std::vector<T> input_files_;
@@ -306,7 +353,26 @@ private:
     std::vector<trace_entry_t> tids_;
     std::vector<trace_entry_t> timestamps_;
     std::vector<uint64_t> times_;
+    // Min-heap of (timestamp, index) for the threads waiting to run.  Ties go to
+    // the lowest index.
+    std::priority_queue<std::pair<uint64_t, size_t>,
+                        std::vector<std::pair<uint64_t, size_t>>,
+                        std::greater<std::pair<uint64_t, size_t>>>
+        time_heap_;
+    bool first_timestamps_read_ = false;
     bool *thread_eof_ = nullptr;
+    // Parallel to input_files_ when read-ahead is in use.
+    std::vector<std::unique_ptr<read_ahead_file_t>> read_ahead_;
+    bool read_ahead_initialized_ = false;
 };
 
+template <typename T>
+trace_entry_t *
+file_reader_t<T>::read_next_thread_entry_ptr(size_t thread_index, OUT bool *eof)
+{
+    if (!read_next_thread_entry(thread_index, &entry_copy_, eof))
+        return nullptr;
+    return &entry_copy_;
+}
+
 #endif /* _FILE_READER_H_ */
@@ -0,0 +1,204 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "mmap_file_reader.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+// The granularity of MADV_WILLNEED and of dropping pages behind the cursor.
+static const size_t MMAP_WINDOW = 4 * 1024 * 1024;
+
+// Returns whether path can be opened and does not start with the gzip magic.
+static bool
+is_uncompressed_file(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    unsigned char magic[2];
+    bool res = read(fd, magic, sizeof(magic)) != sizeof(magic) || magic[0] != 0x1f ||
+        magic[1] != 0x8b;
+    close(fd);
+    return res;
+}
+
+bool
+mmap_file_reader_supports(const std::string &path)
+{
+    if (!directory_iterator_t::is_directory(path))
+        return is_uncompressed_file(path);
+    directory_iterator_t end;
+    directory_iterator_t iter(path);
+    if (!iter)
+        return false;
+    for (; iter != end; ++iter) {
+        const std::string fname = *iter;
+        if (fname == "." || fname == ".." || fname == DRMEMTRACE_MODULE_LIST_FILENAME ||
+            fname == DRMEMTRACE_FUNCTION_LIST_FILENAME ||
+            fname == DRMEMTRACE_VM_MAPS_FILENAME)
+            continue;
+        if (!is_uncompressed_file(path + DIRSEP + fname))
+            return false;
+    }
+    return true;
+}
+
+/* clang-format off */ /* (make vera++ newline-after-type check happy) */
+template <>
+/* clang-format on */
+file_reader_t<mmap_file_t *>::~file_reader_t()
+{
+    for (auto file : input_files_) {
+        if (file->base != nullptr)
+            munmap(file->base, file->size);
+        delete file;
+    }
+    delete[] thread_eof_;
+}
+
+template <>
+bool
+file_reader_t<mmap_file_t *>::open_single_file(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    mmap_file_t *file = new mmap_file_t;
+    file->size = st.st_size;
+    if (file->size > 0) {
+        void *map =
+            mmap(nullptr, file->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            delete file;
+            return false;
+        }
+        file->base = (char *)map;
+        madvise(file->base, file->size, MADV_SEQUENTIAL);
+    }
+    // The mapping keeps the file contents available.
+    close(fd);
+    VPRINT(this, 1, "Mapped input file %s\n", path.c_str());
+    input_files_.push_back(file);
+    return true;
+}
+
+template <>
+trace_entry_t *
+file_reader_t<mmap_file_t *>::read_next_thread_entry_ptr(size_t thread_index,
+                                                         OUT bool *eof)
+{
+    mmap_file_t *file = input_files_[thread_index];
+    if (file->size - file->pos < sizeof(trace_entry_t)) {
+        // Like the stream reader, a partial trailing entry counts as the end.
+        *eof = true;
+        return nullptr;
+    }
+    if (file->pos >= file->advised_end) {
+        // Entering a new window: ask for the next one and drop everything more
+        // than a window behind, which is well clear of any entry still in use.
+        // The window is a multiple of the page size, so the ranges are aligned.
+        size_t start = file->advised_end;
+        file->advised_end = std::min(start + MMAP_WINDOW, file->size);
+        madvise(file->base + start, file->advised_end - start, MADV_WILLNEED);
+        if (start >= 2 * MMAP_WINDOW) {
+            size_t drop_end = start - MMAP_WINDOW;
+            madvise(file->base + file->dropped_end, drop_end - file->dropped_end,
+                    MADV_DONTNEED);
+            file->dropped_end = drop_end;
+        }
+    }
+    trace_entry_t *entry = (trace_entry_t *)(file->base + file->pos);
+    file->pos += sizeof(trace_entry_t);
+    VPRINT(this, 4, "Read from thread #%zd file: type=%d, size=%d, addr=%zu\n",
+           thread_index, entry->type, entry->size, entry->addr);
+    return entry;
+}
+
+template <>
+bool
+file_reader_t<mmap_file_t *>::read_next_thread_entry(size_t thread_index,
+                                                     OUT trace_entry_t *entry,
+                                                     OUT bool *eof)
+{
+    trace_entry_t *next = read_next_thread_entry_ptr(thread_index, eof);
+    if (next == nullptr)
+        return false;
+    *entry = *next;
+    return true;
+}
+
+template <>
+bool
+file_reader_t<mmap_file_t *>::is_complete()
+{
+    // We support the is_complete() call from analyzer_multi before init() for a
+    // single file, like the stream reader.
+    bool opened_temporarily = false;
+    if (input_files_.empty()) {
+        opened_temporarily = true;
+        if (!input_path_list_.empty() || input_path_.empty() ||
+            directory_iterator_t::is_directory(input_path_))
+            return false; // Not supported.
+        if (!open_single_file(input_path_))
+            return false;
+    }
+    bool res = false;
+    for (auto file : input_files_) {
+        // The footer is the last entry.  Reading it through the mapping does not
+        // move the cursor.
+        res = file->size >= sizeof(trace_entry_t) &&
+            ((trace_entry_t *)(file->base + file->size - sizeof(trace_entry_t)))
+                    ->type == TRACE_TYPE_FOOTER;
+        if (!res)
+            break;
+    }
+    if (opened_temporarily) {
+        // Put things back for init().
+        for (auto file : input_files_) {
+            if (file->base != nullptr)
+                munmap(file->base, file->size);
+            delete file;
+        }
+        input_files_.clear();
+    }
+    return res;
+}
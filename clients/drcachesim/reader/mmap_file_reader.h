@@ -0,0 +1,72 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* mmap_file_reader: reads uncompressed files containing memory traces by mapping
+ * them, handing out entries that point straight into the mapping.
+ */
+
+#ifndef _MMAP_FILE_READER_H_
+#define _MMAP_FILE_READER_H_ 1
+
+#include "file_reader.h"
+
+// One mapped per-thread trace file.  The kernel is told to read ahead a window
+// at a time in front of the cursor and to drop pages more than a window behind
+// it, so the resident set of a huge trace stays small.
+struct mmap_file_t {
+    // The mapping is private and writable: reader_t rewrites the type of
+    // TRACE_TYPE_INSTR_MAYBE_FETCH entries in place, which just copies the
+    // page.
+    char *base = nullptr;
+    size_t size = 0;
+    size_t pos = 0;
+    // The end of the range passed to MADV_WILLNEED so far.
+    size_t advised_end = 0;
+    // The end of the range already dropped behind the cursor.
+    size_t dropped_end = 0;
+};
+
+typedef file_reader_t<mmap_file_t *> mmap_file_reader_t;
+
+template <>
+trace_entry_t *
+file_reader_t<mmap_file_t *>::read_next_thread_entry_ptr(size_t thread_index,
+                                                         OUT bool *eof);
+
+// Returns whether path, or every file in it if it is a directory, is an
+// uncompressed trace that mmap_file_reader_t can read.  Returns false for a
+// path that does not exist or cannot be opened, leaving the other readers to
+// report the error.
+bool
+mmap_file_reader_supports(const std::string &path);
+
+#endif /* _MMAP_FILE_READER_H_ */
@@ -0,0 +1,254 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "read_ahead.h"
+#include <algorithm>
+#include <cstring>
+
+// The threads shared by all read_ahead_file_t instances, running while any
+// instance exists.
+class read_ahead_pool_t {
+public:
+    static read_ahead_pool_t *
+    acquire()
+    {
+        std::lock_guard<std::mutex> guard(instance_mutex_);
+        if (instance_ == nullptr)
+            instance_ = new read_ahead_pool_t(jobs_);
+        references_++;
+        return instance_;
+    }
+
+    static void
+    release()
+    {
+        read_ahead_pool_t *pool;
+        {
+            std::lock_guard<std::mutex> guard(instance_mutex_);
+            if (references_ == 0 || --references_ > 0)
+                return;
+            pool = instance_;
+            instance_ = nullptr;
+        }
+        delete pool;
+    }
+
+    void
+    submit(read_ahead_file_t *file)
+    {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            queue_.push_back(file);
+        }
+        cv_.notify_one();
+    }
+
+    static unsigned int jobs_;
+
+private:
+    explicit read_ahead_pool_t(unsigned int jobs)
+    {
+        for (unsigned int i = 0; i < std::max(jobs, 1u); ++i)
+            threads_.emplace_back(&read_ahead_pool_t::thread_loop, this);
+    }
+
+    ~read_ahead_pool_t()
+    {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            exiting_ = true;
+        }
+        cv_.notify_all();
+        for (std::thread &thread : threads_)
+            thread.join();
+    }
+
+    void
+    thread_loop()
+    {
+        while (true) {
+            read_ahead_file_t *file;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return exiting_ || !queue_.empty(); });
+                if (queue_.empty())
+                    return;
+                file = queue_.front();
+                queue_.pop_front();
+            }
+            // Round-robin between files rather than filling one file's ring at
+            // a time, so the file the reader is blocked on is reached quickly.
+            if (file->fill_one())
+                submit(file);
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<read_ahead_file_t *> queue_;
+    bool exiting_ = false;
+
+    static std::mutex instance_mutex_;
+    static read_ahead_pool_t *instance_;
+    static int references_;
+};
+
+unsigned int read_ahead_pool_t::jobs_ = 2;
+std::mutex read_ahead_pool_t::instance_mutex_;
+read_ahead_pool_t *read_ahead_pool_t::instance_ = nullptr;
+int read_ahead_pool_t::references_ = 0;
+
+// The total size of all rings at which chunks stop growing.
+static const size_t READ_AHEAD_BUDGET = 256 * 1024 * 1024;
+static const size_t READ_AHEAD_MIN_CHUNK = 16 * 1024;
+static const size_t READ_AHEAD_MAX_CHUNK = 1024 * 1024;
+
+void
+read_ahead_file_t::set_jobs(unsigned int jobs)
+{
+    read_ahead_pool_t::jobs_ = jobs;
+}
+
+bool
+read_ahead_file_t::enabled()
+{
+    return read_ahead_pool_t::jobs_ > 0;
+}
+
+size_t
+read_ahead_file_t::chunk_size_for(size_t num_files, size_t depth)
+{
+    size_t size = READ_AHEAD_BUDGET / (std::max<size_t>(num_files, 1) * depth);
+    return std::min(std::max(size, READ_AHEAD_MIN_CHUNK), READ_AHEAD_MAX_CHUNK);
+}
+
+read_ahead_file_t::read_ahead_file_t(fill_func_t fill, size_t chunk_size, size_t depth)
+    : pool_(read_ahead_pool_t::acquire())
+    , fill_(std::move(fill))
+    , chunk_size_(chunk_size)
+    , slots_(std::max<size_t>(depth, 1))
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    schedule_locked();
+}
+
+read_ahead_file_t::~read_ahead_file_t()
+{
+    {
+        // A queued file is dropped by the pool once it sees closing_.
+        std::unique_lock<std::mutex> lock(mutex_);
+        closing_ = true;
+        cv_.wait(lock, [this] { return !scheduled_; });
+    }
+    read_ahead_pool_t::release();
+}
+
+void
+read_ahead_file_t::schedule_locked()
+{
+    if (scheduled_ || done_ || closing_ || count_ == slots_.size())
+        return;
+    scheduled_ = true;
+    pool_->submit(this);
+}
+
+bool
+read_ahead_file_t::fill_one()
+{
+    size_t slot;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (closing_ || done_ || count_ == slots_.size()) {
+            scheduled_ = false;
+            cv_.notify_all();
+            return false;
+        }
+        slot = (head_ + count_) % slots_.size();
+    }
+    // The slot is not visible to the consumer until count_ covers it.
+    chunk_t &chunk = slots_[slot];
+    chunk.data.resize(chunk_size_);
+    int len = fill_(chunk.data.data(), chunk_size_);
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (len < 0) {
+        error_ = true;
+        done_ = true;
+    } else {
+        chunk.size = len;
+        if (len > 0)
+            count_++;
+        if ((size_t)len < chunk_size_)
+            done_ = true;
+    }
+    const bool again = !closing_ && !done_ && count_ < slots_.size();
+    if (!again)
+        scheduled_ = false;
+    cv_.notify_all();
+    return again;
+}
+
+int
+read_ahead_file_t::read(void *to, size_t size)
+{
+    char *to_buf = (char *)to;
+    size_t copied = 0;
+    while (copied < size) {
+        if (!have_head_) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return count_ > 0 || done_; });
+            if (count_ == 0) {
+                // Everything has been consumed.
+                if (error_)
+                    return -1;
+                break;
+            }
+            // The head slot stays ours until we hand it back below, so the
+            // copies need no lock.
+            have_head_ = true;
+        }
+        chunk_t &chunk = slots_[head_];
+        size_t will_copy = std::min(size - copied, chunk.size - offset_);
+        memcpy(to_buf + copied, chunk.data.data() + offset_, will_copy);
+        copied += will_copy;
+        offset_ += will_copy;
+        if (offset_ == chunk.size) {
+            std::lock_guard<std::mutex> guard(mutex_);
+            head_ = (head_ + 1) % slots_.size();
+            count_--;
+            offset_ = 0;
+            have_head_ = false;
+            schedule_locked();
+        }
+    }
+    return (int)copied;
+}
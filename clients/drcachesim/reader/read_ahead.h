@@ -0,0 +1,127 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* read_ahead: decompresses trace files ahead of the reader on a small pool of
+ * background threads, so that the analysis thread only copies bytes out of
+ * already-inflated chunks.
+ *
+ * Each read_ahead_file_t owns a bounded ring of chunks.  A pool thread fills
+ * the free slots one chunk at a time by calling the file's fill function,
+ * e.g., gzread, while the reader consumes the oldest filled chunk.  Slots
+ * change hands only at chunk boundaries, under the file's lock.  Files
+ * share the pool, which is started by the first file and stopped with the
+ * last one.
+ */
+
+#ifndef _READ_AHEAD_H_
+#define _READ_AHEAD_H_ 1
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class read_ahead_pool_t;
+
+class read_ahead_file_t {
+public:
+    // Reads up to size bytes into buf, returning the count read, which is only
+    // short at the end of the input, or -1 on an error.  It is called on a pool
+    // thread, but never concurrently for one file.
+    typedef std::function<int(void *buf, size_t size)> fill_func_t;
+
+    // The number of chunks per file: one being read, one being filled, and one
+    // of slack to absorb uneven fill times.
+    static const size_t DEFAULT_DEPTH = 3;
+
+    read_ahead_file_t(fill_func_t fill, size_t chunk_size, size_t depth);
+    // Waits for any fill in progress.
+    ~read_ahead_file_t();
+
+    read_ahead_file_t(const read_ahead_file_t &) = delete;
+    read_ahead_file_t &
+    operator=(const read_ahead_file_t &) = delete;
+
+    // The same contract as fill, from the consumer's side.
+    int
+    read(void *to, size_t size);
+
+    // Sets the number of pool threads used by files created afterward.  0
+    // disables read-ahead: see enabled().
+    static void
+    set_jobs(unsigned int jobs);
+    static bool
+    enabled();
+
+    // Picks a chunk size for one of num_files files read concurrently, bounding
+    // the memory used by all of their rings.
+    static size_t
+    chunk_size_for(size_t num_files, size_t depth);
+
+private:
+    friend class read_ahead_pool_t;
+
+    struct chunk_t {
+        std::vector<char> data;
+        size_t size = 0;
+    };
+
+    // Called by the pool: fills one slot.  Returns whether the file wants
+    // another fill right away.
+    bool
+    fill_one();
+    // Requires mutex_.
+    void
+    schedule_locked();
+
+    read_ahead_pool_t *pool_;
+    fill_func_t fill_;
+    size_t chunk_size_;
+    std::vector<chunk_t> slots_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t head_ = 0;  // Oldest filled slot, owned by the consumer.
+    size_t count_ = 0; // Filled slots.
+    bool scheduled_ = false;
+    bool done_ = false;
+    bool error_ = false;
+    bool closing_ = false;
+
+    // Consumer-only: whether slots_[head_] is filled, and the read position in it.
+    bool have_head_ = false;
+    size_t offset_ = 0;
+};
+
+#endif /* _READ_AHEAD_H_ */
@@ -232,3 +232,14 @@ reader_t::operator++()
 
     return *this;
 }
+
+size_t
+reader_t::read_batch(OUT memref_t *batch, size_t max)
+{
+    size_t count = 0;
+    while (count < max && !at_eof_) {
+        batch[count++] = cur_ref_;
+        reader_t::operator++();
+    }
+    return count;
+}
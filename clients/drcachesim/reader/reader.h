@@ -97,6 +97,14 @@ public:
     virtual reader_t &
     operator++();
 
+    // Copies up to max entries starting with the current one into batch and
+    // advances past them, as a loop of operator* and operator++ would, but without
+    // a virtual call per entry.  Returns the count copied, which is 0 only at the
+    // end of the trace.  Subclasses overriding either operator must override this
+    // as well.
+    virtual size_t
+    read_batch(OUT memref_t *batch, size_t max);
+
     // Supplied for subclasses that may fail in their constructors.
     virtual bool operator!()
     {
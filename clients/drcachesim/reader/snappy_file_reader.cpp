@@ -215,7 +215,8 @@ template <>
 /* clang-format on */
 file_reader_t<snappy_reader_t>::~file_reader_t<snappy_reader_t>()
 {
-    // Empty.
+    // Stop the fills before input_files_ goes away.
+    read_ahead_.clear();
 }
 
 template <>
@@ -236,11 +237,31 @@ file_reader_t<snappy_reader_t>::read_next_thread_entry(size_t thread_index,
                                                        OUT trace_entry_t *entry,
                                                        OUT bool *eof)
 {
-    int len = input_files_[thread_index].read(sizeof(*entry), entry);
-    // Returns less than asked-for for end of file, or –1 for error.
-    if (len < (int)sizeof(*entry)) {
-        *eof = input_files_[thread_index].eof();
-        return false;
+    if (!read_ahead_initialized_) {
+        init_read_ahead([this](size_t index) {
+            snappy_reader_t *file = &input_files_[index];
+            return [file](void *buf, size_t size) {
+                int len = file->read(size, buf);
+                // A short read short of the end of the stream is an error.
+                if (len < (int)size && !file->eof())
+                    return -1;
+                return len;
+            };
+        });
+    }
+    if (!read_ahead_.empty()) {
+        int len = read_ahead_[thread_index]->read(entry, sizeof(*entry));
+        if (len < (int)sizeof(*entry)) {
+            *eof = (len >= 0);
+            return false;
+        }
+    } else {
+        int len = input_files_[thread_index].read(sizeof(*entry), entry);
+        // Returns less than asked-for for end of file, or –1 for error.
+        if (len < (int)sizeof(*entry)) {
+            *eof = input_files_[thread_index].eof();
+            return false;
+        }
     }
     VPRINT(this, 4, "Read from thread #%zd file: type=%d, size=%d, addr=%zu\n",
            thread_index, entry->type, entry->size, entry->addr);
@@ -108,7 +108,13 @@ init_knobs( cache_simulator_knobs_t *knobs )
     knobs->LL_size = op_LL_size.get_value();
     knobs->LL_assoc = op_LL_assoc.get_value();
     knobs->LL_miss_file = op_LL_miss_file.get_value();
+    knobs->LL_sweep = op_LL_sweep.get_value();
+    knobs->LL_sample_ratio = op_LL_sample_ratio.get_value();
+    knobs->checkpoint_out = op_checkpoint_out.get_value();
+    knobs->checkpoint_at = op_checkpoint_at.get_value();
+    knobs->checkpoint_in = op_checkpoint_in.get_value();
     knobs->model_coherence = op_coherence.get_value();
+    knobs->coherence_directory_entries = op_coherence_directory_entries.get_value();
     knobs->replace_policy = op_replace_policy.get_value();
     knobs->data_prefetcher = op_data_prefetcher.get_value();
     knobs->skip_refs = op_skip_refs.get_value();
@@ -119,6 +125,13 @@ init_knobs( cache_simulator_knobs_t *knobs )
     knobs->cpu_scheduling = op_cpu_scheduling.get_value();
     knobs->stats_dir      = op_stats_dir.get_value();
     knobs->op_cache_line_utilization = op_cache_line_utilization.get_value();
+    knobs->flat_block_storage = op_flat_block_storage.get_value();
+    knobs->page_stats_sizes = op_page_stats_sizes.get_value();
+    knobs->stats_format = op_stats_format.get_value();
+    knobs->l1_jobs = op_l1_jobs.get_value();
+    knobs->region_stats = op_region_stats.get_value();
+    knobs->vm_maps_file =
+        get_aux_file_path(op_vm_maps_file.get_value(), DRMEMTRACE_VM_MAPS_FILENAME);
     return( knobs );
 }
 
@@ -187,12 +200,15 @@ drmemtrace_analysis_tool_create( const std::uint64_t start_pc,
         knobs->TLB_L2_entries = op_TLB_L2_entries.get_value();
         knobs->TLB_L2_assoc = op_TLB_L2_assoc.get_value();
         knobs->TLB_replace_policy = op_TLB_replace_policy.get_value();
+        knobs->flat_block_storage = op_flat_block_storage.get_value();
         knobs->skip_refs = op_skip_refs.get_value();
         knobs->warmup_refs = op_warmup_refs.get_value();
         knobs->warmup_fraction = op_warmup_fraction.get_value();
         knobs->sim_refs = op_sim_refs.get_value();
         knobs->verbose = op_verbose.get_value();
         knobs->cpu_scheduling = op_cpu_scheduling.get_value();
+        knobs->vm_maps_file =
+            get_aux_file_path(op_vm_maps_file.get_value(), DRMEMTRACE_VM_MAPS_FILENAME);
         return( tlb_simulator_create( knobs ) );
     } 
     else if (op_simulator_type.get_value() == HISTOGRAM) 
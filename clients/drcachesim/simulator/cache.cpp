@@ -47,6 +47,13 @@ cache_t::init(  cache_settings_t  &&settings,
 {
     // convert total_size to num_blocks to fit for caching_device_t::init
     const auto num_blocks = settings.total_size / settings.block_size;
+    if( settings.record_line_utilization && 
+        settings.block_size > (int)CACHE_LINE_MAX_UTILIZATION_SIZE )
+    {
+        ERRMSG( "Line utilization can only be recorded for lines of up to %zu bytes.\n",
+                CACHE_LINE_MAX_UTILIZATION_SIZE );
+        return false;
+    }
     
     return caching_device_t::init(  caching_device_settings_t( 
                                         std::forward< cache_settings_t >( settings ), 
@@ -61,23 +68,71 @@ cache_t::init(  cache_settings_t  &&settings,
 void
 cache_t::init_blocks( const std::size_t line_size )
 {
+    /** pick the narrowest inline bitmap that covers the line **/
+    const std::size_t num_words( settings_.record_line_utilization ? 
+                                 ( line_size + 63 ) / 64 : 0 );
     for( int i = 0; i < settings_.num_blocks; i++) 
     {
-        if( record_utilization_ )
+        if( num_words == 0 )
+        {
+            blocks_[ i ] = new cache_line_t< 0 >();
+        }
+        else if( num_words == 1 )
+        {
+            blocks_[ i ] = new cache_line_t< 1 >();
+        }
+        else if( num_words == 2 )
         {
-            blocks_[ i ] = new cache_line_t< true >( line_size );
+            blocks_[ i ] = new cache_line_t< 2 >();
+        }
+        else if( num_words <= 4 )
+        {
+            blocks_[ i ] = new cache_line_t< 4 >();
         }
         else
         {
-            blocks_[ i ] = new cache_line_t< false >();
+            blocks_[ i ] = new cache_line_t< 8 >();
         }
     }
 }
 
+void
+cache_t::track_invalid_ways()
+{
+    invalid_words_ = (settings_.associativity + 63) / 64;
+    invalid_ways_.assign((std::size_t)blocks_per_set_ * invalid_words_, 0);
+    for (int i = 0; i < settings_.num_blocks; i++) {
+        if (get_block_tag(i, 0) == TAG_INVALID)
+            cache_t::invalidate_update(i & ~(settings_.associativity - 1),
+                                       i & (settings_.associativity - 1));
+    }
+}
+
+void
+cache_t::invalidate_update(int block_idx, int way)
+{
+    if (invalid_words_ == 0)
+        return;
+    invalid_ways_[(block_idx >> assoc_bits_) * invalid_words_ + way / 64] |=
+        1ULL << (way % 64);
+}
+
+bool
+cache_t::restore_state(stats_file_reader_t &in)
+{
+    if (!caching_device_t::restore_state(in))
+        return false;
+    if (invalid_words_ != 0)
+        track_invalid_ways();
+    return true;
+}
+
 void
 cache_t::request(const memref_t &memref)
 {
     caching_device_t::request(memref);
+    for (cache_t *mirror : mirrors_)
+        mirror->request(memref);
 }
 
 void
@@ -89,15 +144,21 @@ cache_t::flush(const memref_t &memref)
     last_tag_ = TAG_INVALID;
     for (; tag <= final_tag; ++tag) 
     {
-        auto block_way = find_caching_device_block(tag);
-        if (block_way.first == nullptr)
+        const int way = find_caching_device_way(tag);
+        if (way < 0)
             continue;
-        invalidate_caching_device_block(block_way.first);
+        invalidate_caching_device_block(compute_block_idx(tag), way);
     }
     // We flush parent_'s code cache here.
     // XXX: should L1 data cache be flushed when L1 instr cache is flushed?
-    if (parent_ != NULL)
-        ((cache_t *)parent_)->flush(memref);
+    if (parent_ != NULL) {
+        if (parent_queue_ != nullptr)
+            parent_queue_->push(memref, parent_queue_t::PARENT_FLUSH);
+        else
+            ((cache_t *)parent_)->flush(memref);
+    }
     if (stats_ != NULL)
         ((cache_stats_t *)stats_)->flush(memref);
+    for (cache_t *mirror : mirrors_)
+        mirror->flush(memref);
 }
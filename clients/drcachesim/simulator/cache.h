@@ -63,11 +63,51 @@ public:
     virtual void
     flush(const memref_t &memref);
 
+    // Replays every request and flush this cache receives on mirror too.
+    // A mirror is a parentless cache with another geometry or policy,
+    // so that several configurations can be simulated in one pass.
+    void
+    add_mirror(cache_t *mirror)
+    {
+        mirrors_.push_back(mirror);
+    }
+
+    bool
+    restore_state(stats_file_reader_t &in) override;
+
 protected:
     void
     init_blocks( const std::size_t line_size ) override;
-    
-    bool record_utilization_    = false;
+
+    // Per-set bitmaps of the ways holding no line, for policies that fill an
+    // empty way before consulting their replacement state.  A policy enables
+    // them from init() and marks its victim valid in replace_which_way().
+    void
+    track_invalid_ways();
+    // Returns the lowest empty way of the set, or -1 if the set is full.
+    int
+    first_invalid_way(int block_idx) const
+    {
+        const std::uint64_t *words =
+            &invalid_ways_[(block_idx >> assoc_bits_) * invalid_words_];
+        for (int i = 0; i < invalid_words_; ++i) {
+            if (words[i] != 0)
+                return i * 64 + __builtin_ctzll(words[i]);
+        }
+        return -1;
+    }
+    void
+    set_way_valid(int block_idx, int way)
+    {
+        invalid_ways_[(block_idx >> assoc_bits_) * invalid_words_ + way / 64] &=
+            ~(1ULL << (way % 64));
+    }
+    void
+    invalidate_update(int block_idx, int way) override;
+
+    std::vector<cache_t *> mirrors_;
+    std::vector<std::uint64_t> invalid_ways_;
+    int invalid_words_ = 0;
 };
 
 #endif /* _CACHE_H_ */
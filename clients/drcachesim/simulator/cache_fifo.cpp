@@ -64,7 +64,7 @@ cache_fifo_t::init( cache_settings_t &&settings,
     // initialize it to point to the first block.
     for( int i = 0; i < blocks_per_set_; i++) 
     {
-        get_caching_device_block(i << assoc_bits_, 0).counter_ = 1;
+        get_block_counter(i << assoc_bits_, 0) = 1;
     }
     return true;
 }
@@ -82,12 +82,11 @@ cache_fifo_t::replace_which_way(int block_idx)
 {
     // We replace the block whose counter is 1.
     for (int i = 0; i < settings_.associativity; i++) {
-        if (get_caching_device_block(block_idx, i).counter_ == 1) {
+        if (get_block_counter(block_idx, i) == 1) {
             // clear the counter of the victim block
-            get_caching_device_block(block_idx, i).counter_ = 0;
+            get_block_counter(block_idx, i) = 0;
             // set the next block as victim
-            get_caching_device_block(block_idx, (i + 1) & (settings_.associativity - 1)).counter_ =
-                1;
+            get_block_counter(block_idx, (i + 1) & (settings_.associativity - 1)) = 1;
             return i;
         }
     }
@@ -37,58 +37,55 @@
 #define _CACHE_LINE_H_ 1
 
 #include "caching_device_block.h"
-#include <iostream>
-#include <iomanip>
-
-#include <boost/dynamic_bitset.hpp>
+#include "caching_device_stats.h"
 #include <cstddef>
-#include <cassert>
+#include <cstdint>
 #include <algorithm>
 
-template < bool utilization > struct cache_line_t : public caching_device_block_t
-{
-    cache_line_t( const size_t line_size ) : used( line_size ),
-                                             count( line_size )
-    {
-    }
+/** largest line, in bytes, whose utilization a cache_line_t can record **/
+static constexpr std::size_t CACHE_LINE_MAX_UTILIZATION_SIZE = 8 * 64;
 
+/**
+ * cache_line_t< num_words > records which bytes of the line have been used 
+ * in an inline bitmap of num_words 64-bit words, i.e., for lines of up to 
+ * num_words * 64 bytes.  The width is fixed at compile time so the bitmap 
+ * lives in the line itself rather than behind a heap allocation; 
+ * cache_t::init_blocks() picks the narrowest width that fits the line size.
+ */
+template < std::size_t num_words > struct cache_line_t : public caching_device_block_t
+{
     virtual ~cache_line_t() = default;
     
     virtual void update_utilization( const memref_t &in, 
                                      const size_t offset, 
-                                     const bool record ) override
+                                     const bool record,
+                                     caching_device_stats_t *stats ) override
     {
-        caching_device_block_t::update_utilization( in, offset, record );
+        caching_device_block_t::update_utilization( in, offset, record, stats );
         /** calc where in line we hit, update counters **/
-        const auto start( offset );
-        const auto end( std::min( offset + in.data.size, count  ) );
-        for( auto i( start ); i <= end; i++ )
-        {
-            used[ i ] = 1;
-        }
+        const auto end( std::min( offset + in.data.size, num_words * 64 ) );
+        stats->record_bytes_used( used, offset, end );
         return;
     }
 
     virtual void reset() override
     {
         caching_device_block_t::reset();
-        used.reset();
+        std::fill( used, used + num_words, 0 );
         return;
     }
 
-    virtual boost::dynamic_bitset<> getBits() override 
+    virtual std::uint64_t *get_used_bytes() override 
     {
         return( used );
     }
 
-    boost::dynamic_bitset<>         used;
-    using bitset_type   = decltype( used.size() );
-    const bitset_type               count;
+    std::uint64_t used[ num_words ] = {};
 };
 
-template <> struct cache_line_t< false > : public caching_device_block_t
+template <> struct cache_line_t< 0 > : public caching_device_block_t
 {
-    /** no need for bitset here **/
+    /** no need for a bitmap here **/
 };
 
 #endif /* _CACHE_LINE_H_ */
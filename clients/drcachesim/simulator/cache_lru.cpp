@@ -36,6 +36,39 @@
 // how recently a cache line is accessed.
 // The count value 0 means the most recent access, and the cache line with the
 // highest counter value will be picked for replacement in replace_which_way.
+// A replaced or invalidated line restarts at 0 without aging the others, so
+// lines can share a count; the lowest way wins a tie for replacement.
+//
+// Up to PACKED_MAX_ASSOC ways the counts, which never exceed the
+// associativity minus one, are kept as bytes packed eight to a word.  An
+// access then ages the set with one subtract-and-mask per word, and the
+// victim is found with a word-wide maximum and match, rather than a loop
+// over the ways.  Empty ways are tracked in cache_t's bitmaps.
+
+static const std::uint64_t LANE_LOW = 0x0101010101010101ULL;
+static const std::uint64_t LANE_HIGH = 0x8080808080808080ULL;
+
+// Returns the top bit of each byte lane where a <= b.  Lanes must be below
+// 128 so that no lane borrows from its neighbor.
+static inline std::uint64_t
+lanes_le(std::uint64_t a, std::uint64_t b)
+{
+    return ((b | LANE_HIGH) - a) & LANE_HIGH;
+}
+
+static inline std::uint64_t
+lanes_max(std::uint64_t a, std::uint64_t b)
+{
+    const std::uint64_t b_le_a = (lanes_le(b, a) >> 7) * 0xff;
+    return (a & b_le_a) | (b & ~b_le_a);
+}
+
+// Returns the top bit of each byte lane of x that is zero.
+static inline std::uint64_t
+lanes_zero(std::uint64_t x)
+{
+    return ~((x | LANE_HIGH) - LANE_LOW) & LANE_HIGH;
+}
 
 bool
 cache_lru_t::init(  cache_settings_t &&settings,
@@ -62,53 +95,140 @@ cache_lru_t::init(  cache_settings_t &&settings,
     // Initialize line counters with 0, 1, 2, ..., associativity - 1.
     for (int i = 0; i < blocks_per_set_; i++) {
         for (int way = 0; way < settings_.associativity; ++way) {
-            get_caching_device_block(i << assoc_bits_, way).counter_ = way;
+            get_block_counter(i << assoc_bits_, way) = way;
         }
     }
+    if (settings_.associativity <= PACKED_MAX_ASSOC) {
+        age_words_ = (settings_.associativity + 7) / 8;
+        const int last_ways = settings_.associativity - (age_words_ - 1) * 8;
+        last_word_lanes_ = last_ways == 8 ? LANE_HIGH
+                                          : LANE_HIGH & ((1ULL << (last_ways * 8)) - 1);
+        ages_.assign((std::size_t)blocks_per_set_ * age_words_, 0);
+        for (int i = 0; i < blocks_per_set_; i++) {
+            for (int way = 0; way < settings_.associativity; ++way)
+                set_age(i << assoc_bits_, way, way);
+        }
+        track_invalid_ways();
+    }
     return true;
 }
 
 void
 cache_lru_t::access_update(int line_idx, int way)
 {
-    int cnt = get_caching_device_block(line_idx, way).counter_;
+    if (age_words_ != 0) {
+        const int cnt = get_age(line_idx, way);
+        if (cnt == 0)
+            return;
+        // Age every way not older than cnt, then make way the most recent.
+        std::uint64_t *ages = set_ages(line_idx);
+        const std::uint64_t bound = LANE_LOW * cnt;
+        for (int i = 0; i < age_words_; ++i) {
+            const std::uint64_t lanes = i == age_words_ - 1 ? last_word_lanes_ : LANE_HIGH;
+            ages[i] += (lanes_le(ages[i], bound) & lanes) >> 7;
+        }
+        set_age(line_idx, way, 0);
+        return;
+    }
+    int cnt = get_block_counter(line_idx, way);
     // Optimization: return early if it is a repeated access.
     if (cnt == 0)
         return;
     // We inc all the counters that are not larger than cnt for LRU.
     for (int i = 0; i < settings_.associativity; ++i) {
-        if (i != way && get_caching_device_block(line_idx, i).counter_ <= cnt)
-            get_caching_device_block(line_idx, i).counter_++;
+        if (i != way && get_block_counter(line_idx, i) <= cnt)
+            get_block_counter(line_idx, i)++;
     }
     // Clear the counter for LRU.
-    get_caching_device_block(line_idx, way).counter_ = 0;
+    get_block_counter(line_idx, way) = 0;
 }
 
 int
 cache_lru_t::replace_which_way(int line_idx)
 {
+    if (age_words_ != 0) {
+        int way = first_invalid_way(line_idx);
+        if (way < 0) {
+            // The lowest way holding the largest age.
+            const std::uint64_t *ages = set_ages(line_idx);
+            std::uint64_t max = ages[0];
+            for (int i = 1; i < age_words_; ++i)
+                max = lanes_max(max, ages[i]);
+            max = lanes_max(max, max >> 32);
+            max = lanes_max(max, max >> 16);
+            max = lanes_max(max, max >> 8);
+            const std::uint64_t oldest = LANE_LOW * (max & 0xff);
+            for (int i = 0;; ++i) {
+                const std::uint64_t match = lanes_zero(ages[i] ^ oldest);
+                if (match != 0) {
+                    way = i * 8 + __builtin_ctzll(match) / 8;
+                    break;
+                }
+            }
+        }
+        set_way_valid(line_idx, way);
+        set_age(line_idx, way, 0);
+        flush_block_utilization(line_idx, way);
+        reset_block(line_idx, way);
+        return way;
+    }
     // We implement LRU by picking the slot with the largest counter value.
     auto max_counter{0},max_way{0};
     
     for( auto way{ 0 }; way < settings_.associativity; ++way) 
     {
-        const auto &block( get_caching_device_block(line_idx, way ) );
-        if( block.tag_ == TAG_INVALID ) 
+        if( get_block_tag( line_idx, way ) == TAG_INVALID ) 
         {
             max_way = way;
             break;
         }
-        if( block.counter_ > max_counter ) 
+        const auto counter( get_block_counter( line_idx, way ) );
+        if( counter > max_counter ) 
         {
-            max_counter = block.counter_;
+            max_counter = counter;
             max_way = way;
         }
     }
-    auto &block( get_caching_device_block( line_idx, max_way ) );
-    if( block.valid && block.event_flags[0] )
-    {
-        stats_->flush_update( block.getBits() );
-    }
-    block.reset();
+    flush_block_utilization( line_idx, max_way );
+    reset_block( line_idx, max_way );
     return max_way;
 }
+
+void
+cache_lru_t::invalidate_update(int line_idx, int way)
+{
+    cache_t::invalidate_update(line_idx, way);
+    if (age_words_ != 0)
+        set_age(line_idx, way, 0);
+}
+
+void
+cache_lru_t::save_state(stats_file_writer_t &out)
+{
+    // Checkpoints hold the ages in the block counters.
+    if (age_words_ != 0) {
+        for (int i = 0; i < settings_.num_blocks; i++) {
+            get_block_counter(i & ~(settings_.associativity - 1),
+                              i & (settings_.associativity - 1)) =
+                get_age(i, i & (settings_.associativity - 1));
+        }
+    }
+    cache_t::save_state(out);
+}
+
+bool
+cache_lru_t::restore_state(stats_file_reader_t &in)
+{
+    if (!cache_t::restore_state(in))
+        return false;
+    if (age_words_ != 0) {
+        for (int i = 0; i < settings_.num_blocks; i++) {
+            const int way = i & (settings_.associativity - 1);
+            const int age = get_block_counter(i - way, way);
+            if (age < 0 || age >= settings_.associativity)
+                return false;
+            set_age(i, way, age);
+        }
+    }
+    return true;
+}
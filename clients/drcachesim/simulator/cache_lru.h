@@ -50,11 +50,46 @@ public:
             snoop_filter_t *snoop_filter_ = nullptr,
             const std::vector<caching_device_t *> &children = {} ) override;
 
+    void
+    save_state(stats_file_writer_t &out) override;
+    bool
+    restore_state(stats_file_reader_t &in) override;
+
 protected:
     void
     access_update(int line_idx, int way) override;
     int
     replace_which_way(int line_idx) override;
+    void
+    invalidate_update(int line_idx, int way) override;
+
+    // Up to this associativity the ages of a set are packed one byte per
+    // way into age_words_ words, and updated and searched a word at a time.
+    // Beyond it they are kept in the block counters.
+    static constexpr int PACKED_MAX_ASSOC = 128;
+
+    inline std::uint64_t *
+    set_ages(int line_idx)
+    {
+        return &ages_[(line_idx >> assoc_bits_) * age_words_];
+    }
+    inline int
+    get_age(int line_idx, int way)
+    {
+        return (int)((set_ages(line_idx)[way / 8] >> (way % 8 * 8)) & 0xff);
+    }
+    inline void
+    set_age(int line_idx, int way, int age)
+    {
+        std::uint64_t &word = set_ages(line_idx)[way / 8];
+        const int shift = way % 8 * 8;
+        word = (word & ~(0xffULL << shift)) | ((std::uint64_t)age << shift);
+    }
+
+    std::vector<std::uint64_t> ages_;
+    int age_words_ = 0;
+    // The top bit of each byte of the last age word of a set that holds a way.
+    std::uint64_t last_word_lanes_ = 0;
 };
 
 #endif /* _CACHE_LRU_H_ */
@@ -31,6 +31,7 @@
  */
 
 #include "cache_miss_analyzer.h"
+#include "stats_file.h"
 
 #include <iostream>
 #include <stdint.h>
@@ -82,20 +83,38 @@ cache_miss_stats_t::reset()
 
 void
 cache_miss_stats_t::dump_miss(const memref_t &memref)
+{
+    record_miss(memref.data.type, memref.data.pc, memref.data.addr);
+}
+
+void
+cache_miss_stats_t::record_miss(unsigned short type, addr_t pc, addr_t addr)
 {
     // If the operation causing the LLC miss is a memory read (load), insert
     // the miss into the pc_cache_misses_ hash map and update
     // the total_misses_ counter.
-    if (memref.data.type != TRACE_TYPE_READ) {
+    if (type != TRACE_TYPE_READ) {
         return;
     }
 
-    const addr_t pc = memref.data.pc;
-    const addr_t addr = memref.data.addr / kLineSize;
-    pc_cache_misses_[pc].push_back(addr);
+    pc_cache_misses_[pc].push_back(addr / kLineSize);
     total_misses_++;
 }
 
+std::string
+cache_miss_stats_t::read_miss_stream(const std::string &path)
+{
+    stats_file_reader_t reader(path);
+    if (!reader.get_error().empty())
+        return reader.get_error();
+    if (reader.get_type() != STATS_FILE_MISS_STREAM)
+        return path + " is not a miss stream";
+    miss_record_t record;
+    while (reader.read_miss_record(&record))
+        record_miss(record.type, record.pc, record.addr);
+    return reader.get_error();
+}
+
 std::vector<prefetching_recommendation_t *>
 cache_miss_stats_t::generate_recommendations()
 {
@@ -189,6 +208,13 @@ cache_miss_analyzer_t::generate_recommendations()
     return ll_stats_->generate_recommendations();
 }
 
+bool
+cache_miss_analyzer_t::analyze_miss_stream(const std::string &path)
+{
+    error_string_ = ll_stats_->read_miss_stream(path);
+    return error_string_.empty();
+}
+
 bool
 cache_miss_analyzer_t::print_results()
 {
@@ -87,6 +87,12 @@ public:
     std::vector<prefetching_recommendation_t *>
     generate_recommendations();
 
+    // Adds the misses in a binary miss stream, written by -LL_miss_file with
+    // a binary -stats_format, to those being analyzed.  Returns an error
+    // message, or the empty string on success.
+    std::string
+    read_miss_stream(const std::string &path);
+
 protected:
     void
     dump_miss(const memref_t &memref) override;
@@ -116,6 +122,9 @@ private:
     int
     check_for_constant_stride(const std::vector<addr_t> &cache_misses) const;
 
+    void
+    record_miss(unsigned short type, addr_t pc, addr_t addr);
+
     // A hash map storing the data cache line addresses accessed by load
     // instructions that miss in the LLC.
     // Key is the PC of the load instruction.
@@ -147,6 +156,11 @@ public:
     std::vector<prefetching_recommendation_t *>
     generate_recommendations();
 
+    // Analyzes the misses of an earlier simulation, as recorded in a binary
+    // miss stream, along with any simulated here.
+    bool
+    analyze_miss_stream(const std::string &path);
+
     bool
     print_results() override;
 
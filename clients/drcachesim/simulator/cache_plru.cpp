@@ -0,0 +1,122 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include "cache_plru.h"
+
+// For the tree pseudo-LRU implementation, the ways of a set are the leaves of a
+// binary tree whose associativity - 1 internal nodes each hold one bit that
+// points to the half of its subtree to replace next: 0 for the lower ways and
+// 1 for the upper ways.  An access points every node on the way's path away
+// from it, and the victim is found by following the bits from the root, so
+// both take log2(associativity) steps.  Empty ways are filled first, lowest
+// first, as with the other policies.
+
+bool
+cache_plru_t::init( cache_settings_t &&settings,
+                    caching_device_t *parent, 
+                    caching_device_stats_t *stats,
+                    prefetcher_t *prefetcher, 
+                    snoop_filter_t *snoop_filter,
+                    const std::vector<caching_device_t *> &children )
+{
+    bool ret_val =
+        cache_t::init(  std::forward< cache_settings_t >( settings ),
+                        parent, 
+                        stats, 
+                        prefetcher,
+                        snoop_filter, 
+                        children );
+    if (ret_val == false)
+    {
+        return false;
+    }
+    tree_words_ = (settings_.associativity + 63) / 64;
+    trees_.assign((std::size_t)blocks_per_set_ * tree_words_, 0);
+    track_invalid_ways();
+    return true;
+}
+
+void
+cache_plru_t::access_update(int line_idx, int way)
+{
+    int node = 1;
+    for (int level = assoc_bits_ - 1; level >= 0; --level) {
+        const int upper = (way >> level) & 1;
+        set_node(line_idx, node, upper == 0);
+        node = 2 * node + upper;
+    }
+}
+
+int
+cache_plru_t::replace_which_way(int line_idx)
+{
+    int way = first_invalid_way(line_idx);
+    if (way < 0) {
+        int node = 1;
+        way = 0;
+        for (int level = 0; level < assoc_bits_; ++level) {
+            const int upper = get_node(line_idx, node);
+            way = 2 * way + upper;
+            node = 2 * node + upper;
+        }
+    }
+    set_way_valid(line_idx, way);
+    flush_block_utilization(line_idx, way);
+    reset_block(line_idx, way);
+    return way;
+}
+
+void
+cache_plru_t::save_state(stats_file_writer_t &out)
+{
+    // Checkpoints hold node n of a set's tree in the counter of way n.
+    for (int i = 0; i < settings_.num_blocks; i++) {
+        const int way = i & (settings_.associativity - 1);
+        get_block_counter(i - way, way) = way == 0 ? 0 : get_node(i, way);
+    }
+    cache_t::save_state(out);
+}
+
+bool
+cache_plru_t::restore_state(stats_file_reader_t &in)
+{
+    if (!cache_t::restore_state(in))
+        return false;
+    for (int i = 0; i < settings_.num_blocks; i++) {
+        const int way = i & (settings_.associativity - 1);
+        const int bit = get_block_counter(i - way, way);
+        if (bit != 0 && (way == 0 || bit != 1))
+            return false;
+        if (way != 0)
+            set_node(i, way, bit != 0);
+    }
+    return true;
+}
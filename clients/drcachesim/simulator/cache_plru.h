@@ -0,0 +1,81 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+/* cache_plru: represents a single hardware cache with tree pseudo-LRU algo.
+ */
+
+#ifndef _CACHE_PLRU_H_
+#define _CACHE_PLRU_H_ 1
+
+#include "cache.h"
+#include "cache_settings.h"
+
+class cache_plru_t : public cache_t {
+public:
+    bool
+    init(   cache_settings_t &&settings,
+            caching_device_t *parent,
+            caching_device_stats_t *stats, 
+            prefetcher_t *prefetcher, 
+            snoop_filter_t *snoop_filter_ = nullptr,
+            const std::vector<caching_device_t *> &children = {} ) override;
+
+    void
+    save_state(stats_file_writer_t &out) override;
+    bool
+    restore_state(stats_file_reader_t &in) override;
+
+protected:
+    void
+    access_update(int line_idx, int way) override;
+    int
+    replace_which_way(int line_idx) override;
+
+    // Node n of a set's tree, for 1 <= n < associativity, is bit n of the
+    // set's tree_words_ words.
+    inline bool
+    get_node(int line_idx, int node)
+    {
+        return (trees_[(line_idx >> assoc_bits_) * tree_words_ + node / 64] >>
+                (node % 64)) & 1;
+    }
+    inline void
+    set_node(int line_idx, int node, bool right)
+    {
+        std::uint64_t &word = trees_[(line_idx >> assoc_bits_) * tree_words_ + node / 64];
+        word = (word & ~(1ULL << (node % 64))) | ((std::uint64_t)right << (node % 64));
+    }
+
+    std::vector<std::uint64_t> trees_;
+    int tree_words_ = 0;
+};
+
+#endif /* _CACHE_PLRU_H_ */
@@ -30,8 +30,13 @@
  * DAMAGE.
  */
 
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <string>
 #include <assert.h>
 #include <limits.h>
@@ -46,12 +51,17 @@
 #include "cache.h"
 #include "cache_lru.h"
 #include "cache_fifo.h"
+#include "cache_plru.h"
 #include "cache_simulator.h"
 #include "droption.h"
 
 #include "snoop_filter.h"
+#include "stats_file.h"
 #include "cache_settings.h"
 
+// Stored as the parameter of the checkpoint file header.
+static const std::uint32_t CHECKPOINT_VERSION = 3;
+
 analysis_tool_t *
 cache_simulator_create( cache_simulator_knobs_t *knobs )
 {
@@ -81,6 +91,26 @@ cache_simulator_t::cache_simulator_t( cache_simulator_knobs_t *knobs )
     page_stats_impl::init();
     // This configuration allows for one shared LLC only.
     auto *local_knobs = reinterpret_cast< knob_t* >( knobs_ );
+    std::vector< int > page_stats_bits;
+    if( ! page_stats_impl::parse_page_stats_sizes( local_knobs->page_stats_sizes, 
+                                                   page_stats_bits ) )
+    {
+        error_string_ = "Usage error: invalid page_stats_sizes '" + 
+                        local_knobs->page_stats_sizes + 
+                        "', expected power-of-two sizes of at least 4K, e.g., 4K,2M";
+        success_ = false;
+        return;
+    }
+    page_stats_impl::set_page_stats_sizes( page_stats_bits );
+    stats_format_t stats_format;
+    if( ! stats_format_from_string( local_knobs->stats_format, &stats_format ) )
+    {
+        error_string_ = "Usage error: invalid stats_format '" + 
+                        local_knobs->stats_format + "'";
+        success_ = false;
+        return;
+    }
+    page_stats_impl::set_page_stats_format( stats_format );
     cache_t *llc = create_cache( local_knobs->replace_policy );
     if (llc == nullptr) 
     {
@@ -103,6 +133,8 @@ cache_simulator_t::cache_simulator_t( cache_simulator_knobs_t *knobs )
 
     bool warmup_enabled_ = ((local_knobs->warmup_refs > 0) || (local_knobs->warmup_fraction > 0.0));
 
+    llc->set_flat_storage_use(local_knobs->flat_block_storage);
+    llc->set_sample_ratio((int)local_knobs->LL_sample_ratio);
     if (!llc->init( cache_settings_t( local_knobs->LL_assoc, 
                                       local_knobs->line_size, 
                                       local_knobs->LL_size, 
@@ -119,11 +151,15 @@ cache_simulator_t::cache_simulator_t( cache_simulator_knobs_t *knobs )
         error_string_ =
             "Usage error: failed to initialize LL cache.  Ensure sizes and "
             "associativity are powers of 2, that the total size is a multiple "
-            "of the line size, and that any miss file path is writable.";
+            "of the line size, that any sample ratio is a power of 2 no larger "
+            "than the number of sets, and that any miss file path is writable.";
         success_ = false;
         return;
     }
     
+    llc->get_stats()->set_output_format( stats_format );
+    llc->set_page_stats_sizes( page_stats_bits );
+    llc->set_page_stats_format( stats_format );
     llc->set_as_last_level();
 
     l1_icaches_ = new cache_t *[local_knobs->num_cores];
@@ -149,6 +185,8 @@ cache_simulator_t::cache_simulator_t( cache_simulator_knobs_t *knobs )
             return;
         }
         snooped_caches_[(2 * i) + 1] = l1_dcaches_[i];
+        l1_icaches_[i]->set_flat_storage_use(local_knobs->flat_block_storage);
+        l1_dcaches_[i]->set_flat_storage_use(local_knobs->flat_block_storage);
 
         const auto cache_name_l1i = "L1_I_Cache_" + std::to_string(i);
         const auto cache_name_l1d = "L1_D_Cache_" + std::to_string(i);
@@ -201,16 +239,160 @@ cache_simulator_t::cache_simulator_t( cache_simulator_knobs_t *knobs )
             success_ = false;
             return;
         }
+        l1_icaches_[i]->get_stats()->set_output_format( stats_format );
+        l1_dcaches_[i]->get_stats()->set_output_format( stats_format );
         all_caches_[cache_name_l1i] = l1_icaches_[i];
         all_caches_[cache_name_l1d] = l1_dcaches_[i];
     }
 
     if (local_knobs->model_coherence &&
-        !snoop_filter_->init(snooped_caches_, total_snooped_caches)) {
+        !snoop_filter_->init(snooped_caches_, total_snooped_caches,
+                             local_knobs->coherence_directory_entries)) {
         ERRMSG("Usage error: failed to initialize snoop filter.\n");
         success_ = false;
         return;
     }
+
+    if (local_knobs->l1_jobs > 0) {
+        // The L1 caches must not be affected by the LLC, which holds without
+        // coherence as the LLC built here is not inclusive.
+        if (local_knobs->model_coherence) {
+            error_string_ = "Usage error: -l1_jobs is not supported with -coherence";
+            success_ = false;
+            return;
+        }
+        l1_parallel_ = new l1_parallel_t(local_knobs->l1_jobs, local_knobs->num_cores,
+                                         l1_icaches_, l1_dcaches_, &record);
+    }
+
+    if (local_knobs->region_stats) {
+        region_stats_ = new region_stats_t(&os_process_map_);
+        llc->get_stats()->set_region_stats(region_stats_);
+    }
+
+    if (!parse_sweep(local_knobs->LL_sweep, local_knobs->LL_assoc,
+                     local_knobs->replace_policy, sweep_points_)) {
+        error_string_ = "Usage error: invalid LL_sweep '" + local_knobs->LL_sweep +
+            "', expected size:assoc[:policy] items, e.g., 1M:8,2M:16";
+        success_ = false;
+        return;
+    }
+    // Each point is a parentless LLC replaying the requests of the real one.
+    // It is not marked as the last level so the page stats count misses once.
+    for (auto &point : sweep_points_) {
+        point.cache = create_cache(point.policy);
+        if (point.cache == nullptr) {
+            error_string_ = "create_cache failed for LL_sweep point " + point.name;
+            success_ = false;
+            return;
+        }
+        all_caches_[point.name] = point.cache;
+        point.cache->set_flat_storage_use(local_knobs->flat_block_storage);
+        point.cache->set_sample_ratio((int)local_knobs->LL_sample_ratio);
+        if (!point.cache->init(cache_settings_t(point.assoc, local_knobs->line_size,
+                                                point.size,
+                                                local_knobs->op_cache_line_utilization,
+                                                &record),
+                               NULL,
+                               new cache_stats_t(stat_dir_name, point.name,
+                                                 local_knobs->op_cache_line_utilization,
+                                                 (int)local_knobs->line_size, "",
+                                                 warmup_enabled_))) {
+            error_string_ = "Usage error: failed to initialize LL_sweep point " +
+                point.name + ".  Ensure sizes and associativity are powers of 2, "
+                "that the total size is a multiple of the line size and that any "
+                "sample ratio is no larger than the number of sets.";
+            success_ = false;
+            return;
+        }
+        point.cache->get_stats()->set_output_format(stats_format);
+        llc->add_mirror(point.cache);
+    }
+
+    if (!local_knobs->checkpoint_out.empty()) {
+        if (local_knobs->checkpoint_at != "warmup" &&
+            local_knobs->checkpoint_at != "start") {
+            error_string_ = "Usage error: invalid checkpoint_at '" +
+                local_knobs->checkpoint_at + "', expected warmup or start";
+            success_ = false;
+            return;
+        }
+        if (local_knobs->checkpoint_at == "start" && local_knobs->start_pc == 0) {
+            error_string_ = "Usage error: -checkpoint_at start needs a start point";
+            success_ = false;
+            return;
+        }
+    }
+    if (!local_knobs->checkpoint_in.empty() &&
+        !read_checkpoint(local_knobs->checkpoint_in)) {
+        success_ = false;
+        return;
+    }
+}
+
+bool
+cache_simulator_t::parse_sweep(const std::string &spec, unsigned int default_assoc,
+                               const std::string &default_policy,
+                               std::vector<sweep_point_t> &points)
+{
+    points.clear();
+    std::size_t pos = 0;
+    while (pos < spec.size()) {
+        std::size_t comma = spec.find(',', pos);
+        if (comma == std::string::npos)
+            comma = spec.size();
+        const std::string item = spec.substr(pos, comma - pos);
+        pos = comma + 1;
+        std::size_t digits = 0;
+        while (digits < item.size() && std::isdigit((unsigned char)item[digits]))
+            digits++;
+        if (digits == 0 || digits > 12)
+            return false;
+        sweep_point_t point = {};
+        point.size = std::stoull(item.substr(0, digits));
+        point.assoc = default_assoc;
+        point.policy = default_policy;
+        std::size_t colon = item.find(':', digits);
+        const std::string suffix = item.substr(digits, colon - digits);
+        int shift = 0;
+        if (suffix == "K")
+            shift = 10;
+        else if (suffix == "M")
+            shift = 20;
+        else if (suffix == "G")
+            shift = 30;
+        else if (!suffix.empty())
+            return false;
+        // Reject sizes that overflow rather than wrapping them, including
+        // those too large for the int total size cache_settings_t takes.
+        if (point.size > ((uint64_t)std::numeric_limits<int>::max() >> shift))
+            return false;
+        point.size <<= shift;
+        if (colon != std::string::npos) {
+            std::size_t next = item.find(':', colon + 1);
+            const std::string assoc = item.substr(colon + 1, next - colon - 1);
+            if (!assoc.empty()) {
+                if (assoc.find_first_not_of("0123456789") != std::string::npos ||
+                    assoc.size() > 6)
+                    return false;
+                point.assoc = (unsigned int)std::stoul(assoc);
+            }
+            if (next != std::string::npos) {
+                point.policy = item.substr(next + 1);
+                if (point.policy.empty())
+                    return false;
+            }
+        }
+        point.name = "LL_" + item.substr(0, colon) + "_" +
+            std::to_string(point.assoc) +
+            (point.policy == default_policy ? "" : "_" + point.policy);
+        for (const auto &prior : points) {
+            if (prior.name == point.name)
+                return false;
+        }
+        points.push_back(point);
+    }
+    return true;
 }
 
 cache_simulator_t::cache_simulator_t(std::istream *config_file)
@@ -425,24 +607,28 @@ cache_simulator_t::cache_simulator_t(std::istream *config_file)
         }
     }
 #endif    
+    error_string_ = "Configuration files are not supported";
+    success_ = false;
 }
 
 cache_simulator_t::~cache_simulator_t()
 {
     
     auto *local_knobs = reinterpret_cast< knob_t* >( knobs_ );
+    /** nothing was set up without knobs, e.g., from a configuration file **/
+    if( local_knobs == nullptr )
+    {
+        return;
+    }
     const auto stats_dir = local_knobs->stats_dir;
-    //open streams, write stats for unfiltered data
-    //write 4KiB
-    std::ofstream stream_4( stats_dir + "/page_usage_unfiltered_4KiB.dat" );
-    //write 64KiB
-    std::ofstream stream_64( stats_dir + "/page_usage_unfiltered_64KiB.dat" );
-    //write 1MiB
-    std::ofstream stream_1M( stats_dir + "/page_usage_unfiltered_1MiB.dat" );
-    page_stats_impl::write(  stream_4,
-                             stream_64,
-                             stream_1M );
-    //these close stream so ignore that little detail, stream is unusable after call
+    // Finishes any queued references and stops the workers.
+    delete l1_parallel_;
+    delete region_stats_;
+    //write stats for unfiltered data, page_usage_unfiltered_4KiB.dat etc.
+    if( ! stats_dir.empty() )
+    {
+        page_stats_impl::write( stats_dir + "/page_usage_unfiltered" );
+    }
 
     for (auto &caches_it : all_caches_) {
         cache_t *cache = caches_it.second;
@@ -477,6 +663,7 @@ bool
 cache_simulator_t::process_memref(const memref_t &memref)
 {
     auto *local_knobs = reinterpret_cast< knob_t* >( knobs_ );
+    refs_seen_++;
     if (local_knobs->skip_refs > 0) 
     {
         local_knobs->skip_refs--;
@@ -521,22 +708,26 @@ cache_simulator_t::process_memref(const memref_t &memref)
         core = core_and_va_activation_for_thread( memref );
         last_thread_ = memref.data.tid;
         last_core_ = core;
+        last_process_map_ = os_process_map_[ memref.data.pid ];
         /** 
          * this should only be called once given right now we have only one attach
          * point, let's go ahead and update the knobs start address.
          */
         local_knobs->start_pc = 
-            os_process_map_[ memref.data.pid ]->add_os_vm_offset_to_pc( 
+            last_process_map_->add_os_vm_offset_to_pc( 
                 local_knobs->start_pc 
             );
         
         local_knobs->stop_pc = 
-            os_process_map_[ memref.data.pid ]->add_os_vm_offset_to_pc( 
+            last_process_map_->add_os_vm_offset_to_pc( 
                 local_knobs->stop_pc 
             );
 
-        std::fprintf( stderr, "start pc: 0x%zx\n", local_knobs->start_pc );
-        std::fprintf( stderr, "stop pc: 0x%zx\n", local_knobs->stop_pc );
+        if( local_knobs->verbose >= 1 )
+        {
+            std::fprintf( stderr, "start pc: 0x%zx\n", local_knobs->start_pc );
+            std::fprintf( stderr, "stop pc: 0x%zx\n", local_knobs->stop_pc );
+        }
     }
 
     if( record )
@@ -545,7 +736,8 @@ cache_simulator_t::process_memref(const memref_t &memref)
     }
     if( type_is_instr(memref.instr.type) || memref.instr.type == TRACE_TYPE_PREFETCH_INSTR ) 
     {
-        if(! os_process_map_[ memref.instr.pid ]->is_address_in_code( memref.instr.addr ) )
+        if( local_knobs->verbose >= 2 && 
+            ! last_process_map_->is_address_in_code( memref.instr.addr ) )
         {
             std::fprintf( 
                          stderr, 
@@ -562,6 +754,10 @@ cache_simulator_t::process_memref(const memref_t &memref)
             {
                 std::cerr << "starting dr_cachesim recording @" << (void *)memref.instr.addr << std::endl;
             }
+            if( ! record && local_knobs->checkpoint_at == "start" )
+            {
+                checkpoint_pending_ = true;
+            }
             record = true;
         }
         if( memref.instr.addr == local_knobs->stop_pc )
@@ -573,7 +769,12 @@ cache_simulator_t::process_memref(const memref_t &memref)
             record = false;
         }
 
-        l1_icaches_[core]->request(memref);
+        if (region_stats_ != nullptr)
+            region_stats_->access(memref);
+        if (l1_parallel_ != nullptr)
+            l1_parallel_->enqueue(core, l1_parallel_t::L1_INSTR, memref, record);
+        else
+            l1_icaches_[core]->request(memref);
     } 
     else if (memref.data.type == TRACE_TYPE_READ ||
                memref.data.type == TRACE_TYPE_WRITE ||
@@ -586,21 +787,32 @@ cache_simulator_t::process_memref(const memref_t &memref)
                       << trace_type_names[memref.data.type] << " "
                       << (void *)memref.data.addr << " x" << memref.data.size << "\n";
         }
-        l1_dcaches_[core]->request(memref);
+        if (region_stats_ != nullptr)
+            region_stats_->access(memref);
+        if (l1_parallel_ != nullptr)
+            l1_parallel_->enqueue(core, l1_parallel_t::L1_DATA, memref, record);
+        else
+            l1_dcaches_[core]->request(memref);
     } else if (memref.flush.type == TRACE_TYPE_INSTR_FLUSH) {
         if (local_knobs->verbose >= 3) {
             std::cerr << "::" << memref.data.pid << "." << memref.data.tid << ":: "
                       << " @" << (void *)memref.data.pc << " iflush "
                       << (void *)memref.data.addr << " x" << memref.data.size << "\n";
         }
-        l1_icaches_[core]->flush(memref);
+        if (l1_parallel_ != nullptr)
+            l1_parallel_->enqueue(core, l1_parallel_t::L1_IFLUSH, memref, record);
+        else
+            l1_icaches_[core]->flush(memref);
     } else if (memref.flush.type == TRACE_TYPE_DATA_FLUSH) {
         if (local_knobs->verbose >= 3) {
             std::cerr << "::" << memref.data.pid << "." << memref.data.tid << ":: "
                       << " @" << (void *)memref.data.pc << " dflush "
                       << (void *)memref.data.addr << " x" << memref.data.size << "\n";
         }
-        l1_dcaches_[core]->flush(memref);
+        if (l1_parallel_ != nullptr)
+            l1_parallel_->enqueue(core, l1_parallel_t::L1_DFLUSH, memref, record);
+        else
+            l1_dcaches_[core]->flush(memref);
     } else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT) {
         handle_thread_exit(memref.exit.tid);
         last_thread_ = 0;
@@ -618,17 +830,44 @@ cache_simulator_t::process_memref(const memref_t &memref)
 
     // reset cache stats when warming up is completed
     if (!is_warmed_up_ && check_warmed_up()) {
+        // Bring every cache up to this reference before resetting.
+        if (l1_parallel_ != nullptr)
+            l1_parallel_->drain();
+        report_child_hits();
         for (auto &cache_it : all_caches_) {
             cache_t *cache = cache_it.second;
             cache->get_stats()->reset();
         }
+        if (region_stats_ != nullptr)
+            region_stats_->reset();
         if (local_knobs->verbose >= 1) {
             std::cerr << "Cache simulation warmed up\n";
         }
+        if (local_knobs->checkpoint_at == "warmup")
+            checkpoint_pending_ = true;
     } else {
         local_knobs->sim_refs--;
     }
 
+    // Checkpoints are taken between references so that the restored run
+    // resumes with the next one.
+    if (checkpoint_pending_ && !checkpoint_written_ && !local_knobs->checkpoint_out.empty()) {
+        if (!write_checkpoint(refs_seen_))
+            return false;
+    }
+    checkpoint_pending_ = false;
+
+    return true;
+}
+
+bool
+cache_simulator_t::process_memref_batch(const memref_t *memrefs, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        // A direct rather than a virtual call per entry.
+        if (!cache_simulator_t::process_memref(memrefs[i]))
+            return false;
+    }
     return true;
 }
 
@@ -678,6 +917,9 @@ cache_simulator_t::check_warmed_up()
 bool
 cache_simulator_t::print_results()
 {
+    if (l1_parallel_ != nullptr)
+        l1_parallel_->drain();
+    report_child_hits();
     std::cerr << "Cache simulation results:\n";
     // Print core and associated L1 cache stats first.
     for (unsigned int i = 0; i < knobs_->num_cores; i++) 
@@ -712,6 +954,13 @@ cache_simulator_t::print_results()
     {
         snoop_filter_->print_stats();
     }
+
+    if( ! local_knobs->checkpoint_out.empty() && ! checkpoint_written_ )
+    {
+        std::cerr << "Warning: the " << local_knobs->checkpoint_at 
+                  << " point was never reached, " << local_knobs->checkpoint_out 
+                  << " was not written\n";
+    }
     
     /**
      * print overall configuration as well here 
@@ -724,9 +973,194 @@ cache_simulator_t::print_results()
     }
     config_stream.flush();
     config_stream.close();
+
+    if( region_stats_ != nullptr )
+    {
+        std::ofstream region_stream( stats_dir + "/region_stats.txt" );
+        region_stats_->print( region_stream );
+    }
+
+    if( ! sweep_points_.empty() )
+    {
+        for( const auto &point : sweep_points_ )
+        {
+            point.cache->get_stats()->print_stats( "" );
+        }
+        print_sweep( stats_dir + "/LL_sweep.txt" );
+    }
+    return true;
+}
+
+// The checkpoint holds the position and run state, the simulator_t state,
+// the process of last_process_map_, each cache by name in sorted order, the
+// snoop filter, if any, the page stats and finally the region stats, if any.
+bool
+cache_simulator_t::write_checkpoint(uint64_t position)
+{
+    auto *local_knobs = reinterpret_cast<knob_t *>(knobs_);
+    const std::string &path = local_knobs->checkpoint_out;
+    if (l1_parallel_ != nullptr)
+        l1_parallel_->drain();
+    report_child_hits();
+    const bool compress =
+        path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0;
+    stats_file_writer_t out(path, STATS_FILE_CHECKPOINT, CHECKPOINT_VERSION, compress);
+    if (!out.is_open()) {
+        error_string_ = "Failed to open checkpoint file " + path;
+        return false;
+    }
+    out.write_varint(position);
+    out.write_varint(is_warmed_up_ ? 1 : 0);
+    out.write_varint(local_knobs->warmup_refs);
+    out.write_varint(local_knobs->sim_refs);
+    out.write_varint(local_knobs->start_pc);
+    out.write_varint(local_knobs->stop_pc);
+    simulator_t::save_state(out);
+    uint64_t last_pid = 0;
+    for (const auto &process : os_process_map_) {
+        if (last_process_map_ != nullptr && process.second == last_process_map_)
+            last_pid = (uint64_t)process.first + 1;
+    }
+    out.write_varint(last_pid);
+    std::vector<std::string> names;
+    for (const auto &cache_it : all_caches_)
+        names.push_back(cache_it.first);
+    std::sort(names.begin(), names.end());
+    out.write_varint(names.size());
+    for (const std::string &name : names) {
+        out.write_varint(name.size());
+        out.write_bytes(name.data(), name.size());
+        all_caches_[name]->save_state(out);
+    }
+    out.write_varint(snoop_filter_ != nullptr ? 1 : 0);
+    if (snoop_filter_ != nullptr)
+        snoop_filter_->save_state(out);
+    save_page_stats(out);
+    out.write_varint(region_stats_ != nullptr ? 1 : 0);
+    if (region_stats_ != nullptr)
+        region_stats_->save_state(out);
+    checkpoint_written_ = true;
+    if (local_knobs->verbose >= 1)
+        std::cerr << "Saved the cache simulator state to " << path << "\n";
+    return true;
+}
+
+bool
+cache_simulator_t::read_checkpoint(const std::string &path)
+{
+    auto *local_knobs = reinterpret_cast<knob_t *>(knobs_);
+    stats_file_reader_t in(path);
+    if (!in.get_error().empty()) {
+        error_string_ = "Failed to read checkpoint: " + in.get_error();
+        return false;
+    }
+    if (in.get_type() != STATS_FILE_CHECKPOINT || in.get_param() != CHECKPOINT_VERSION) {
+        error_string_ = path + " is not a cache simulator checkpoint";
+        return false;
+    }
+    error_string_ = "Checkpoint " + path + " is truncated or does not match the ";
+    uint64_t position, warmed_up, warmup_refs, sim_refs, start_pc, stop_pc, last_pid,
+        count;
+    if (!in.read_varint(&position) || !in.read_varint(&warmed_up) ||
+        !in.read_varint(&warmup_refs) || !in.read_varint(&sim_refs) ||
+        !in.read_varint(&start_pc) || !in.read_varint(&stop_pc) ||
+        !simulator_t::restore_state(in) || !in.read_varint(&last_pid)) {
+        error_string_ += "cores";
+        return false;
+    }
+    if (!in.read_varint(&count) || count != all_caches_.size()) {
+        error_string_ += "caches";
+        return false;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t length;
+        std::string name;
+        if (in.read_varint(&length) && length <= 1024) {
+            name.resize(length);
+            if (!in.read_bytes(&name[0], length))
+                name.clear();
+        }
+        const auto cache_it = all_caches_.find(name);
+        if (cache_it == all_caches_.end() || !cache_it->second->restore_state(in)) {
+            error_string_ += "cache " + (name.empty() ? std::string("names") : name);
+            return false;
+        }
+    }
+    uint64_t has_snoop_filter;
+    if (!in.read_varint(&has_snoop_filter) ||
+        has_snoop_filter != (snoop_filter_ != nullptr ? 1 : 0) ||
+        (snoop_filter_ != nullptr && !snoop_filter_->restore_state(in))) {
+        error_string_ += "coherence settings";
+        return false;
+    }
+    if (!restore_page_stats(in)) {
+        error_string_ += "page stats";
+        return false;
+    }
+    uint64_t has_region_stats;
+    if (!in.read_varint(&has_region_stats) ||
+        has_region_stats != (region_stats_ != nullptr ? 1 : 0) ||
+        (region_stats_ != nullptr && !region_stats_->restore_state(in))) {
+        error_string_ += "region stats";
+        return false;
+    }
+    error_string_.clear();
+    is_warmed_up_ = warmed_up != 0;
+    // A checkpoint taken during warmup resumes its countdown.
+    if (!is_warmed_up_ && local_knobs->warmup_refs > 0)
+        local_knobs->warmup_refs = warmup_refs;
+    // The run goes on with what was left of its -sim_refs budget.
+    local_knobs->sim_refs = sim_refs;
+    local_knobs->start_pc = start_pc;
+    local_knobs->stop_pc = stop_pc;
+    if (last_pid != 0)
+        last_process_map_ = os_process_map_[(memref_pid_t)(last_pid - 1)];
+    local_knobs->skip_refs = position;
+    if (local_knobs->verbose >= 1) {
+        std::cerr << "Restored the cache simulator state from " << path << ", skipping "
+                  << position << " references\n";
+    }
     return true;
 }
 
+void
+cache_simulator_t::report_child_hits() const
+{
+    for (auto &cache_it : all_caches_)
+        cache_it.second->report_child_hits();
+}
+
+void
+cache_simulator_t::print_sweep(const std::string &path) const
+{
+    const auto *local_knobs = reinterpret_cast<const knob_t *>(knobs_);
+    std::ofstream out(path);
+    out << std::left << std::setw(24) << "cache" << std::right << std::setw(14) << "size"
+        << std::setw(7) << "assoc" << std::setw(8) << "policy" << std::setw(16) << "hits"
+        << std::setw(16) << "misses" << std::setw(10) << "miss%" << std::setw(16)
+        << "compulsory" << "\n";
+    auto row = [&out](const std::string &name, uint64_t size, unsigned int assoc,
+                      const std::string &policy, const caching_device_stats_t *stats) {
+        const int_least64_t hits = stats->get_metric(metric_name_t::HITS);
+        const int_least64_t misses = stats->get_metric(metric_name_t::MISSES);
+        const double miss_rate =
+            hits + misses == 0 ? 0.0 : 100.0 * misses / (double)(hits + misses);
+        out << std::left << std::setw(24) << name << std::right << std::setw(14) << size
+            << std::setw(7) << assoc << std::setw(8)
+            << (policy.empty() ? REPLACE_POLICY_LRU : policy) << std::setw(16) << hits
+            << std::setw(16) << misses << std::setw(10) << std::fixed
+            << std::setprecision(2) << miss_rate << std::setw(16)
+            << stats->get_metric(metric_name_t::COMPULSORY_MISSES) << "\n";
+    };
+    const auto llc = llcaches_.find("LL");
+    if (llc != llcaches_.end()) {
+        row(llc->first, local_knobs->LL_size, local_knobs->LL_assoc,
+            local_knobs->replace_policy, llc->second->get_stats());
+    }
+    for (const auto &point : sweep_points_)
+        row(point.name, point.size, point.assoc, point.policy, point.cache->get_stats());
+}
+
 // All valid metrics are returned as a positive number.
 // Negative return value is an error and is of type stats_error_t.
 int_least64_t
@@ -737,6 +1171,10 @@ cache_simulator_t::get_cache_metric(    metric_name_t metric,
 {
     caching_device_t *curr_cache;
 
+    if (l1_parallel_ != nullptr)
+        l1_parallel_->drain();
+    report_child_hits();
+
     if (core >= knobs_->num_cores) 
     {
         return STATS_ERROR_WRONG_CORE_NUMBER;
@@ -782,9 +1220,12 @@ cache_simulator_t::create_cache(const std::string &policy)
         return new cache_t;
     if (policy == REPLACE_POLICY_FIFO) // set to FIFO
         return new cache_fifo_t;
+    if (policy == REPLACE_POLICY_PLRU) // set to tree pseudo-LRU
+        return new cache_plru_t;
 
     // undefined replacement policy
     ERRMSG("Usage error: undefined replacement policy. "
-           "Please choose " REPLACE_POLICY_LRU " or " REPLACE_POLICY_LFU ".\n");
+           "Please choose " REPLACE_POLICY_LRU ", " REPLACE_POLICY_LFU ", "
+           REPLACE_POLICY_FIFO " or " REPLACE_POLICY_PLRU ".\n");
     return NULL;
 }
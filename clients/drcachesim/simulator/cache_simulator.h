@@ -43,6 +43,8 @@
 #include "cache_stats.h"
 #include "cache.h"
 #include "snoop_filter.h"
+#include "l1_parallel.h"
+#include "region_stats.h"
 #include "defs.h"
 
 enum class cache_split_t { DATA, INSTRUCTION };
@@ -77,6 +79,8 @@ public:
     bool
     process_memref(const memref_t &memref) override;
     bool
+    process_memref_batch(const memref_t *memrefs, size_t count) override;
+    bool
     print_results() override;
 
     int_least64_t
@@ -116,6 +120,54 @@ protected:
     // Snoop filter tracks ownership of cache lines across private caches.
     snoop_filter_t *snoop_filter_ = nullptr;
 
+    // Simulates the L1 caches on worker threads when -l1_jobs is set.
+    l1_parallel_t *l1_parallel_ = nullptr;
+
+    // The memory map of last_thread_'s process, valid while last_thread_ is set.
+    vm_memory_map *last_process_map_ = nullptr;
+
+    // Per-mapping accesses and LLC hits and misses, when -region_stats is set.
+    region_stats_t *region_stats_ = nullptr;
+
+    // A last-level cache configuration from -LL_sweep.  The cache mirrors
+    // the LLC and is also owned through all_caches_.
+    struct sweep_point_t {
+        std::string name;
+        uint64_t size;
+        unsigned int assoc;
+        std::string policy;
+        cache_t *cache;
+    };
+    std::vector<sweep_point_t> sweep_points_;
+
+    // Writes the whole simulator state to -checkpoint_out as of position
+    // references passed to process_memref().
+    bool
+    write_checkpoint(uint64_t position);
+    // Restores the state written by write_checkpoint() and arranges for the
+    // references it covers to be skipped.
+    bool
+    read_checkpoint(const std::string &path);
+
+    // References passed to process_memref(), including skipped ones.
+    uint64_t refs_seen_ = 0;
+    bool checkpoint_pending_ = false;
+    bool checkpoint_written_ = false;
+
+    // Credits each cache's hits to its ancestors' child hits, which must be
+    // done before they are read or reset.
+    void
+    report_child_hits() const;
+
+    // Writes the LLC and the -LL_sweep points as one table.
+    void
+    print_sweep(const std::string &path) const;
+
+    // Parses -LL_sweep into points without caches.
+    static bool
+    parse_sweep(const std::string &spec, unsigned int default_assoc,
+                const std::string &default_policy, std::vector<sweep_point_t> &points);
+
 private:
     bool is_warmed_up_  = false;
 };
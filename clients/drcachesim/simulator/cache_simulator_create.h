@@ -72,10 +72,21 @@ struct cache_simulator_knobs_t : simulator_knobs_t /** base set of knobs **/
     uint64_t LL_size                = 8 * 1024 * 1024;
     unsigned int LL_assoc           = 16;
     std::string LL_miss_file        = "";
+    std::string LL_sweep            = "";
+    unsigned int LL_sample_ratio    = 1;
+    std::string checkpoint_out      = "";
+    std::string checkpoint_at       = "warmup";
+    std::string checkpoint_in       = "";
     bool model_coherence            = false;
+    uint64_t coherence_directory_entries = 0;
     std::string replace_policy      = "LRU";
     std::string data_prefetcher     = "nextline";
     bool op_cache_line_utilization  = false; 
+    bool flat_block_storage         = false;
+    std::string page_stats_sizes    = "4K,64K,1M";
+    std::string stats_format        = "text";
+    unsigned int l1_jobs            = 0;
+    bool region_stats               = false;
 };
 
 /** Creates an instance of a cache simulator with a 2-level hierarchy. */
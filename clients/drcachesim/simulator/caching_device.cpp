@@ -40,9 +40,12 @@
 #include "caching_device_stats.h"
 #include "prefetcher.h"
 #include "snoop_filter.h"
+#include "tag_match.h"
 #include "../common/utils.h"
 #include "dr_api.h"
 #include <assert.h>
+#include <algorithm>
+#include <new>
 #include "trace_entry.h"
 
 caching_device_t::caching_device_t()
@@ -62,21 +65,20 @@ caching_device_t::~caching_device_t()
     
     if( last_level )
     {
-        //write 4KiB
-        std::ofstream stream_4( stats_dir + "/ll_cache_usage_4KiB.dat" );
-        //write 64KiB
-        std::ofstream stream_64( stats_dir + "/ll_cache_usage_64KiB.dat" );
-        //write 1MiB
-        std::ofstream stream_1M( stats_dir + "/ll_cache_usage_1MiB.dat" );
-
-        page_stats_impl::write(  stream_4,
-                                 stream_64,
-                                 stream_1M );
+        //write ll_cache_usage_4KiB.dat etc.
+        page_stats_impl::write( stats_dir + "/ll_cache_usage" );
 
         page_stats_impl::destroy();
 
     }
 
+    if (use_flat_storage_) {
+        ::operator delete[](flat_tags_, std::align_val_t(FLAT_STORAGE_ALIGN));
+        ::operator delete[](flat_counters_, std::align_val_t(FLAT_STORAGE_ALIGN));
+        ::operator delete[](flat_valid_, std::align_val_t(FLAT_STORAGE_ALIGN));
+        ::operator delete[](flat_used_, std::align_val_t(FLAT_STORAGE_ALIGN));
+        return;
+    }
     if (blocks_ == NULL)
         return;
     for (int i = 0; i < settings_.num_blocks; i++)
@@ -84,6 +86,29 @@ caching_device_t::~caching_device_t()
     delete[] blocks_;
 }
 
+void
+caching_device_t::init_flat_blocks()
+{
+    const auto num_blocks = static_cast<std::size_t>(settings_.num_blocks);
+    // We align to the host cache line so that a set of up to 8 ways of tags
+    // occupies a single line.
+    flat_tags_ = new (std::align_val_t(FLAT_STORAGE_ALIGN)) addr_t[num_blocks];
+    flat_counters_ = new (std::align_val_t(FLAT_STORAGE_ALIGN)) int[num_blocks];
+    flat_valid_ = new (std::align_val_t(FLAT_STORAGE_ALIGN)) bool[num_blocks];
+    std::fill(flat_tags_, flat_tags_ + num_blocks, TAG_INVALID);
+    std::fill(flat_counters_, flat_counters_ + num_blocks, 0);
+    std::fill(flat_valid_, flat_valid_ + num_blocks, false);
+    tag_match_ =
+        settings_.associativity <= TAG_MATCH_INLINE_WAYS ? nullptr : tag_match_ways;
+    if (settings_.record_line_utilization) {
+        flat_used_words_ = (settings_.block_size + 63) / 64;
+        const auto num_words = num_blocks * flat_used_words_;
+        flat_used_ =
+            new (std::align_val_t(FLAT_STORAGE_ALIGN)) std::uint64_t[num_words];
+        std::fill(flat_used_, flat_used_ + num_words, 0);
+    }
+}
+
 
 /**
  * TODO - the param lists here have gotten a bit insane...
@@ -119,13 +144,27 @@ caching_device_t::init( caching_device_settings_t &&settings,
     blocks_per_set_mask_ = blocks_per_set_ - 1;
     if (assoc_bits_ == -1 || block_size_bits_ == -1 || !IS_POWER_OF_2(blocks_per_set_))
         return false;
+    if (sample_ratio_ > 1) {
+        if (!IS_POWER_OF_2(sample_ratio_) || sample_ratio_ > blocks_per_set_)
+            return false;
+        sample_bits_ = compute_log2(sample_ratio_);
+        sample_mask_ = sample_ratio_ - 1;
+        blocks_per_set_ >>= sample_bits_;
+        blocks_per_set_mask_ = blocks_per_set_ - 1;
+        settings_.num_blocks >>= sample_bits_;
+        stats->set_sample_sets(block_size_bits_ + sample_bits_, blocks_per_set_,
+                               blocks_per_set_ << sample_bits_);
+    }
     parent_ = parent;
     stats_ = stats;
     prefetcher_ = prefetcher;
     snoop_filter_ = snoop_filter;
-    blocks_ = new caching_device_block_t *[ settings_.num_blocks ];
-    
-    init_blocks( settings_.block_size );
+    if (use_flat_storage_) {
+        init_flat_blocks();
+    } else {
+        blocks_ = new caching_device_block_t *[ settings_.num_blocks ];
+        init_blocks( settings_.block_size );
+    }
 
     last_tag_ = TAG_INVALID; // sentinel
 
@@ -135,25 +174,116 @@ caching_device_t::init( caching_device_settings_t &&settings,
     return true;
 }
 
-std::pair<caching_device_block_t *, int>
-caching_device_t::find_caching_device_block(addr_t tag)
+int
+caching_device_t::find_caching_device_way(addr_t tag)
 {
     if (use_tag2block_table_) 
     {
         auto it = tag2block.find(tag);
         if (it == tag2block.end())
-            return std::make_pair(nullptr, 0);
-        assert(it->second.first->tag_ == tag);
+            return -1;
+        assert(get_block_tag(compute_block_idx(tag), it->second) == tag);
         return it->second;
     }
     int block_idx = compute_block_idx(tag);
+    if (use_flat_storage_)
+    {
+        const addr_t *set_tags = flat_tags_ + block_idx;
+        if (tag_match_ == nullptr)
+        {
+            for (int way = 0; way < settings_.associativity; ++way)
+            {
+                if (set_tags[way] == tag)
+                    return way;
+            }
+            return -1;
+        }
+        // Tags of a set are contiguous so we compare them all at once.
+        for (int base = 0; base < settings_.associativity; base += TAG_MATCH_MAX_WAYS)
+        {
+            const std::uint64_t mask = tag_match_(
+                set_tags + base, 
+                std::min(settings_.associativity - base, TAG_MATCH_MAX_WAYS), 
+                tag);
+            if (mask != 0)
+                return base + __builtin_ctzll(mask);
+        }
+        return -1;
+    }
     for (int way = 0; way < settings_.associativity; ++way ) 
     {
-        caching_device_block_t &block = get_caching_device_block(block_idx, way);
-        if (block.tag_ == tag)
-            return std::make_pair(&block, way);
+        if (blocks_[block_idx + way]->tag_ == tag)
+            return way;
+    }
+    return -1;
+}
+
+void
+caching_device_t::reset_block(int block_idx, int way)
+{
+    if (!use_flat_storage_)
+    {
+        caching_device_block_t *block = blocks_[block_idx + way];
+        if (settings_.record_line_utilization && block->valid)
+            stats_->utilization_line_evicted(block->get_used_bytes(), settings_.block_size);
+        block->reset();
+        return;
+    }
+    if (flat_used_ != nullptr)
+    {
+        std::uint64_t *used = flat_used_ + (block_idx + way) * flat_used_words_;
+        if (flat_valid_[block_idx + way])
+            stats_->utilization_line_evicted(used, settings_.block_size);
+        std::fill(used, used + flat_used_words_, 0);
+    }
+    flat_valid_[block_idx + way] = false;
+    flat_counters_[block_idx + way] = 0;
+}
+
+void
+caching_device_t::update_block_utilization(int block_idx, int way,
+                                           const memref_t &memref,
+                                           std::size_t offset)
+{
+    if (!use_flat_storage_)
+    {
+        caching_device_block_t *block = blocks_[block_idx + way];
+        if (!block->valid)
+            stats_->utilization_line_filled();
+        block->update_utilization(memref, offset, *(settings_.record), stats_);
+        return;
+    }
+    if (!flat_valid_[block_idx + way])
+    {
+        flat_valid_[block_idx + way] = true;
+        stats_->utilization_line_filled();
+    }
+    if (flat_used_ == nullptr)
+        return;
+    std::uint64_t *used = flat_used_ + (block_idx + way) * flat_used_words_;
+    const std::size_t end =
+        std::min(offset + memref.data.size, (std::size_t)settings_.block_size);
+    stats_->record_bytes_used(used, offset, end);
+}
+
+void
+caching_device_t::flush_block_utilization(int block_idx, int way)
+{
+    if (!is_block_valid(block_idx, way))
+        return;
+    if (use_flat_storage_)
+    {
+        if (flat_used_ == nullptr)
+            return;
+        stats_->flush_update(flat_used_ + (block_idx + way) * flat_used_words_,
+                             settings_.block_size);
+    }
+    else
+    {
+        const std::uint64_t *used = blocks_[block_idx + way]->get_used_bytes();
+        if (used != nullptr)
+            stats_->flush_update(used, settings_.block_size);
     }
-    return std::make_pair(nullptr, 0);
 }
 
 void
@@ -181,21 +311,21 @@ caching_device_t::request(const memref_t &memref_in)
     if (tag == final_tag && tag == last_tag_ && memref_in.data.type != TRACE_TYPE_WRITE) 
     {
         // Make sure last_tag_ is properly in sync.
-        caching_device_block_t *cache_block =
-            &get_caching_device_block(last_block_idx_, last_way_);
-        assert(tag != TAG_INVALID && tag == cache_block->tag_);
+        assert(tag != TAG_INVALID && tag == get_block_tag(last_block_idx_, last_way_));
         
         if( settings_.record_line_utilization )
         {
             /** get offset **/
             const auto offset( ( ~( UINT64_MAX << block_size_bits_ ) ) & memref_in.data.addr );
             /** update line utilization **/
-            cache_block->update_utilization( memref_in, 
-                                             offset, 
-                                             *(settings_.record) );
+            update_block_utilization( last_block_idx_, 
+                                      last_way_, 
+                                      memref_in, 
+                                      offset );
             
         }
-        record_access_stats(memref_in, true /*hit*/, cache_block);
+        record_access_stats(memref_in, true /*hit*/,
+                            get_caching_device_block_ptr(last_block_idx_, last_way_));
         access_update(last_block_idx_, last_way_);
         return;
     }
@@ -206,27 +336,36 @@ caching_device_t::request(const memref_t &memref_in)
         int block_idx = compute_block_idx(tag);
         bool missed = false;
 
+        if ((tag & sample_mask_) != 0) {
+            // The line maps to a set that is not sampled.
+            if (tag + 1 <= final_tag) {
+                addr_t next_addr = (tag + 1) << block_size_bits_;
+                memref.data.addr = next_addr;
+                memref.data.size = final_addr - next_addr + 1 /*undo the -1*/;
+            }
+            continue;
+        }
+
         if (tag + 1 <= final_tag)
             memref.data.size = ((tag + 1) << block_size_bits_) - memref.data.addr;
 
-        auto block_way = find_caching_device_block(tag);
-        if (block_way.first != nullptr) {
+        const int hit_way = find_caching_device_way(tag);
+        if (hit_way >= 0) {
             // Access is a hit.
-            caching_device_block_t *cache_block = block_way.first;
-            way = block_way.second;
+            way = hit_way;
             if( settings_.record_line_utilization )
             {
                 /** get offset **/
                 const auto offset( ( ~( UINT64_MAX << block_size_bits_ ) ) & memref.data.addr );
                 /** update line utilization **/
-                cache_block->update_utilization( 
-                    memref, 
-                    offset, 
-                    (*settings_.record) );
+                update_block_utilization( block_idx, 
+                                          way, 
+                                          memref, 
+                                          offset );
             }
             record_access_stats(    memref, 
                                     true /*hit*/, 
-                                    cache_block );
+                                    get_caching_device_block_ptr( block_idx, way ) );
             if( settings_.coherent_cache && memref.data.type == TRACE_TYPE_WRITE ) 
             {
                 // On a hit, we must notify the snoop filter of the write or propagate
@@ -245,15 +384,17 @@ caching_device_t::request(const memref_t &memref_in)
         // Access is a miss.
         {
             way = replace_which_way(block_idx);
-            caching_device_block_t *cache_block =
-                &get_caching_device_block(block_idx, way);
 
-            record_access_stats(memref, false /*miss*/, cache_block);
+            record_access_stats(memref, false /*miss*/,
+                                get_caching_device_block_ptr(block_idx, way));
             missed = true;
             // If no parent we assume we get the data from main memory
             if (parent_ != NULL)
             {
-                parent_->request(memref);
+                if (parent_queue_ != nullptr)
+                    parent_queue_->push(memref, parent_queue_t::PARENT_REQUEST);
+                else
+                    parent_->request(memref);
             }
             if( parent_ == NULL && last_level && (*settings_.record) )
             {
@@ -266,7 +407,7 @@ caching_device_t::request(const memref_t &memref_in)
                 snoop_filter_->snoop(tag, settings_.id, (memref.data.type == TRACE_TYPE_WRITE));
             }
 
-            addr_t victim_tag = cache_block->tag_;
+            addr_t victim_tag = get_block_tag(block_idx, way);
             // Check if we are inserting a new block, if we are then increment
             // the block loaded count.
             if (victim_tag == TAG_INVALID) {
@@ -304,7 +445,7 @@ caching_device_t::request(const memref_t &memref_in)
                     }
                 }
             }
-            update_tag(cache_block, way, tag);
+            update_tag(block_idx, way, tag);
         }
 
         access_update(block_idx, way);
@@ -331,7 +472,7 @@ void
 caching_device_t::access_update(int block_idx, int way)
 {
     // We just inc the counter for LFU.  We live with any blip on overflow.
-    get_caching_device_block(block_idx, way).counter_++;
+    get_block_counter(block_idx, way)++;
 }
 
 int
@@ -343,34 +484,30 @@ caching_device_t::replace_which_way(int block_idx)
     int min_counter{ 0 }, min_way{ 0 }; 
     for( int way{ 0 }; way < settings_.associativity; ++way) 
     {
-        const auto &block( get_caching_device_block( block_idx, way ) );
-        if( block.tag_ == TAG_INVALID) 
+        if( get_block_tag( block_idx, way ) == TAG_INVALID) 
         {
             min_way = way;
             break;
         }
-        if( way == 0 || block.counter_ < min_counter ) 
+        const auto counter( get_block_counter( block_idx, way ) );
+        if( way == 0 || counter < min_counter ) 
         {
-            min_counter = block.counter_;
+            min_counter = counter;
             min_way = way;
         }
     }
-    auto &block( get_caching_device_block( block_idx, min_way ) );
     // Clear the counter for LFU.
-    //if( block.valid && block.event_flags[0] )
-    //{
-    //    stats_->flush_update( block.getBits() );
-    //}
-    block.reset();
+    //flush_block_utilization( block_idx, min_way );
+    reset_block( block_idx, min_way );
     return min_way;
 }
 
 void
 caching_device_t::invalidate(addr_t tag, invalidation_type_t invalidation_type)
 {
-    auto block_way = find_caching_device_block(tag);
-    if (block_way.first != nullptr) {
-        invalidate_caching_device_block(block_way.first);
+    const int way = find_caching_device_way(tag);
+    if (way >= 0) {
+        invalidate_caching_device_block(compute_block_idx(tag), way);
         stats_->invalidate(invalidation_type);
         // Invalidate last_tag_ if it was this tag.
         if (last_tag_ == tag) {
@@ -396,8 +533,7 @@ caching_device_t::invalidate(addr_t tag, invalidation_type_t invalidation_type)
 bool
 caching_device_t::contains_tag(addr_t tag)
 {
-    auto block_way = find_caching_device_block(tag);
-    if (block_way.first != nullptr)
+    if (find_caching_device_way(tag) >= 0)
         return true;
     if (children_.empty()) {
         return false;
@@ -416,8 +552,7 @@ void
 caching_device_t::propagate_eviction(addr_t tag, const caching_device_t *requester)
 {
     // Check our own cache for this line.
-    auto block_way = find_caching_device_block(tag);
-    if (block_way.first != nullptr)
+    if (find_caching_device_way(tag) >= 0)
         return;
 
     // Check if other children contain this line.
@@ -466,27 +601,38 @@ caching_device_t::record_access_stats(const memref_t &memref, bool hit,
                                       caching_device_block_t *cache_block)
 {
     stats_->access(memref, hit, cache_block);
-    // We propagate hits all the way up the hierachy.
-    // But to avoid over-counting we only propagate misses one level up.
-    if (hit) {
-        for (caching_device_t *up = parent_; up != nullptr; up = up->parent_)
-            up->stats_->child_access(memref, hit, cache_block);
-    } else if (parent_ != nullptr)
+    // The parent is updated when the queue is replayed.
+    if (parent_queue_ != nullptr) {
+        if (hit)
+            parent_queue_->child_hits++;
+        return;
+    }
+    // We propagate hits all the way up the hierachy, in bulk when they are
+    // reported.  But to avoid over-counting we only propagate misses one
+    // level up.
+    if (hit)
+        unreported_hits_++;
+    else if (parent_ != nullptr)
         parent_->stats_->child_access(memref, hit, cache_block);
 }
 
+void
+caching_device_t::report_child_hits() const
+{
+    if (unreported_hits_ == 0)
+        return;
+    for (caching_device_t *up = parent_; up != nullptr; up = up->parent_)
+        up->stats_->add_child_hits(unreported_hits_);
+    unreported_hits_ = 0;
+}
+
 
 void
 caching_device_t::forceUpdateInc() noexcept
 {
-    for( auto i{0}; i < settings_.num_blocks; i++)
-    {
-        auto * const block( blocks_[ i ] );
-        if( block->valid && block->event_flags[0] )
-        {
-            stats_->inc_update( block->getBits() );
-        }
-    }
+    // The stats track the utilization of resident lines as they change, so
+    // there is no need to walk the blocks here.
+    stats_->snapshot_utilization();
     return;
 }
 
@@ -494,18 +640,94 @@ caching_device_t::forceUpdateInc() noexcept
 void
 caching_device_t::forceUpdateFinal() noexcept
 {
-    for( auto i{0}; i < settings_.num_blocks; i++)
-    {
-        auto * const block( blocks_[ i ] );
-        if( block->valid && block->event_flags[0] )
-        {
-            stats_->flush_update( block->getBits() );
-        }
-    }
+    stats_->snapshot_utilization();
     return;
 }
     
 
+void
+caching_device_t::save_state(stats_file_writer_t &out)
+{
+    const std::size_t used_words =
+        settings_.record_line_utilization ? (settings_.block_size + 63) / 64 : 0;
+    out.write_varint(settings_.num_blocks);
+    out.write_varint(settings_.associativity);
+    out.write_varint(settings_.block_size);
+    out.write_varint(sample_ratio_);
+    out.write_varint(used_words);
+    out.write_varint(loaded_blocks_);
+    out.write_varint(request_counter);
+    for (int i = 0; i < settings_.num_blocks; i++) {
+        // Invalid tags, all ones, are written as 0 to keep them to one byte.
+        out.write_varint(get_block_tag(i, 0) + 1);
+        out.write_varint((std::uint32_t)get_block_counter(i, 0));
+        const bool valid = use_flat_storage_ ? flat_valid_[i] : blocks_[i]->valid;
+        out.write_varint(valid ? 1 : 0);
+        if (used_words == 0)
+            continue;
+        const std::uint64_t *used = use_flat_storage_ ? flat_used_ + i * flat_used_words_
+                                                      : blocks_[i]->get_used_bytes();
+        for (std::size_t w = 0; w < used_words; w++)
+            out.write_varint(used[w]);
+    }
+    // The last level also tracks the pages it was asked for.
+    out.write_varint(last_level ? 1 : 0);
+    if (last_level)
+        save_page_stats(out);
+    stats_->save_state(out);
+}
+
+bool
+caching_device_t::restore_state(stats_file_reader_t &in)
+{
+    const std::size_t used_words =
+        settings_.record_line_utilization ? (settings_.block_size + 63) / 64 : 0;
+    std::uint64_t num_blocks, associativity, block_size, sample_ratio, words;
+    std::uint64_t loaded_blocks, counter;
+    if (!in.read_varint(&num_blocks) || !in.read_varint(&associativity) ||
+        !in.read_varint(&block_size) || !in.read_varint(&sample_ratio) ||
+        !in.read_varint(&words) || !in.read_varint(&loaded_blocks) ||
+        !in.read_varint(&counter))
+        return false;
+    if (num_blocks != (std::uint64_t)settings_.num_blocks ||
+        associativity != (std::uint64_t)settings_.associativity ||
+        block_size != (std::uint64_t)settings_.block_size ||
+        sample_ratio != (std::uint64_t)sample_ratio_ || words != used_words)
+        return false;
+    loaded_blocks_ = (int)loaded_blocks;
+    request_counter = counter;
+    for (int i = 0; i < settings_.num_blocks; i++) {
+        std::uint64_t tag, block_counter, valid;
+        if (!in.read_varint(&tag) || !in.read_varint(&block_counter) ||
+            !in.read_varint(&valid))
+            return false;
+        // Index by set so that any tag2block table is kept up to date.
+        const int block_idx = i & ~(settings_.associativity - 1);
+        const int way = i & (settings_.associativity - 1);
+        if (tag != 0)
+            update_tag(block_idx, way, tag - 1);
+        get_block_counter(block_idx, way) = (int)(std::uint32_t)block_counter;
+        if (use_flat_storage_)
+            flat_valid_[i] = valid != 0;
+        else
+            blocks_[i]->valid = valid != 0;
+        if (used_words == 0)
+            continue;
+        std::uint64_t *used = use_flat_storage_ ? flat_used_ + i * flat_used_words_
+                                                : blocks_[i]->get_used_bytes();
+        for (std::size_t w = 0; w < used_words; w++) {
+            if (!in.read_varint(&used[w]))
+                return false;
+        }
+    }
+    last_tag_ = TAG_INVALID;
+    std::uint64_t has_page_stats;
+    if (!in.read_varint(&has_page_stats) || has_page_stats != (last_level ? 1 : 0) ||
+        (last_level && !restore_page_stats(in)))
+        return false;
+    return stats_->restore_state(in);
+}
+
 void 
 caching_device_t::set_as_last_level()
 {
@@ -57,6 +57,7 @@
 #include "page_stats_impl.hpp"
 #include "cache_settings.h"
 #include "caching_device_settings.h"
+#include "tag_match.h"
 
 // Statistics collection is abstracted out into the caching_device_stats_t class.
 
@@ -68,6 +69,37 @@
 
 class snoop_filter_t;
 
+// Work bound for a device's parent, buffered instead of performed when the
+// device is simulated on a different thread from its parent; see
+// caching_device_t::set_parent_queue().  The owner replays the entries on the
+// parent in seq order.
+struct parent_queue_t {
+    enum op_t : uint8_t {
+        PARENT_REQUEST, // The device missed: child_access() and request().
+        PARENT_FLUSH,   // The device was flushed.
+    };
+    struct entry_t {
+        memref_t memref;
+        uint64_t seq;
+        op_t op;
+        bool record;
+    };
+    std::vector<entry_t> entries;
+    // Hits since the queue was last drained, owed to every ancestor's
+    // child hit count.
+    int_least64_t child_hits = 0;
+    // Stamped on each entry: the position in the input of the memref being
+    // simulated and the simulator's recording state at that point.
+    uint64_t seq = 0;
+    bool record = false;
+
+    inline void
+    push(const memref_t &memref, op_t op)
+    {
+        entries.push_back({ memref, seq, op, record });
+    }
+};
+
 
 class caching_device_t : public page_stats_impl {
 public:
@@ -101,11 +133,28 @@ public:
     void
     propagate_write(addr_t tag, const caching_device_t *requester);
 
+    // Writes the blocks, including their replacement counters and used bytes,
+    // the page stats of a last level and then the stats, for a checkpoint.  The layout does not depend on
+    // the block storage, so flat and pointer-based devices can exchange it.
+    virtual void
+    save_state(stats_file_writer_t &out);
+    // Reads what save_state() wrote into a freshly initialized device of the
+    // same geometry.  Returns false on a mismatch or a truncated file.
+    virtual bool
+    restore_state(stats_file_reader_t &in);
+
     caching_device_stats_t *
     get_stats() const
     {
         return stats_;
     }
+    // Hits are counted here rather than in every ancestor's child stats on
+    // each hit.  This credits the hits counted since the last call to all
+    // ancestors, and must be called on every device before any child hits
+    // are read or reset.  It is const as it changes no metric's value, only
+    // where the hits are held until then.
+    void
+    report_child_hits() const;
     void
     set_stats(caching_device_stats_t *stats)
     {
@@ -126,6 +175,38 @@ public:
     {
         return double(loaded_blocks_) / settings_.num_blocks;
     }
+    // When queue is non-null, requests, flushes and child hit accounting
+    // bound for the parent are appended to queue instead of being performed,
+    // so that the device can be simulated on another thread.  Only valid
+    // when nothing flows back down from the parent: no coherence and a
+    // non-inclusive parent.
+    inline void
+    set_parent_queue(parent_queue_t *queue)
+    {
+        parent_queue_ = queue;
+    }
+    // Must be called prior to init().  Replaces the per-block objects pointed
+    // to by blocks_ with flat per-set arrays of tags, counters and valid bits,
+    // keeping any line utilization bitmaps in a separate side array.  A way
+    // scan then touches contiguous memory instead of chasing one pointer per
+    // way.  Subclasses that extend caching_device_block_t with their own
+    // fields must override init_flat_blocks() to add side arrays for them,
+    // as tlb_t does for its pids.
+    inline void
+    set_flat_storage_use(bool use_flat_storage)
+    {
+        use_flat_storage_ = use_flat_storage;
+    }
+    // Must be called prior to init().  Simulates only one in sample_ratio
+    // sets, a power of 2, and allocates blocks for those alone.  A line that
+    // maps to any other set is dropped by request() without being counted,
+    // so the stats describe the sampled sets and their miss rate estimates
+    // the miss rate of the full device.
+    inline void
+    set_sample_ratio(int sample_ratio)
+    {
+        sample_ratio_ = sample_ratio;
+    }
     // Must be called prior to any call to request().
     virtual inline void
     set_hashtable_use(bool use_hashtable)
@@ -162,6 +243,12 @@ protected:
     access_update(int block_idx, int way);
     virtual int
     replace_which_way(int block_idx);
+    // Called when a block is invalidated other than by replacement, for
+    // policies that keep replacement state outside of the block counters.
+    virtual void
+    invalidate_update(int block_idx, int way)
+    {
+    }
     virtual void
     record_access_stats(const memref_t &memref, bool hit,
                         caching_device_block_t *cache_block);
@@ -174,44 +261,103 @@ protected:
     inline int
     compute_block_idx(addr_t tag)
     {
-        return (tag & blocks_per_set_mask_) << assoc_bits_;
+        return ((tag >> sample_bits_) & blocks_per_set_mask_) << assoc_bits_;
     }
+    // Only valid with pointer-based block storage: see set_flat_storage_use().
     inline caching_device_block_t &
     get_caching_device_block(int block_idx, int way)
     {
         return *(blocks_[block_idx + way]);
     }
+    // Returns nullptr with flat block storage, where there is no block object.
+    inline caching_device_block_t *
+    get_caching_device_block_ptr(int block_idx, int way)
+    {
+        if (use_flat_storage_)
+            return nullptr;
+        return blocks_[block_idx + way];
+    }
+
+    // The following accessors work with either block storage and are what
+    // replacement policies should use to examine and update a set.
+    inline addr_t &
+    get_block_tag(int block_idx, int way)
+    {
+        if (use_flat_storage_)
+            return flat_tags_[block_idx + way];
+        return blocks_[block_idx + way]->tag_;
+    }
+    inline int &
+    get_block_counter(int block_idx, int way)
+    {
+        if (use_flat_storage_)
+            return flat_counters_[block_idx + way];
+        return blocks_[block_idx + way]->counter_;
+    }
+    inline bool
+    is_block_valid(int block_idx, int way)
+    {
+        if (use_flat_storage_)
+            return flat_valid_[block_idx + way];
+        const caching_device_block_t *block = blocks_[block_idx + way];
+        return block->valid && block->event_flags[0];
+    }
+
+    // Clears the replacement counter, valid bit and utilization of a block
+    // that is about to be replaced.
+    void
+    reset_block(int block_idx, int way);
+
+    // Marks the bytes touched by memref, starting at offset within the block,
+    // as used.
+    void
+    update_block_utilization(int block_idx, int way, const memref_t &memref,
+                             std::size_t offset);
+
+    // Folds the utilization of a block into the stats' flush histogram.
+    void
+    flush_block_utilization(int block_idx, int way);
 
     inline void
-    invalidate_caching_device_block(caching_device_block_t *block)
+    invalidate_caching_device_block(int block_idx, int way)
     {
+        addr_t &tag = get_block_tag(block_idx, way);
         if (use_tag2block_table_)
-            tag2block.erase(block->tag_);
-        block->tag_ = TAG_INVALID;
+            tag2block.erase(tag);
+        tag = TAG_INVALID;
         // Xref cache_block_t constructor about why we set counter to 0.
-        block->counter_ = 0;
+        get_block_counter(block_idx, way) = 0;
+        invalidate_update(block_idx, way);
     }
 
     inline void
-    update_tag(caching_device_block_t *block, int way, addr_t new_tag)
+    update_tag(int block_idx, int way, addr_t new_tag)
     {
+        addr_t &tag = get_block_tag(block_idx, way);
         if (use_tag2block_table_) {
-            if (block->tag_ != TAG_INVALID)
-                tag2block.erase(block->tag_);
-            tag2block[new_tag] = std::make_pair(block, way);
+            if (tag != TAG_INVALID)
+                tag2block.erase(tag);
+            tag2block[new_tag] = way;
         }
-        block->tag_ = new_tag;
+        tag = new_tag;
     }
 
-    // Returns the block (and its way) whose tag equals `tag`.
-    // Returns <nullptr,0> if there is no such block.
-    std::pair<caching_device_block_t *, int>
-    find_caching_device_block(addr_t tag);
+    // Returns the way whose tag equals `tag` within the set `tag` maps to.
+    // Returns -1 if there is no such block.
+    int
+    find_caching_device_way(addr_t tag);
 
     // a pure virtual function for subclasses to initialize their own block array
     virtual void
     init_blocks( const std::size_t line_size ) = 0;
 
+    // Allocates the flat block arrays used when use_flat_storage_ is set.
+    virtual void
+    init_flat_blocks();
+
+    // Alignment of each flat block array, a host cache line.
+    static constexpr std::size_t FLAT_STORAGE_ALIGN = 64;
+
     // Current valid blocks in the cache
     int loaded_blocks_;
 
@@ -220,18 +366,40 @@ protected:
     std::vector<caching_device_t *>  children_;
 
     snoop_filter_t                  *snoop_filter_  = nullptr;
+    parent_queue_t                  *parent_queue_  = nullptr;
 
     // This should be an array of caching_device_block_t pointers, otherwise
     // an extended block class which has its own member variables cannot be indexed
     // correctly by base class pointers.
     caching_device_block_t **blocks_    = nullptr;
 
+    // Flat structure-of-arrays block storage, used instead of blocks_ when
+    // use_flat_storage_ is set.  Each array has num_blocks entries laid out
+    // set-major, so all ways of a set are adjacent.
+    bool            use_flat_storage_   = false;
+    addr_t         *flat_tags_          = nullptr;
+    int            *flat_counters_      = nullptr;
+    bool           *flat_valid_         = nullptr;
+    // Side array of line utilization bitmaps, flat_used_words_ words per block.
+    // Only allocated when recording line utilization.
+    std::uint64_t  *flat_used_          = nullptr;
+    int             flat_used_words_    = 0;
+    // The tag match kernel for this device's sets, chosen by init_flat_blocks().
+    // nullptr for sets of up to TAG_MATCH_INLINE_WAYS ways, which are compared
+    // with an inline loop: a call costs more than it saves there.
+    tag_match_func_t tag_match_         = nullptr;
+
     //set internal to this class
     int blocks_per_set_;
     // Optimization fields for fast bit operations
     int blocks_per_set_mask_;
     int assoc_bits_;
     int block_size_bits_;
+    // Set sampling: a tag is simulated only when its low sample_bits_ bits,
+    // masked by sample_mask_, are zero.  Both are zero without sampling.
+    int sample_ratio_   = 1;
+    int sample_bits_    = 0;
+    addr_t sample_mask_ = 0;
 
     caching_device_stats_t *stats_  = nullptr;
     prefetcher_t           *prefetcher_ = nullptr;
@@ -246,12 +414,14 @@ protected:
     // We can't easily remove the blocks_ array and replace with just
     // the hashtable as replace_which_way(), etc. want quick access to
     // every way for a given line index.
-    std::unordered_map<addr_t, std::pair<caching_device_block_t *, int>,
-                       std::function<unsigned long(addr_t)>>
+    // The block index is implied by the tag so we only store the way.
+    std::unordered_map<addr_t, int, std::function<unsigned long(addr_t)>>
         tag2block;
     bool use_tag2block_table_ = false;
     
     uintmax_t   request_counter     = 0;
+    // Hits not yet credited to the ancestors: see report_child_hits().
+    mutable int_least64_t unreported_hits_ = 0;
 
     //only set if last level, leave these here for now
     bool        last_level          = false;
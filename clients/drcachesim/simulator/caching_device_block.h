@@ -36,7 +36,6 @@
 #ifndef _CACHING_DEVICE_BLOCK_H_
 #define _CACHING_DEVICE_BLOCK_H_ 1
 
-#include <boost/dynamic_bitset.hpp>
 #include <bitset>
 #include <cinttypes>
 #include <cstdint>
@@ -49,6 +48,8 @@
 // block status.
 static const addr_t TAG_INVALID = (addr_t)-1; // block is invalid
 
+class caching_device_stats_t;
+
 class caching_device_block_t {
 public:
     // Initializing counter to 0 is just to be safe and to make it easier to write new
@@ -60,7 +61,14 @@ public:
     // Destructor must be virtual and default is not.
     virtual ~caching_device_block_t() = default;
     
-    virtual void update_utilization( const memref_t &in, const size_t offset, const bool record )
+    /** 
+     * bytes used for the first time are reported to stats so that it can 
+     * keep its utilization histogram up to date incrementally 
+     */
+    virtual void update_utilization( const memref_t &in, 
+                                     const size_t offset, 
+                                     const bool record,
+                                     caching_device_stats_t *stats )
     {
         valid = true;
         //event_flags[0] = event_flags[0] || record; //record if we are in ROI
@@ -74,10 +82,13 @@ public:
         return;
     }
 
-    virtual boost::dynamic_bitset<> getBits()
+    /** 
+     * bitmap of the bytes of the block used so far, one bit per byte, or
+     * nullptr if this block does not record utilization 
+     */
+    virtual std::uint64_t *get_used_bytes()
     {
-        boost::dynamic_bitset<> dummy( 0 );
-        return( dummy );
+        return( nullptr );
     }
 
     addr_t tag_        = TAG_INVALID;
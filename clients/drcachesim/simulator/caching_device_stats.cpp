@@ -31,6 +31,7 @@
  */
 
 #include <assert.h>
+#include <cmath>
 #include <iostream>
 #include <iomanip>
 #include <sys/types.h>
@@ -39,11 +40,14 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <thread>
+#include <utility>
 #include "dr_api.h"
 
 #include "../common/options.h"
 #include "caching_device_stats.h"
 #include "caching_device.h"
+#include "region_stats.h"
 
 caching_device_stats_t::caching_device_stats_t( const std::string directory_name,
                                                 const std::string cache_name, 
@@ -69,24 +73,30 @@ caching_device_stats_t::caching_device_stats_t( const std::string directory_name
     , record_utilization_( record_utilization )
     , file_(nullptr)
 {
-    /** multiple calls here, but subsequent ones will hit success quickly **/
-    struct stat st;
-    std::memset( &st, 0, sizeof( struct stat ) );
-    if( stat( directory_name.c_str(), &st ) != 0 )
+    /** 
+     * multiple calls here, but subsequent ones will hit success quickly,
+     * no directory means no stats files, e.g., for the miss analyzer 
+     **/
+    if( ! directory_name.empty() )
     {
-        //make directory
-        if( mkdir( directory_name.c_str(), 0777 ) != 0 )
+        struct stat st;
+        std::memset( &st, 0, sizeof( struct stat ) );
+        if( stat( directory_name.c_str(), &st ) != 0 )
         {
-            perror( "failed to create stats directory as specified" );
+            //make directory
+            if( mkdir( directory_name.c_str(), 0777 ) != 0 )
+            {
+                perror( "failed to create stats directory as specified" );
+                DR_ASSERT( false );
+            }
+        }
+        //check to make sure its a directory
+        else if( ! S_ISDIR( st.st_mode ) )
+        {
+            fprintf( stderr, "\"%s\" is not a directory, can't write stats file\n", directory_name.c_str() );
             DR_ASSERT( false );
         }
     }
-    //check to make sure its a directory
-    else if( ! S_ISDIR( st.st_mode ) )
-    {
-        fprintf( stderr, "\"%s\" is not a directory, can't write stats file\n", directory_name.c_str() );
-        DR_ASSERT( false );
-    }
     
     if (miss_file.empty()) {
         dump_misses_ = false;
@@ -99,8 +109,12 @@ caching_device_stats_t::caching_device_stats_t( const std::string directory_name
         if (file_ == nullptr) {
             dump_misses_ = false;
             success_ = false;
-        } else
+        } else {
             dump_misses_ = true;
+            miss_file_ = miss_file;
+            for (auto &block : miss_blocks_)
+                block.records.resize(MISS_BLOCK_RECORDS);
+        }
     }
     if( record_utilization_ )
     {
@@ -111,15 +125,36 @@ caching_device_stats_t::caching_device_stats_t( const std::string directory_name
             std::perror( "failed to open utilization stream" );
             DR_ASSERT( false );
         }
+        if( block_size > 0 )
+        {
+            histogram_size = init_histogram( &histogram, block_size );
+            init_histogram( &resident_histogram, block_size );
+            for( auto &snapshot : snapshots )
+            {
+                init_histogram( &snapshot.histogram, block_size );
+            }
+        }
+    }
+    if( file_ != nullptr || ( record_utilization_ && block_size > 0 ) )
+    {
+        stats_writer = stats_writer_t::acquire();
+        stats_writer->add_source( this, [ this ]()
+        {
+            const bool wrote_snapshots( drain_histogram_snapshots() );
+            return( drain_miss_blocks() || wrote_snapshots );
+        } );
     }
     this->cache_name = cache_name;
     this->stats_dir  = directory_name;
     /** open stream for each cache stats **/
-    cache_stats_stream.open( directory_name + "/" + cache_name + ".txt" );
-    if( ! cache_stats_stream.is_open() )
+    if( ! directory_name.empty() )
     {
-        std::perror( "Failed to open cache stats stream, exiting!" );
-        DR_ASSERT( false );
+        cache_stats_stream.open( directory_name + "/" + cache_name + ".txt" );
+        if( ! cache_stats_stream.is_open() )
+        {
+            std::perror( "Failed to open cache stats stream, exiting!" );
+            DR_ASSERT( false );
+        }
     }
 
 
@@ -137,6 +172,16 @@ caching_device_stats_t::caching_device_stats_t( const std::string directory_name
 
 caching_device_stats_t::~caching_device_stats_t()
 {
+    if( stats_writer != nullptr )
+    {
+        if( ! miss_file_.empty() )
+        {
+            publish_miss_block();
+        }
+        /** writes out any snapshots and misses still in flight **/
+        stats_writer->remove_source( this );
+        stats_writer_t::release();
+    }
     if (file_ != nullptr) {
 #ifdef HAS_ZLIB
         gzclose(file_);
@@ -144,6 +189,14 @@ caching_device_stats_t::~caching_device_stats_t()
         fclose(file_);
 #endif
     }
+    delete miss_writer_;
+    delete( histogram_writer );
+    free( histogram );
+    free( resident_histogram );
+    for( auto &snapshot : snapshots )
+    {
+        free( snapshot.histogram );
+    }
 }
 
 void
@@ -165,6 +218,107 @@ caching_device_stats_t::access(const memref_t &memref, bool hit,
         }
         check_compulsory_miss(memref.data.addr);
     }
+    if (region_stats_ != nullptr)
+        region_stats_->llc_access(memref, hit);
+    if (!set_samples_.empty()) {
+        set_sample_t &set =
+            set_samples_[(memref.data.addr >> set_sample_shift_) & set_sample_mask_];
+        set.accesses++;
+        if (!hit)
+            set.misses++;
+    }
+}
+
+// Histograms are written with their length, 0 when not allocated.
+static void
+save_histogram(stats_file_writer_t &out, const std::uint64_t *hist, std::size_t size)
+{
+    if (hist == nullptr)
+        size = 0;
+    out.write_varint(size);
+    for (std::size_t i = 0; i < size; i++)
+        out.write_varint(hist[i]);
+}
+
+static bool
+restore_histogram(stats_file_reader_t &in, std::uint64_t **hist, std::size_t *size)
+{
+    std::uint64_t length;
+    if (!in.read_varint(&length))
+        return false;
+    if (length == 0)
+        return true;
+    if (*hist == nullptr)
+        *size = caching_device_stats_t::init_histogram(hist, length);
+    else if (length != *size)
+        return false;
+    for (std::size_t i = 0; i < length; i++) {
+        if (!in.read_varint(&(*hist)[i]))
+            return false;
+    }
+    return true;
+}
+
+void
+caching_device_stats_t::save_state(stats_file_writer_t &out) const
+{
+    out.write_varint(stats_map_.size());
+    for (const auto &stat : stats_map_) {
+        out.write_varint((std::uint64_t)stat.first);
+        out.write_varint((std::uint64_t)stat.second);
+    }
+    access_count_.save(out);
+    out.write_varint(set_samples_.size());
+    for (const set_sample_t &set : set_samples_) {
+        out.write_varint(set.accesses);
+        out.write_varint(set.misses);
+    }
+    out.write_varint(resident_lines);
+    out.write_varint(bytes_used);
+    out.write_varint(bytes_requested);
+    save_histogram(out, histogram, histogram_size);
+    save_histogram(out, resident_histogram, histogram_size);
+}
+
+bool
+caching_device_stats_t::restore_state(stats_file_reader_t &in)
+{
+    std::uint64_t count, metric, value;
+    if (!in.read_varint(&count) || count != stats_map_.size())
+        return false;
+    for (std::uint64_t i = 0; i < count; i++) {
+        if (!in.read_varint(&metric) || !in.read_varint(&value))
+            return false;
+        auto it = stats_map_.find((metric_name_t)metric);
+        if (it == stats_map_.end())
+            return false;
+        it->second = (int_least64_t)value;
+    }
+    if (!access_count_.restore(in) || !in.read_varint(&count) ||
+        count != set_samples_.size())
+        return false;
+    for (set_sample_t &set : set_samples_) {
+        if (!in.read_varint(&value))
+            return false;
+        set.accesses = (int_least64_t)value;
+        if (!in.read_varint(&value))
+            return false;
+        set.misses = (int_least64_t)value;
+    }
+    std::size_t resident_size = histogram_size;
+    return in.read_varint(&resident_lines) && in.read_varint(&bytes_used) &&
+        in.read_varint(&bytes_requested) &&
+        restore_histogram(in, &histogram, &histogram_size) &&
+        restore_histogram(in, &resident_histogram, &resident_size);
+}
+
+void
+caching_device_stats_t::set_sample_sets(int set_shift, int num_sets, int total_sets)
+{
+    set_samples_.assign(num_sets, set_sample_t());
+    set_sample_shift_ = set_shift;
+    set_sample_mask_ = num_sets - 1;
+    total_sets_ = total_sets;
 }
 
 void
@@ -179,14 +333,9 @@ caching_device_stats_t::child_access(const memref_t &memref, bool hit,
 void
 caching_device_stats_t::check_compulsory_miss(addr_t addr)
 {
-    auto lookup_pair = access_count_.lookup(addr);
-
-    // If the address has never been accessed insert proper bound into access_count_
-    // and count it as a compulsory miss.
-    if (!lookup_pair.first) {
+    // A miss on a block never accessed before is compulsory.
+    if (!access_count_.test_and_set(addr))
         num_compulsory_misses_++;
-        access_count_.insert(addr, lookup_pair.second);
-    }
 }
 
 void
@@ -202,6 +351,64 @@ caching_device_stats_t::dump_miss(const memref_t &memref)
         pc = memref.data.pc;
     }
     addr = memref.data.addr;
+    miss_block_t &block = miss_blocks_[miss_block_head_];
+    if (miss_block_used_ == 0) {
+        // Only waits if the writer is a full ring of blocks behind.
+        while (block.full.load(std::memory_order_acquire)) {
+            stats_writer->wake();
+            std::this_thread::yield();
+        }
+    }
+    miss_record_t &record = block.records[miss_block_used_++];
+    record.pc = pc;
+    record.addr = addr;
+    record.type = memref.data.type;
+    record.tid = memref.data.tid;
+    record.timestamp =
+        num_hits_at_reset_ + num_misses_at_reset_ + num_hits_ + num_misses_;
+    if (miss_block_used_ == MISS_BLOCK_RECORDS)
+        publish_miss_block();
+}
+
+void
+caching_device_stats_t::publish_miss_block()
+{
+    if (miss_block_used_ == 0)
+        return;
+    miss_block_t &block = miss_blocks_[miss_block_head_];
+    block.count = miss_block_used_;
+    block.full.store(true, std::memory_order_release);
+    miss_block_head_ = (miss_block_head_ + 1) % MISS_BLOCK_SLOTS;
+    miss_block_used_ = 0;
+    stats_writer->wake();
+}
+
+bool
+caching_device_stats_t::drain_miss_blocks()
+{
+    bool wrote = false;
+    while (true) {
+        miss_block_t &block = miss_blocks_[miss_block_tail_];
+        if (!block.full.load(std::memory_order_acquire))
+            break;
+        for (std::size_t i = 0; i < block.count; i++)
+            write_miss(block.records[i]);
+        block.full.store(false, std::memory_order_release);
+        miss_block_tail_ = (miss_block_tail_ + 1) % MISS_BLOCK_SLOTS;
+        wrote = true;
+    }
+    return wrote;
+}
+
+void
+caching_device_stats_t::write_miss(const miss_record_t &record)
+{
+    if (miss_writer_ != nullptr) {
+        miss_writer_->write_miss_record(record);
+        return;
+    }
+    const addr_t pc = static_cast<addr_t>(record.pc);
+    const addr_t addr = static_cast<addr_t>(record.addr);
 #ifdef HAS_ZLIB
     gzprintf(file_, "0x%zx,0x%zx\n", pc, addr);
 #else
@@ -260,18 +467,58 @@ void
 caching_device_stats_t::print_child_stats(std::string prefix)
 {
     if (num_child_hits_ != 0) {
+        // Child hits are not sampled, so scale up the sampled hits and misses.
+        const double scale =
+            set_samples_.empty() ? 1. : (double)total_sets_ / set_samples_.size();
         cache_stats_stream << prefix << std::setw(18) << std::left
                   << "Child hits:" << std::setw(20) << std::right << num_child_hits_
                   << std::endl;
         cache_stats_stream << prefix << std::setw(18) << std::left
                   << "Total miss rate:" << std::setw(20) << std::fixed
                   << std::setprecision(2) << std::right
-                  << ((float)num_misses_ * 100 /
-                      (num_hits_ + num_child_hits_ + num_misses_))
+                  << ((float)(num_misses_ * scale) * 100 /
+                      ((num_hits_ + num_misses_) * scale + num_child_hits_))
                   << "%" << std::endl;
     }
 }
 
+// The miss rate of the sampled sets is a ratio estimator over a simple
+// random sample of sets, as sets are chosen by address bits that are
+// close to uniform.  Its standard error is
+//   sqrt((1 - n/N) * sum((m_i - r * a_i)^2) / (n - 1) / (n * abar^2))
+// for n of N sets with a_i accesses and m_i misses each, a mean of abar
+// accesses per set and an estimated miss rate r.
+void
+caching_device_stats_t::print_sampling(std::string prefix)
+{
+    if (set_samples_.empty())
+        return;
+    const double n = (double)set_samples_.size();
+    const int_least64_t accesses = num_hits_ + num_misses_;
+    cache_stats_stream << prefix << std::setw(18) << std::left << "Sampled sets:"
+                       << std::setw(20) << std::right << set_samples_.size() << " of "
+                       << total_sets_ << std::endl;
+    cache_stats_stream << prefix << std::setw(18) << std::left << "Est. misses:"
+                       << std::setw(20) << std::right
+                       << (int_least64_t)(num_misses_ * (total_sets_ / n)) << std::endl;
+    if (accesses == 0 || set_samples_.size() < 2)
+        return;
+    const double rate = (double)num_misses_ / accesses;
+    double sum_sq = 0.;
+    for (const set_sample_t &set : set_samples_) {
+        const double resid = set.misses - rate * set.accesses;
+        sum_sq += resid * resid;
+    }
+    const double mean_accesses = accesses / n;
+    const double variance = (1. - n / total_sets_) * sum_sq / (n - 1.) /
+        (n * mean_accesses * mean_accesses);
+    // A two-sided 95% interval.
+    cache_stats_stream << prefix << std::setw(18) << std::left << "Miss rate 95% CI:"
+                       << std::setw(19) << std::fixed << std::setprecision(2)
+                       << std::right << "+/-" << 196. * std::sqrt(variance) << "%"
+                       << std::endl;
+}
+
 void
 caching_device_stats_t::print_stats(std::string prefix)
 {
@@ -282,6 +529,7 @@ caching_device_stats_t::print_stats(std::string prefix)
     print_counts(prefix);
     print_rates(prefix);
     print_child_stats(prefix);
+    print_sampling(prefix);
     cache_stats_stream.imbue(std::locale("C")); // Reset to avoid affecting later prints.
 }
 
@@ -299,53 +547,70 @@ caching_device_stats_t::init_histogram( histogram_t **hist,
 }
 
 void
-caching_device_stats_t::inc_update( const boost::dynamic_bitset<> &dbs )
+caching_device_stats_t::flush_update( const std::uint64_t *words, 
+                                      const std::size_t num_bits )
 {
-    /**
-     * This should only be called if the cache line was allocated when 
-     * the record flag was switched on
-     */
-    (this)->bytes_used      += dbs.count();
+    // This should only be called if the cache line was allocated when the record flag was switched on
+    /** get the number of bytes used out of each line vs. total requested **/
     (this)->bytes_requested += histogram_size;
-    /** lets get the histogram initialized for the first time **/
     if( histogram == nullptr )
     {
-        (this)->histogram_size = init_histogram( &histogram, dbs.size() );
+        (this)->histogram_size = init_histogram( &histogram, num_bits );
     }
-    /** generate histogram of where bytes were used in the line **/
-    auto index( dbs.find_first() );
-    const auto loop_end( boost::dynamic_bitset<>::npos );
-    while( index != loop_end )
+    const auto num_words( ( num_bits + 63 ) / 64 );
+    for( std::size_t w( 0 ); w < num_words; w++ )
     {
-        histogram[ index ]++;
-        index = dbs.find_next( index );
+        auto word( words[ w ] );
+        (this)->bytes_used += __builtin_popcountll( word );
+        while( word != 0 )
+        {
+            histogram[ ( w << 6 ) + __builtin_ctzll( word ) ]++;
+            //clear lowest set bit
+            word &= word - 1;
+        }
     }
     return;
 }
 
 void
-caching_device_stats_t::flush_update( const boost::dynamic_bitset<> &dbs )
+caching_device_stats_t::utilization_line_evicted( const std::uint64_t *words, 
+                                                  const std::size_t num_bits )
+{
+    resident_lines--;
+    if( resident_histogram == nullptr || words == nullptr )
+    {
+        return;
+    }
+    const auto num_words( ( num_bits + 63 ) / 64 );
+    for( std::size_t w( 0 ); w < num_words; w++ )
+    {
+        auto word( words[ w ] );
+        while( word != 0 )
+        {
+            resident_histogram[ ( w << 6 ) + __builtin_ctzll( word ) ]--;
+            word &= word - 1;
+        }
+    }
+    return;
+}
+
+void
+caching_device_stats_t::snapshot_utilization()
 {
-    // This should only be called if the cache line was allocated when the record flag was switched on
-    /** get the number of bytes used out of each line vs. total requested **/
-    (this)->bytes_used      += dbs.count();
-    (this)->bytes_requested += histogram_size;
-    
-    /** lets get the histogram initialized for the first time **/
     if( histogram == nullptr )
     {
-        (this)->histogram_size = init_histogram( &histogram, dbs.size() );
+        return;
     }
-    /** we want to update histogram on every flush **/
-    auto index( dbs.find_first() );
-    const auto loop_end( boost::dynamic_bitset<>::npos );
-    while( index != loop_end )
+    /** 
+     * each resident line contributes its used bytes and a full line of 
+     * requested bytes, just as a sweep over every block would 
+     */
+    for( std::size_t index( 0 ); index < histogram_size; index++ )
     {
-        //increment count offset occupied
-        histogram[ index ]++;
-        //find next bit offset in bit vector
-        index = dbs.find_next( index );
+        histogram[ index ] += resident_histogram[ index ];
+        bytes_used         += resident_histogram[ index ];
     }
+    bytes_requested += resident_lines * histogram_size;
     return;
 }
 
@@ -361,34 +626,137 @@ caching_device_stats_t::reset()
     num_child_hits_ = 0;
     num_inclusive_invalidates_ = 0;
     num_coherence_invalidates_ = 0;
+    std::fill(set_samples_.begin(), set_samples_.end(), set_sample_t());
 }
 
 
 void
 caching_device_stats_t::write_histogram( const memref_t &mref, const size_t req_counter )
+{
+    /** the writer may only be here for the miss file **/
+    if( stats_writer == nullptr || histogram == nullptr )
+    {
+        return;
+    }
+    auto &snapshot( snapshots[ snapshot_head ] );
+    /** only waits if the writer is a full ring of snapshots behind **/
+    while( snapshot.full.load( std::memory_order_acquire ) )
+    {
+        stats_writer->wake();
+        std::this_thread::yield();
+    }
+    snapshot.req_counter     = req_counter;
+    snapshot.pc              = mref.data.pc;
+    snapshot.bytes_used      = bytes_used;
+    snapshot.bytes_requested = bytes_requested;
+    /** the writer zeroed the slot's histogram, so it becomes the new one **/
+    std::swap( histogram, snapshot.histogram );
+    snapshot.full.store( true, std::memory_order_release );
+    snapshot_head = ( snapshot_head + 1 ) % HISTOGRAM_SNAPSHOT_SLOTS;
+    bytes_requested = 0;
+    bytes_used      = 0;
+    stats_writer->wake();
+    return;
+}
+
+bool
+caching_device_stats_t::drain_histogram_snapshots()
+{
+    bool wrote( false );
+    while( true )
+    {
+        auto &snapshot( snapshots[ snapshot_tail ] );
+        if( ! snapshot.full.load( std::memory_order_acquire ) )
+        {
+            break;
+        }
+        write_snapshot( snapshot );
+        std::memset( snapshot.histogram, 0x0, sizeof( histogram_t ) * histogram_size );
+        snapshot.full.store( false, std::memory_order_release );
+        snapshot_tail = ( snapshot_tail + 1 ) % HISTOGRAM_SNAPSHOT_SLOTS;
+        wrote = true;
+    }
+    return( wrote );
+}
+
+void
+caching_device_stats_t::write_snapshot( const histogram_snapshot_t &snapshot )
 {
     const auto length( histogram_size );
-    if( histogram_stream.is_open() )
+    const histogram_t *hist( snapshot.histogram );
+    if( histogram_writer != nullptr )
     {
-        histogram_stream << "{{" << req_counter << ", " <<  mref.data.pc << "},";
+        histogram_writer->write_varint( snapshot.req_counter );
+        histogram_writer->write_varint( snapshot.pc );
+        for( std::remove_const< decltype( length ) >::type  index( 0 ); index < length; index++ )
+        {
+            histogram_writer->write_varint( hist[ index ] );
+        }
+        histogram_writer->write_varint( snapshot.bytes_used );
+        histogram_writer->write_varint( snapshot.bytes_requested );
+    }
+    else if( histogram_stream.is_open() )
+    {
+        histogram_stream << "{{" << snapshot.req_counter << ", " <<  snapshot.pc << "},";
         histogram_stream << "{";
         for( std::remove_const< decltype( length ) >::type  index( 0 ); index < length; index++ )
         {
-            histogram_stream << histogram[ index ];
+            histogram_stream << hist[ index ];
             if( index < length - 1 )
             {
                 histogram_stream << ", ";
             }
         }
-        histogram_stream << "}, " << ((double)bytes_used / (double)bytes_requested) << ", " <<  bytes_used << ", " <<  bytes_requested << "},\n";
+        histogram_stream << "}, " << ((double)snapshot.bytes_used / (double)snapshot.bytes_requested) 
+                         << ", " <<  snapshot.bytes_used << ", " <<  snapshot.bytes_requested << "},\n";
     }
-    const auto byte_size( sizeof( histogram_t ) * histogram_size );
-    bytes_requested = 0;
-    bytes_used      = 0;
-    std::memset( histogram, 0x0, byte_size );
     return;
 }
 
+void
+caching_device_stats_t::set_output_format( const stats_format_t format )
+{
+    if( format == STATS_FORMAT_TEXT )
+    {
+        return;
+    }
+    if( file_ != nullptr && miss_writer_ == nullptr )
+    {
+        /** reopen the miss file, nothing was written to it **/
+#ifdef HAS_ZLIB
+        gzclose( file_ );
+#else
+        fclose( file_ );
+#endif
+        file_ = nullptr;
+        miss_writer_ = new stats_file_writer_t( miss_file_, STATS_FILE_MISS_STREAM, 0,
+                                                format == STATS_FORMAT_BINARY_GZ );
+        if( ! miss_writer_->is_open() )
+        {
+            std::perror( "failed to open miss file" );
+            DR_ASSERT( false );
+        }
+    }
+    if( ! record_utilization_ || histogram_writer != nullptr )
+    {
+        return;
+    }
+    /** drop the text file the constructor opened, nothing was written to it **/
+    const auto text_path( stats_dir + "/" + cache_name + ".dat" );
+    histogram_stream.close();
+    std::remove( text_path.c_str() );
+    histogram_writer = new stats_file_writer_t( stats_dir + "/" + cache_name + 
+                                                    stats_format_extension( format ),
+                                                STATS_FILE_LINE_UTILIZATION,
+                                                (std::uint32_t)histogram_size,
+                                                format == STATS_FORMAT_BINARY_GZ );
+    if( ! histogram_writer->is_open() )
+    {
+        std::perror( "failed to open utilization stream" );
+        DR_ASSERT( false );
+    }
+}
+
 void
 caching_device_stats_t::invalidate(invalidation_type_t invalidation_type)
 {
@@ -37,14 +37,20 @@
 #define _CACHING_DEVICE_STATS_H_ 1
 
 #include "caching_device_block.h"
+#include "sparse_table.h"
+#include "stats_file.h"
+#include "stats_writer.h"
+#include <atomic>
 #include <string>
 #include <cstdint>
 #include <cstddef>
 #include <map>
+#include <vector>
 #include <fstream>
 #include <stdint.h>
-#include <boost/dynamic_bitset.hpp>
 #include <limits>
+#include <algorithm>
+#include <utility>
 #ifdef HAS_ZLIB
 #    include <zlib.h>
 #endif
@@ -53,6 +59,7 @@
 
 /** pre-declare **/
 class caching_device_t;
+class region_stats_t;
 
 enum invalidation_type_t {
     INVALIDATION_INCLUSIVE,
@@ -74,87 +81,106 @@ enum class metric_name_t {
     FLUSHES
 };
 
-struct bound {
-    addr_t beg;
-    addr_t end;
-};
-
+// Records which blocks have ever been accessed, for counting compulsory
+// misses: one bit per block, in 64-bit words keyed by block number / 64
+// (a 4K page for 64-byte blocks) so each test-and-set is one hash lookup
+// and a scattered footprint costs a word per touched page.
 class access_count_t {
 public:
     access_count_t(int block_size)
-        : block_size_(block_size)
     {
         if (!IS_POWER_OF_2(block_size)) {
             ERRMSG("Block size should be a power of 2.");
             return;
         }
-        int block_size_bits = compute_log2(block_size);
-        block_size_mask_ = ~((1 << block_size_bits) - 1);
+        block_size_bits_ = compute_log2(block_size);
     }
 
-    // Takes non-aligned address and inserts bound consisting of the nearest multiples
-    // of the block_size.
-    void
-    insert(addr_t addr_beg, std::map<addr_t, addr_t>::iterator next_it)
+    // Takes non-aligned address. Marks its block as accessed and returns
+    // whether it had been accessed before.
+    inline bool
+    test_and_set(addr_t addr)
     {
-        // Round the address down to the nearest multiple of the block_size.
-        addr_beg &= block_size_mask_;
-        addr_t addr_end = addr_beg + block_size_;
+        const std::uint64_t block = addr >> block_size_bits_;
+        std::uint64_t &word = blocks_[block >> 6];
+        const std::uint64_t bit = std::uint64_t(1) << (block & 63);
+        if ((word & bit) != 0)
+            return true;
+        word |= bit;
+        return false;
+    }
 
-        // Detect the overflow and assign maximum possible value to the addr_end.
-        if (addr_beg > addr_end) {
-            addr_end = std::numeric_limits<addr_t>::max();
+    // Writes the accessed blocks as gaps and lengths of maximal address ranges,
+    // for a checkpoint.
+    void
+    save(stats_file_writer_t &out) const
+    {
+        // Runs of consecutive blocks, as first and last block.
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> runs;
+        std::vector<std::uint64_t> keys = blocks_.get_keys();
+        std::sort(keys.begin(), keys.end());
+        for (const std::uint64_t key : keys) {
+            std::uint64_t word = *blocks_.find(key);
+            while (word != 0) {
+                const int first = __builtin_ctzll(word);
+                const std::uint64_t rest = ~(word >> first);
+                const int len = rest == 0 ? 64 - first : __builtin_ctzll(rest);
+                const std::uint64_t beg = (key << 6) + first;
+                if (!runs.empty() && runs.back().second + 1 == beg)
+                    runs.back().second = beg + len - 1;
+                else
+                    runs.emplace_back(beg, beg + len - 1);
+                word = first + len == 64 ? 0
+                                         : word & (~std::uint64_t(0) << (first + len));
+            }
         }
-
-        std::map<addr_t, addr_t>::reverse_iterator prev_it(next_it);
-
-        // Current bound -> (addr_beg...addr_end) connects previous and
-        // next bound
-        if (prev_it != bounds.rend() && prev_it->second == addr_beg &&
-            next_it != bounds.end() && next_it->first == addr_end) {
-            prev_it->second = next_it->second;
-            bounds.erase(next_it);
-            // Current bound extends previous bound
-        } else if (prev_it != bounds.rend() && prev_it->second == addr_beg) {
-            prev_it->second = addr_end;
-            // Current bound extends next bound
-        } else if (next_it != bounds.end() && next_it->first == addr_end) {
-            addr_t bound_end = next_it->second;
-            // We need to reinsert the element when changing key value.
-            // Iterator hint should provide costant complexity of this operation.
-            bounds.erase(next_it++);
-            bounds.emplace_hint(next_it, addr_beg, bound_end);
-        } else {
-            bounds.emplace_hint(next_it, addr_beg, addr_end);
+        const addr_t last_block = std::numeric_limits<addr_t>::max() >> block_size_bits_;
+        out.write_varint(runs.size());
+        addr_t prev_end = 0;
+        for (const auto &run : runs) {
+            const addr_t beg = run.first << block_size_bits_;
+            // The last block's range ends at the maximum address.
+            const addr_t end = run.second == last_block
+                ? std::numeric_limits<addr_t>::max()
+                : (run.second + 1) << block_size_bits_;
+            out.write_varint(beg - prev_end);
+            out.write_varint(end - beg);
+            prev_end = end;
         }
     }
 
-    // Takes non-aligned address. Returns:
-    // - boolean value indicating whether the address has ever been accessed
-    // - iterator to the bound where the address is located or the element which should
-    //   be provided as a hint when inserting new bound with given address.
-    std::pair<bool, std::map<addr_t, addr_t>::iterator>
-    lookup(addr_t addr)
+    // Replaces the accessed blocks with what save() wrote.
+    bool
+    restore(stats_file_reader_t &in)
     {
-        // Function upper_bound returns bound which beginning is larger
-        // then the addr.
-        auto next_it = bounds.upper_bound(addr);
-        std::map<addr_t, addr_t>::reverse_iterator prev_it(next_it);
-
-        if (prev_it != bounds.rend() && addr >= prev_it->first &&
-            addr < prev_it->second) {
-            return std::make_pair(true, prev_it.base());
-        } else {
-            return std::make_pair(false, next_it);
+        std::uint64_t count, gap, length;
+        if (!in.read_varint(&count))
+            return false;
+        blocks_.clear();
+        addr_t prev_end = 0;
+        for (std::uint64_t i = 0; i < count; i++) {
+            if (!in.read_varint(&gap) || !in.read_varint(&length))
+                return false;
+            const addr_t beg = prev_end + gap;
+            const addr_t end = beg + length;
+            prev_end = end;
+            if (length == 0)
+                continue;
+            const std::uint64_t last = end == std::numeric_limits<addr_t>::max()
+                ? end >> block_size_bits_
+                : (end - 1) >> block_size_bits_;
+            for (std::uint64_t block = beg >> block_size_bits_;; block++) {
+                blocks_[block >> 6] |= std::uint64_t(1) << (block & 63);
+                if (block == last)
+                    break;
+            }
         }
+        return true;
     }
 
 private:
-    // Bounds are members of the std::map. The beginning of the bound is stored
-    // as a key and the end as a value.
-    std::map<addr_t, addr_t> bounds;
-    int block_size_mask_ = 0;
-    int block_size_;
+    sparse_table_t<std::uint64_t> blocks_;
+    int block_size_bits_ = 0;
 };
 
 class caching_device_stats_t {
@@ -177,28 +203,122 @@ public:
     virtual void
     access(const memref_t &memref, bool hit, caching_device_block_t *cache_block);
 
-    // Called on each access by a child caching device.
+    // Called on each miss by a child caching device.  Child hits are
+    // credited in bulk through add_child_hits(): see
+    // caching_device_t::report_child_hits().
     virtual void
     child_access(const memref_t &memref, bool hit, caching_device_block_t *cache_block);
 
+    // Credits count child hits at once.
+    virtual void
+    add_child_hits(int_least64_t count)
+    {
+        num_child_hits_ += count;
+    }
+
     virtual void
     print_stats(std::string prefix);
+
+    // Also attributes each access to the traced process's mapping it touches.
+    // region_stats is owned by the caller.
+    void
+    set_region_stats(region_stats_t *region_stats)
+    {
+        region_stats_ = region_stats;
+    }
     
+    // Writes every counter in stats_map_, the addresses seen so far for
+    // compulsory misses, the sampled set counts and the utilization state,
+    // for a checkpoint.
+    virtual void
+    save_state(stats_file_writer_t &out) const;
+    // Reads what save_state() wrote.  Returns false on a mismatch or a
+    // truncated file.
+    virtual bool
+    restore_state(stats_file_reader_t &in);
+
+    // Called by a set-sampled device: counts accesses and misses per sampled
+    // set, which is found by shifting an address right by set_shift, so
+    // that print_stats() can bound the estimated miss rate.  num_sets of
+    // total_sets sets are sampled.
+    void
+    set_sample_sets(int set_shift, int num_sets, int total_sets);
+
     static std::size_t
     init_histogram( histogram_t **hist, const size_t size );
     
+    /** 
+     * adds an evicted line's used-byte bitmap to the histogram, 
+     * num_bits is the line size in bytes 
+     */
     virtual void 
-    inc_update( const boost::dynamic_bitset<> &dbs );
+    flush_update( const std::uint64_t *words, const std::size_t num_bits );
 
-    virtual void 
-    flush_update( const boost::dynamic_bitset<> &dbs );
+    /**
+     * Incremental utilization of the lines resident in the device.  The
+     * device reports each line as it becomes valid, each byte the first
+     * time it is used and each line as it is evicted, so that
+     * snapshot_utilization() costs O(line size) rather than O(cache size).
+     */
+    inline void
+    utilization_line_filled()
+    {
+        resident_lines++;
+    }
+
+    /** 
+     * sets bytes [begin, end) in a resident line's used-byte bitmap, a word 
+     * at a time, counting the bytes that were not already set 
+     */
+    inline void
+    record_bytes_used( std::uint64_t *used, const std::size_t begin, const std::size_t end )
+    {
+        for( std::size_t i( begin ); i < end; i = ( i | 63 ) + 1 )
+        {
+            const std::size_t num_bits( std::min( end, ( i | 63 ) + 1 ) - i );
+            const std::uint64_t bits( ( num_bits == 64 ? ~(std::uint64_t)0 
+                                        : ( ( (std::uint64_t)1 << num_bits ) - 1 ) ) 
+                                      << ( i & 63 ) );
+            std::uint64_t new_bits( bits & ~used[ i >> 6 ] );
+            used[ i >> 6 ] |= new_bits;
+            if( resident_histogram == nullptr )
+            {
+                continue;
+            }
+            while( new_bits != 0 )
+            {
+                resident_histogram[ ( i & ~(std::size_t)63 ) + __builtin_ctzll( new_bits ) ]++;
+                new_bits &= new_bits - 1;
+            }
+        }
+    }
+
+    /** words may be nullptr for a line that does not record its bytes **/
+    virtual void
+    utilization_line_evicted( const std::uint64_t *words, const std::size_t num_bits );
+
+    /** folds the resident lines into the histogram, replaces a full sweep **/
+    virtual void
+    snapshot_utilization();
 
     virtual void
     reset();
     
+    /** 
+     * hands the histogram accumulated since the last call to the stats 
+     * writer thread, which formats and writes it, and starts a new one
+     */
     virtual void 
     write_histogram( const memref_t &mref, const size_t req_counter );
 
+    /** 
+     * switches the utilization histogram dump and the miss file from text, 
+     * the default, to a binary format; call before any snapshot or miss is 
+     * written 
+     */
+    void
+    set_output_format( const stats_format_t format );
+
     std::string get_stats_dir();
     
     virtual bool operator!()
@@ -233,6 +353,8 @@ protected:
     print_rates(std::string prefix); // hit/miss rates
     virtual void
     print_child_stats(std::string prefix); // child/total info
+    virtual void
+    print_sampling(std::string prefix); // sampled sets and miss rate bounds
 
     virtual void
     dump_miss(const memref_t &memref);
@@ -266,7 +388,49 @@ protected:
     // We provide a feature of dumping misses to a file.
     bool dump_misses_;
 
+    // Misses go to the stats writer thread a block at a time, so that the
+    // simulation thread only stores a record per miss.  A block is full from
+    // when the simulation thread publishes it until the writer has written it.
+    struct miss_block_t {
+        std::atomic<bool> full { false };
+        std::size_t count = 0;
+        std::vector<miss_record_t> records;
+    };
+    static constexpr std::size_t MISS_BLOCK_SLOTS = 4;
+    static constexpr std::size_t MISS_BLOCK_RECORDS = 4096;
+
+    // Hands the block being filled, even a partial one, to the writer.
+    void
+    publish_miss_block();
+    // Runs on the stats writer thread, returns true if it wrote anything.
+    bool
+    drain_miss_blocks();
+    void
+    write_miss(const miss_record_t &record);
+
+    miss_block_t miss_blocks_[MISS_BLOCK_SLOTS];
+    // Next block filled by the simulation thread and how much of it is.
+    std::size_t miss_block_head_ = 0;
+    std::size_t miss_block_used_ = 0;
+    // Next block written by the stats writer thread.
+    std::size_t miss_block_tail_ = 0;
+    std::string miss_file_;
+    // Used instead of file_ for the binary formats.
+    stats_file_writer_t *miss_writer_ = nullptr;
+
     access_count_t access_count_;
+
+    region_stats_t *region_stats_ = nullptr;
+
+    // Accesses and misses of each sampled set when the device samples sets.
+    struct set_sample_t {
+        int_least64_t accesses = 0;
+        int_least64_t misses   = 0;
+    };
+    std::vector<set_sample_t> set_samples_;
+    int set_sample_shift_ = 0;
+    addr_t set_sample_mask_ = 0;
+    int total_sets_ = 0;
     
     /**
      ** THINGS ADDED BY JCB
@@ -274,12 +438,46 @@ protected:
     //how many bytes per line were used
     histogram_t                     *histogram         = nullptr;
     std::size_t                      histogram_size     = 0;
+    /** per-byte use counts over the currently resident lines **/
+    histogram_t                     *resident_histogram = nullptr;
+    std::uint64_t                    resident_lines     = 0;
     std::uint64_t                    bytes_used         = 0;
     std::uint64_t                    bytes_requested    = 0;
     /** caching device ptr, may or may not be set dep. on impl, check before use **/
     caching_device_t            *device_ptr        = nullptr;
     
+    /** 
+     * a histogram snapshot in flight to the stats writer thread, full is 
+     * set by the simulation thread once the slot is filled and cleared by 
+     * the writer once it has been written and its histogram zeroed 
+     **/
+    struct histogram_snapshot_t
+    {
+        std::atomic< bool >     full            = { false };
+        std::size_t             req_counter     = 0;
+        addr_t                  pc              = 0;
+        std::uint64_t           bytes_used      = 0;
+        std::uint64_t           bytes_requested = 0;
+        histogram_t            *histogram       = nullptr;
+    };
+    static constexpr std::size_t HISTOGRAM_SNAPSHOT_SLOTS = 2;
+
+    /** runs on the stats writer thread, returns true if it wrote anything **/
+    bool drain_histogram_snapshots();
+
+    void write_snapshot( const histogram_snapshot_t &snapshot );
+
+    histogram_snapshot_t        snapshots[ HISTOGRAM_SNAPSHOT_SLOTS ];
+    /** next slot filled by the simulation thread **/
+    std::size_t                 snapshot_head     = 0;
+    /** next slot written by the stats writer thread **/
+    std::size_t                 snapshot_tail     = 0;
+    stats_writer_t             *stats_writer      = nullptr;
+
+    /** only touched by the stats writer thread once snapshots are flowing **/
     std::ofstream               histogram_stream;     
+    /** used instead of histogram_stream for the binary formats **/
+    stats_file_writer_t        *histogram_writer  = nullptr;
     std::string                 cache_name  = "";
     std::string                 stats_dir   = "";    
     bool                        record_utilization_;
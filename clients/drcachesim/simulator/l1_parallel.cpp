@@ -0,0 +1,214 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "l1_parallel.h"
+#include <functional>
+#include <queue>
+#include <utility>
+
+l1_parallel_t::l1_parallel_t(unsigned int num_jobs, unsigned int num_cores,
+                             cache_t **l1_icaches, cache_t **l1_dcaches,
+                             atomic_bool_t *record)
+    : num_jobs_(num_jobs)
+    , num_cores_(num_cores)
+    , l1_icaches_(l1_icaches)
+    , l1_dcaches_(l1_dcaches)
+    , record_(record)
+    , cores_(num_cores)
+{
+    if (num_jobs_ > num_cores_)
+        num_jobs_ = num_cores_;
+    for (unsigned int job = 0; job < num_jobs_; job++)
+        workers_.emplace_back(&l1_parallel_t::worker_loop, this, job);
+}
+
+l1_parallel_t::~l1_parallel_t()
+{
+    drain();
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        exiting_ = true;
+    }
+    start_cv_.notify_all();
+    for (std::thread &worker : workers_)
+        worker.join();
+    for (unsigned int core = 0; core < num_cores_; core++) {
+        l1_icaches_[core]->set_parent_queue(nullptr);
+        l1_dcaches_[core]->set_parent_queue(nullptr);
+    }
+}
+
+void
+l1_parallel_t::enqueue(unsigned int core, op_t op, const memref_t &memref, bool record)
+{
+    cores_[core].input[filling_].push_back({ memref, next_seq_++, op, record });
+    if (++pending_ >= BATCH_REFS)
+        cycle();
+}
+
+void
+l1_parallel_t::drain()
+{
+    // The first cycle starts whatever is queued and replays the batch before
+    // it, the second waits for it and replays it.
+    cycle();
+    cycle();
+}
+
+void
+l1_parallel_t::cycle()
+{
+    int finished = -1;
+    if (running_ >= 0) {
+        wait_batch();
+        finished = running_;
+        running_ = -1;
+    }
+    if (pending_ > 0) {
+        start_batch(filling_);
+        running_ = filling_;
+        filling_ ^= 1;
+        pending_ = 0;
+    }
+    // Overlaps with the workers simulating the batch just started.
+    if (finished >= 0)
+        replay(finished);
+}
+
+void
+l1_parallel_t::start_batch(int buf)
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        batch_buf_ = buf;
+        remaining_ = num_jobs_;
+        generation_++;
+    }
+    start_cv_.notify_all();
+}
+
+void
+l1_parallel_t::wait_batch()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return remaining_ == 0; });
+}
+
+void
+l1_parallel_t::worker_loop(unsigned int job)
+{
+    uint64_t seen = 0;
+    while (true) {
+        int buf;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_cv_.wait(lock, [this, seen] { return generation_ != seen || exiting_; });
+            if (exiting_)
+                return;
+            seen = generation_;
+            buf = batch_buf_;
+        }
+        simulate(job, buf);
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (--remaining_ == 0)
+            done_cv_.notify_one();
+    }
+}
+
+void
+l1_parallel_t::simulate(unsigned int job, int buf)
+{
+    for (unsigned int core = job; core < num_cores_; core += num_jobs_) {
+        std::vector<input_t> &input = cores_[core].input[buf];
+        parent_queue_t *queue = &cores_[core].queue[buf];
+        cache_t *icache = l1_icaches_[core];
+        cache_t *dcache = l1_dcaches_[core];
+        icache->set_parent_queue(queue);
+        dcache->set_parent_queue(queue);
+        for (const input_t &in : input) {
+            queue->seq = in.seq;
+            queue->record = in.record;
+            switch (in.op) {
+            case L1_INSTR: icache->request(in.memref); break;
+            case L1_DATA: dcache->request(in.memref); break;
+            case L1_IFLUSH: icache->flush(in.memref); break;
+            case L1_DFLUSH: dcache->flush(in.memref); break;
+            }
+        }
+        input.clear();
+    }
+}
+
+void
+l1_parallel_t::replay(int buf)
+{
+    // A k-way merge of the per-core queues, each already in seq order.
+    using head_t = std::pair<uint64_t, unsigned int>;
+    std::priority_queue<head_t, std::vector<head_t>, std::greater<head_t>> heads;
+    std::vector<size_t> next(num_cores_, 0);
+    for (unsigned int core = 0; core < num_cores_; core++) {
+        const parent_queue_t &queue = cores_[core].queue[buf];
+        if (!queue.entries.empty())
+            heads.emplace(queue.entries[0].seq, core);
+    }
+    const bool saved_record = *record_;
+    while (!heads.empty()) {
+        const unsigned int core = heads.top().second;
+        heads.pop();
+        const std::vector<parent_queue_t::entry_t> &entries =
+            cores_[core].queue[buf].entries;
+        caching_device_t *parent = l1_dcaches_[core]->get_parent();
+        // Entries for one memref stay together, in the order they were made.
+        const uint64_t seq = entries[next[core]].seq;
+        for (; next[core] < entries.size() && entries[next[core]].seq == seq;
+             next[core]++) {
+            const parent_queue_t::entry_t &entry = entries[next[core]];
+            *record_ = entry.record;
+            if (entry.op == parent_queue_t::PARENT_REQUEST) {
+                parent->get_stats()->child_access(entry.memref, false, nullptr);
+                parent->request(entry.memref);
+            } else
+                static_cast<cache_t *>(parent)->flush(entry.memref);
+        }
+        if (next[core] < entries.size())
+            heads.emplace(entries[next[core]].seq, core);
+    }
+    *record_ = saved_record;
+    for (unsigned int core = 0; core < num_cores_; core++) {
+        parent_queue_t &queue = cores_[core].queue[buf];
+        for (caching_device_t *up = l1_dcaches_[core]->get_parent(); up != nullptr;
+             up = up->get_parent())
+            up->get_stats()->add_child_hits(queue.child_hits);
+        queue.child_hits = 0;
+        queue.entries.clear();
+    }
+}
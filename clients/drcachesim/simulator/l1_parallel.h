@@ -0,0 +1,142 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* l1_parallel: simulates the private L1 caches of each core on worker
+ * threads, replaying the traffic they send to their shared parent on the
+ * analysis thread.
+ *
+ * Memrefs are queued per core and handed to the workers in batches.  A
+ * worker runs its cores' L1 caches with their parent accesses redirected
+ * into a per-core parent_queue_t, stamped with each memref's position in
+ * the input.  While the workers simulate one batch the analysis thread
+ * merges the previous batch's queues by that position and replays them on
+ * the parent, so the parent sees exactly the sequence of accesses a
+ * serial simulation would give it.  This requires that nothing flows from
+ * the parent back into the L1 caches, i.e., no coherence and a
+ * non-inclusive parent, in which case the results are identical to the
+ * serial simulation.
+ */
+
+#ifndef _L1_PARALLEL_H_
+#define _L1_PARALLEL_H_ 1
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "cache.h"
+#include "caching_device.h"
+#include "defs.h"
+#include "memref.h"
+
+class l1_parallel_t {
+public:
+    enum op_t : uint8_t {
+        L1_INSTR,  // l1_icaches[core]->request()
+        L1_DATA,   // l1_dcaches[core]->request()
+        L1_IFLUSH, // l1_icaches[core]->flush()
+        L1_DFLUSH, // l1_dcaches[core]->flush()
+    };
+
+    // Simulates the L1 caches of num_cores cores on num_jobs threads.  The
+    // instruction and data caches of a core must share their parent.
+    // record is the simulator's recording state, which is set to the
+    // value captured by enqueue() while each parent access is replayed.
+    l1_parallel_t(unsigned int num_jobs, unsigned int num_cores, cache_t **l1_icaches,
+                  cache_t **l1_dcaches, atomic_bool_t *record);
+    ~l1_parallel_t();
+
+    // Queues memref for core's L1 caches.  Simulates the queued batch once
+    // it is full.
+    void
+    enqueue(unsigned int core, op_t op, const memref_t &memref, bool record);
+
+    // Simulates everything queued so far, including the parent accesses, so
+    // that all statistics are up to date.
+    void
+    drain();
+
+private:
+    struct input_t {
+        memref_t memref;
+        uint64_t seq;
+        op_t op;
+        bool record;
+    };
+    // Each core alternates between two buffers: one being filled by the
+    // analysis thread or replayed, the other being simulated by a worker.
+    struct core_t {
+        std::vector<input_t> input[2];
+        parent_queue_t queue[2];
+    };
+
+    // Memrefs per batch across all cores.
+    static const uint64_t BATCH_REFS = 32 * 1024;
+
+    void
+    cycle();
+    void
+    start_batch(int buf);
+    void
+    wait_batch();
+    void
+    replay(int buf);
+    void
+    simulate(unsigned int job, int buf);
+    void
+    worker_loop(unsigned int job);
+
+    unsigned int num_jobs_;
+    unsigned int num_cores_;
+    cache_t **l1_icaches_;
+    cache_t **l1_dcaches_;
+    atomic_bool_t *record_;
+    std::vector<core_t> cores_;
+
+    uint64_t next_seq_ = 0;
+    uint64_t pending_ = 0;
+    // The buffer being filled, and the one the workers are simulating or -1.
+    int filling_ = 0;
+    int running_ = -1;
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    uint64_t generation_ = 0;
+    int batch_buf_ = 0;
+    unsigned int remaining_ = 0;
+    bool exiting_ = false;
+};
+
+#endif /* _L1_PARALLEL_H_ */
@@ -19,11 +19,15 @@
  */
 #include "memorymap.hpp"
 #include "proc_tools.hpp"
-#include "vm_smap_entry.hpp"
+#include "vm_maps_snapshot.h"
 #include <sys/types.h>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
 #include <string>
+#include <vector>
 #include <fstream>
+#include <iterator>
 
     
 /**
@@ -32,70 +36,68 @@
 std::uintptr_t 
 vm_memory_map::add_os_vm_offset_to_pc( const std::uintptr_t pc )
 {
-#if ! NDEBUG
-    if( segments.code != nullptr )
+    if( ! loaded )
     {
-#endif    
-        return( segments.code->start + pc );
-#if ! NDEBUG
+        load();
     }
-    return( pc );
-#endif    
+    /** no snapshot for this process, leave the pc alone **/
+    if( segments.code == nullptr )
+    {
+        return( pc );
+    }
+    return( segments.code->start + pc );
 }
 
 bool    
 vm_memory_map::is_address_in_code( const std::uintptr_t address )
 {
-#if ! NDEBUG
-    if( segments.code != nullptr )
+    if( ! loaded )
+    {
+        load();
+    }
+    if( segments.code == nullptr )
     {
-#endif    
-        return( ( address - segments.code->start ) < segments.code->addy_range );
-#if ! NDEBUG        
+        return( false );
     }
-    return( false );
-#endif
+    return( ( address - segments.code->start ) < segments.code->addy_range );
 }
 
 bool    
 vm_memory_map::is_address_in_heap( const std::uintptr_t address )
 {
-#if ! NDEBUG
-    if( segments.heap != nullptr )
+    if( ! loaded )
+    {
+        load();
+    }
+    if( segments.heap == nullptr )
     {
-#endif    
-        return( ( address - segments.heap->start ) < segments.heap->addy_range );
-#if ! NDEBUG        
+        return( false );
     }
-    return( false );
-#endif
+    return( ( address - segments.heap->start ) < segments.heap->addy_range );
 }
 
 bool    
 vm_memory_map::is_address_in_stack( const std::uintptr_t address )
 {
-#if ! NDEBUG
-    if( segments.stack != nullptr )
+    if( ! loaded )
     {
-#endif     
-        return( ( address - segments.stack->start ) < segments.stack->addy_range );
-#if ! NDEBUG        
+        load();
     }
-    return( false );
-#endif
+    if( segments.stack == nullptr )
+    {
+        return( false );
+    }
+    return( ( address - segments.stack->start ) < segments.stack->addy_range );
 }
 
-vm_memory_map::vm_memory_map( const pid_t pid ) : pid( pid ),
+vm_memory_map::vm_memory_map( const pid_t pid, 
+                              const std::string &snapshot_path,
+                              const unsigned int verbose ) : pid( pid ),
     pid_map_string( "/proc/" + std::to_string( pid ) + "/maps" ), 
-    pid_smap_string( "/proc/" + std::to_string( pid ) + "/smaps" ) 
+    snapshot_path( snapshot_path ),
+    verbose( verbose )
 {
-    if( ! proc_tools::get_bin_path_for_pid( pid, bin_path ) )
-    {
-        std::fprintf( stderr, 
-                      "Failed to discover binary path, can't proceed, exiting\n" );
-        exit( EXIT_FAILURE );
-    }
-    initialize_os_map();
+    /** nothing to do until the first query, see load() **/
 }
 
 vm_memory_map::~vm_memory_map()
@@ -106,26 +108,105 @@ vm_memory_map::~vm_memory_map()
     }
 }
 
+std::size_t
+vm_memory_map::region_count()
+{
+    if( ! loaded )
+    {
+        load();
+    }
+    return( region_index.size() );
+}
+
+void
+vm_memory_map::load()
+{
+    loaded = true;
+    if( ! snapshot_path.empty() )
+    {
+        load_snapshot();
+    }
+    else
+    {
+        /** 
+         * online, the process is still around. If we can't 
+         * find the binary we can't find its code segment, 
+         * but the rest of the map is still worth having.
+         * Offline without a snapshot the process is usually
+         * gone, so that's only worth a warning when asked.
+         */
+        if( ! proc_tools::get_bin_path_for_pid( pid, bin_path ) && verbose >= 1 )
+        {
+            std::fprintf( stderr, 
+                          "WARNING: no memory map snapshot and no /proc entry for pid %d: %s\n",
+                          static_cast< int >( pid ),
+                          std::strerror( errno ) );
+        }
+        initialize_os_map();
+    }
+    region_index.build( vm_maps_db );
+}
+
+void
+vm_memory_map::load_snapshot()
+{
+    std::ifstream snapshot_ifs( snapshot_path, std::ios::binary );
+    if( ! snapshot_ifs.is_open() )
+    {
+        return;
+    }
+    const std::string data( ( std::istreambuf_iterator< char >( snapshot_ifs ) ),
+                              std::istreambuf_iterator< char >() );
+    std::uint64_t                   snapshot_pid = 0;
+    std::vector< vm_maps_region_t > regions;
+    if( ! vm_maps_snapshot_decode( data.data(), 
+                                   data.size(), 
+                                   &snapshot_pid, 
+                                   &bin_path, 
+                                   &regions ) ||
+        snapshot_pid != static_cast< std::uint64_t >( pid ) )
+    {
+        bin_path.clear();
+        return;
+    }
+    for( const auto &region : regions )
+    {
+        auto *m = new vm_maps_entry_t();
+        m->start     = region.start;
+        m->end       = region.end;
+        m->perms     = region.perms;
+        m->offset    = region.offset;
+        m->maj_dev   = region.dev_major;
+        m->min_dev   = region.dev_minor;
+        m->inode     = region.inode;
+        std::strncpy( m->pathname, region.pathname.c_str(), PATH_MAX - 1 );
+        m->addy_range = ( m->end - m->start ) + 1;
+        add_entry( m->start, m );
+    }
+    return;
+}
+
 void
 vm_memory_map::initialize_os_map( )
 {
-    std::ifstream maps_ifs( pid_smap_string );
+    /** 
+     * maps rather than smaps, the per-mapping page 
+     * statistics in smaps are costly for the kernel
+     * to produce and nothing here uses them.
+     */
+    std::ifstream maps_ifs( pid_map_string );
     if( ! maps_ifs.is_open() )
     {
         return;
     }
     //else it's open
     std::string line;
-    vm_maps_entry_t *m( nullptr );
     while( std::getline( maps_ifs, line ) )
     {
-        m = new vm_smap_entry_t();
+        auto *m = new vm_maps_entry_t();
         m->add_fields_to_entry( maps_ifs, line ); 
-        /** for smaps will consume multiple lines **/
         add_entry( m->start, m );
-        std::cout << (*m) << "\n";
     }
-    m = nullptr;
     maps_ifs.close();
     return;
 }
@@ -140,8 +221,10 @@ vm_memory_map::add_entry( const vm_maps_entry_t::address_t start_address,
     if( found.second == false )
     {
         delete( entry );
+        return;
     }
-    if( ( entry->perms & vm_maps_entry_t::execute ) == vm_maps_entry_t::execute )
+    if( ( entry->perms & vm_maps_entry_t::execute ) == vm_maps_entry_t::execute &&
+        ! bin_path.empty() )
     {
         //double check to make sure it's ours
         if( strncmp( bin_path.c_str(), entry->pathname, bin_path.length() ) == 0 )
@@ -181,16 +264,22 @@ std::ostream&
 operator << ( std::ostream &stream, const vm_memory_map &map )
 {
     stream << "Important segments\n";
-    stream << "Code: \n";
-    stream << *reinterpret_cast< vm_smap_entry_t*>( map.segments.code ) << "\n"; 
-    stream << "Stack: \n";
-    stream << *reinterpret_cast< vm_smap_entry_t*>( map.segments.stack ) << "\n"; 
-    stream << "Heap: \n";
-    stream << *reinterpret_cast< vm_smap_entry_t*>( map.segments.heap ) << "\n"; 
+    if( map.segments.code != nullptr )
+    {
+        stream << "Code: \n" << *map.segments.code << "\n"; 
+    }
+    if( map.segments.stack != nullptr )
+    {
+        stream << "Stack: \n" << *map.segments.stack << "\n"; 
+    }
+    if( map.segments.heap != nullptr )
+    {
+        stream << "Heap: \n" << *map.segments.heap << "\n"; 
+    }
     stream << "\n\n\n";
     for( const auto &pair : map.vm_maps_db )
     {
-        stream << *reinterpret_cast< vm_smap_entry_t*>( pair.second ) << "\n";
+        stream << *pair.second << "\n";
     }
     return( stream );
 }
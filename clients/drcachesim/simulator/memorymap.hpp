@@ -30,11 +30,25 @@
 #include "pagemap.hpp"
 #include "vm_map_db.hpp"
 #include "vm_map_entry.hpp"
+#include "vm_region_index.hpp"
 
 class vm_memory_map 
 {
 public:
-    vm_memory_map( const pid_t pid );
+    /**
+     * vm_memory_map - nothing is read until the map is first
+     * queried. If snapshot_path is non-empty the map is loaded
+     * from the tracer's snapshot at that path (see 
+     * vm_maps_snapshot.h), and stays empty if there is none. 
+     * If it is empty the process is assumed to still be running
+     * and /proc/<pid>/maps is read instead.
+     * @param - pid - process whose map this is
+     * @param - snapshot_path - path of the vm_maps.bin snapshot
+     * @param - verbose - warns about a missing map at 1 or more
+     */
+    vm_memory_map( const pid_t pid, 
+                   const std::string &snapshot_path,
+                   const unsigned int verbose = 0 );
     
     virtual ~vm_memory_map();
     
@@ -62,8 +76,44 @@ public:
 
     bool    is_address_in_stack( const std::uintptr_t address );
 
+    /**
+     * find_region - index of the mapping (any mmap, library, anon
+     * region or thread stack) holding address, or 
+     * vm_region_index::npos. Indices run from 0 to region_count() 
+     * in address order and are stable once the map is loaded.
+     */
+    inline std::size_t find_region( const std::uintptr_t address )
+    {
+        if( ! loaded )
+        {
+            load();
+        }
+        return( region_index.find( address ) );
+    }
+
+    std::size_t region_count();
+
+    /** mapping for an index returned by find_region() **/
+    const vm_maps_entry_t& region( const std::size_t index ) const
+    {
+        return( *region_index[ index ].entry );
+    }
+
 protected:
     
+    /**
+     * load - fill the map on first use, from the snapshot if 
+     * we have one, else from /proc/<id>/maps.
+     */
+    void load();
+
+    /**
+     * load_snapshot - fill the map from the snapshot at 
+     * snapshot_path, leaving it empty if the snapshot is 
+     * missing or belongs to another process.
+     */
+    void load_snapshot();
+
     /**
      * initialize_map - initialize a vm_memory_map object
      * and return it with the information from /proc/<id>/maps
@@ -117,6 +167,8 @@ protected:
 
 private:
     vm_maps_db_t    vm_maps_db;
+    /** flat copy of vm_maps_db for find_region(), built by load() **/
+    vm_region_index region_index;
     
     
     std::uint8_t      page_granule_pow_2;
@@ -124,10 +176,14 @@ private:
     const             pid_t pid;
 
     const std::string pid_map_string;
-    const std::string pid_smap_string;
+    const std::string snapshot_path;
+    const unsigned int verbose;
     
     std::string       bin_path;
 
+    /** set once load() has run, whether or not it found anything **/
+    bool              loaded = false;
+
     friend std::ostream& operator << ( std::ostream&, const vm_memory_map&);
 
 };
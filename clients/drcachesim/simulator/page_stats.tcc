@@ -24,14 +24,13 @@
 #include <string>
 #include <ostream>
 #include <limits>
-#include <map>
-#include <functional>
 
 #include "trace_entry.h"
 
 template< int GRANULE_OFFSETS, std::uint8_t BIT /** page size pow 2 **/ > struct page_stats
 {
-    void update( const addr_t address, const trace_type_t type )
+    /** seq orders first accesses across pages, see first_access **/
+    void update( const addr_t address, const trace_type_t type, const std::uint64_t seq )
     {
         counter++;
         constexpr std::uint64_t mask = ~(std::numeric_limits< std::uint64_t >::max() << BIT);
@@ -54,6 +53,7 @@ template< int GRANULE_OFFSETS, std::uint8_t BIT /** page size pow 2 **/ > struct
         //NOTE, WE'RE IGNORING SEV TYPES
         if( insn_page == 0 )
         {
+            first_access = seq;
             if( type == TRACE_TYPE_INSTR )
             {
                 insn_page = 1;
@@ -67,6 +67,11 @@ template< int GRANULE_OFFSETS, std::uint8_t BIT /** page size pow 2 **/ > struct
     
 
     std::uint64_t               counter = 0;
+    /** 
+     * sequence number of the first access, lets a larger page made of 
+     * several of these work out which of them was touched first 
+     */
+    std::uint64_t               first_access = 0;
     std::uint8_t                insn_page = 0;
     std::bitset< GRANULE_OFFSETS > read_access;
     std::bitset< GRANULE_OFFSETS > write_access;
@@ -104,38 +109,4 @@ inline std::string return_type_helper( const std::uint8_t insn_page )
     return( pg_type );
 }
     
-inline std::ostream& operator << ( std::ostream &stream, page_stats< 64, 12 > &ps)
-{
-    const auto pg_type( return_type_helper( ps.insn_page ) );
-    stream << ps.counter << ", " << pg_type << ", " << 
-        ps.read_access.to_string() << ", " << ps.write_access.to_string();
-    return( stream );
-}
-
-inline std::ostream& operator << ( std::ostream &stream, page_stats< 1024, 16 > &ps)
-{
-    const auto pg_type( return_type_helper( ps.insn_page ) );
-    stream << ps.counter << ", " << pg_type << ", " << 
-        ps.read_access.to_string() << ", " << ps.write_access.to_string();
-    return( stream );
-}
-
-inline std::ostream& operator << ( std::ostream &stream, page_stats< 16384, 20 > &ps)
-{
-    const auto pg_type( return_type_helper( ps.insn_page ) );
-    stream << ps.counter << ", " << pg_type << ", " << 
-        ps.read_access.to_string() << ", " << ps.write_access.to_string();
-    return( stream );
-}
-
-
-template < int GRANULES,    
-           int PAGE_SIZE_POW_2 > 
-using gran_stats_t = 
-                std::map< std::uint64_t, 
-                          page_stats< GRANULES, 
-                                      PAGE_SIZE_POW_2 >, 
-                                      std::greater< std::uint64_t > >;
-
-
 #endif /* END PAGE_STATS_TCC */
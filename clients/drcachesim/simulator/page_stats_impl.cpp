@@ -19,15 +19,43 @@
  */
 #include "page_stats_impl.hpp"
 #include "trace_entry.h"
+#include <algorithm>
+#include <cctype>
+#include <utility>
+#include <functional>
 #include <iostream>
 
+page_region_table::~page_region_table()
+{
+    regions.for_each( []( const std::uint64_t, page_region *region )
+    {
+        delete( region );
+    } );
+}
+
+std::vector< std::uint64_t >
+page_region_table::sorted_keys() const
+{
+    auto out( regions.get_keys() );
+    std::sort( out.begin(), out.end(), std::greater< std::uint64_t >() );
+    return( out );
+}
+
+const page_region&
+page_region_table::at( const std::uint64_t region_num ) const
+{
+    return( **regions.find( region_num ) );
+}
+
 void    
 page_stats_impl::init( )
 {
     //allocate tracking structures
-    _4K_stats       = new gran_stats_t< 64    ,12 >();
-    _64K_stats      = new gran_stats_t< 1024  ,16 >();
-    _1M_stats       = new gran_stats_t< 16384 ,20 >();
+    _regions        = new page_region_table();
+    if( stats_writer == nullptr )
+    {
+        stats_writer = stats_writer_t::acquire();
+    }
 }
 
 void
@@ -35,83 +63,350 @@ page_stats_impl::update( const memref_t &memref )
 {
     const auto address = memref.data.addr;
     const auto type    = memref.data.type;
-    //get rid of lower bits, index only on bits > log2(page size)
-    const std::uint64_t index12    = (address >> 12);
-    const std::uint64_t index16    = (address >> 16);
-    const std::uint64_t index20    = (address >> 20);
     /** 
      * for now, no access bigger than cache line size, 
      * so ignore for now. 
      */
-    (*_4K_stats)    [ index12 ].update( address, type );
-    (*_64K_stats)   [ index16 ].update( address, type );
-    (*_1M_stats)    [ index20 ].update( address, type );
+    page_region &region( (*_regions)[ address >> 20 ] );
+    region._4K[ ( address >> BASE_PAGE_BITS ) & 0xff ].update( address, 
+                                                               type, 
+                                                               update_count++ );
 }
 
 void
-page_stats_impl::write( std::ofstream &ostream_4, std::ofstream &ostream_64, std::ofstream &ostream_1M )
+page_stats_impl::set_page_stats_sizes( const std::vector< int > &page_bits )
 {
-            
-    if( ostream_4.is_open() )
+    page_stats_bits = page_bits;
+}
+
+bool
+page_stats_impl::parse_page_stats_sizes( const std::string &spec, 
+                                         std::vector< int > &page_bits )
+{
+    page_bits.clear();
+    std::size_t pos( 0 );
+    while( pos <= spec.size() )
     {
-        auto it = _4K_stats->begin();
-        auto end = _4K_stats->end();
-        for( ; it != end; ++it )
+        auto comma( spec.find( ',', pos ) );
+        if( comma == std::string::npos )
+        {
+            comma = spec.size();
+        }
+        const auto item( spec.substr( pos, comma - pos ) );
+        pos = comma + 1;
+        std::size_t digits( 0 );
+        while( digits < item.size() && std::isdigit( (unsigned char)item[ digits ] ) )
+        {
+            digits++;
+        }
+        if( digits == 0 || digits > 6 )
+        {
+            return( false );
+        }
+        std::uint64_t size( std::stoull( item.substr( 0, digits ) ) );
+        const auto suffix( item.substr( digits ) );
+        if( suffix == "K" || suffix == "KiB" )
         {
-            const auto actual_addy = 
-                (std::uintptr_t)( (*it).first ) << 12;
-            ostream_4 << "0x" << std::hex << actual_addy << std::dec << ", " << (*it).second << "\n";
+            size <<= 10;
         }
-        ostream_4.flush();
-        ostream_4.close();
+        else if( suffix == "M" || suffix == "MiB" )
+        {
+            size <<= 20;
+        }
+        else if( suffix == "G" || suffix == "GiB" )
+        {
+            size <<= 30;
+        }
+        else if( ! suffix.empty() )
+        {
+            return( false );
+        }
+        if( ( size & ( size - 1 ) ) != 0 || 
+            size < ( (std::uint64_t)1 << BASE_PAGE_BITS ) )
+        {
+            return( false );
+        }
+        page_bits.push_back( __builtin_ctzll( size ) );
     }
-    else
+    return( ! page_bits.empty() );
+}
+
+void
+page_stats_impl::save_page_stats( stats_file_writer_t &out ) const
+{
+    out.write_varint( update_count );
+    const auto keys( _regions->sorted_keys() );
+    out.write_varint( keys.size() );
+    for( const auto key : keys )
     {
-        std::cout << "error, failed to open file\n";
+        out.write_varint( key );
+        /** untouched pages are written as a 0 counter alone **/
+        for( const auto &page : _regions->at( key )._4K )
+        {
+            out.write_varint( page.counter );
+            if( page.counter == 0 )
+            {
+                continue;
+            }
+            out.write_varint( page.first_access );
+            out.write_varint( page.insn_page );
+            out.write_varint( page.read_access.to_ullong() );
+            out.write_varint( page.write_access.to_ullong() );
+        }
     }
+}
 
-    if( ostream_64.is_open() )
+bool
+page_stats_impl::restore_page_stats( stats_file_reader_t &in )
+{
+    std::uint64_t count( 0 ), region_count( 0 );
+    if( ! in.read_varint( &count ) || ! in.read_varint( &region_count ) )
     {
-        auto it = _64K_stats->begin();
-        auto end = _64K_stats->end();
-        for( ; it != end; ++it)
+        return( false );
+    }
+    update_count = count;
+    for( std::uint64_t i( 0 ); i < region_count; i++ )
+    {
+        std::uint64_t key( 0 );
+        if( ! in.read_varint( &key ) || key > ( ~std::uint64_t( 0 ) >> 20 ) )
         {
-            const auto actual_addy = 
-                (std::uintptr_t)( (*it).first ) << 16;
-            ostream_64 << "0x" << std::hex << actual_addy << std::dec << ", " << (*it).second << "\n";
+            return( false );
         }
-        ostream_64.flush();
-        ostream_64.close();
+        for( auto &page : (*_regions)[ key ]._4K )
+        {
+            std::uint64_t insn_page( 0 ), read( 0 ), write( 0 );
+            if( ! in.read_varint( &page.counter ) )
+            {
+                return( false );
+            }
+            if( page.counter == 0 )
+            {
+                continue;
+            }
+            if( ! in.read_varint( &page.first_access ) || 
+                ! in.read_varint( &insn_page ) || insn_page > 3 ||
+                ! in.read_varint( &read ) || ! in.read_varint( &write ) )
+            {
+                return( false );
+            }
+            page.insn_page    = (std::uint8_t)insn_page;
+            page.read_access  = read;
+            page.write_access = write;
+        }
+    }
+    return( true );
+}
+
+static std::string
+page_size_name( const int page_bits )
+{
+    if( page_bits >= 30 )
+    {
+        return( std::to_string( (std::uint64_t)1 << ( page_bits - 30 ) ) + "GiB" );
     }
-    else
+    if( page_bits >= 20 )
     {
-        std::cout << "error, failed to open file\n";
+        return( std::to_string( (std::uint64_t)1 << ( page_bits - 20 ) ) + "MiB" );
     }
+    return( std::to_string( (std::uint64_t)1 << ( page_bits - 10 ) ) + "KiB" );
+}
+
+void
+page_stats_impl::set_page_stats_format( const stats_format_t format )
+{
+    page_stats_format = format;
+}
+
+void
+page_stats_impl::write_granularity( std::ostream *text, 
+                                    stats_file_writer_t *binary,
+                                    const std::vector< std::uint64_t > &keys,
+                                    const int page_bits )
+{
+    const int shift( page_bits - BASE_PAGE_BITS );
+    const std::uint64_t pages_per_page( (std::uint64_t)1 << shift );
+    /** the touched 4KiB pages within the current page, highest first **/
+    std::vector< std::pair< std::uint64_t, const base_page_stats* > > members;
+    const std::string absent( 64, '0' );
+    /** binary bitmaps, 8 bytes of granules per 4KiB page **/
+    std::vector< unsigned char > bitmap( binary != nullptr ? pages_per_page * 8 : 0 );
+    std::uint64_t prev_page( 0 );
+    bool first_page( true );
+
+    auto flush = [&]()
+    {
+        const auto page( members.front().first >> shift );
+        std::uint64_t counter( 0 );
+        const base_page_stats *first( members.front().second );
+        for( const auto &m : members )
+        {
+            counter += m.second->counter;
+            if( m.second->first_access < first->first_access )
+            {
+                first = m.second;
+            }
+        }
+        /** 
+         * the page's type is fixed by its first access, and turns mixed if 
+         * it was data and an instruction fetch follows anywhere in the page
+         */
+        std::uint8_t insn_page( first->insn_page );
+        if( insn_page == 2 )
+        {
+            for( const auto &m : members )
+            {
+                if( m.second != first && 
+                    ( m.second->insn_page == 1 || m.second->insn_page == 3 ) )
+                {
+                    insn_page = 3;
+                    break;
+                }
+            }
+        }
+        if( binary != nullptr )
+        {
+            binary->write_varint( first_page ? page : prev_page - page );
+            binary->write_varint( counter );
+            const unsigned char type( insn_page );
+            binary->write_bytes( &type, 1 );
+            for( int pass( 0 ); pass < 2; pass++ )
+            {
+                std::fill( bitmap.begin(), bitmap.end(), 0 );
+                for( const auto &m : members )
+                {
+                    std::uint64_t word( pass == 0 ? m.second->read_access.to_ullong() 
+                                                  : m.second->write_access.to_ullong() );
+                    auto *out( &bitmap[ ( m.first & ( pages_per_page - 1 ) ) * 8 ] );
+                    for( int b( 0 ); b < 8; b++, word >>= 8 )
+                    {
+                        out[ b ] = (unsigned char)word;
+                    }
+                }
+                binary->write_bytes( bitmap.data(), bitmap.size() );
+            }
+            prev_page  = page;
+            first_page = false;
+            members.clear();
+            return;
+        }
+        std::ostream &stream( *text );
+        stream << "0x" << std::hex << ( (std::uintptr_t)page << page_bits ) << std::dec 
+               << ", " << counter << ", " << return_type_helper( insn_page ) << ", ";
+        /** bitsets print most significant granule first **/
+        for( int pass( 0 ); pass < 2; pass++ )
+        {
+            auto it( members.begin() );
+            for( std::uint64_t i( pages_per_page ); i-- > 0; )
+            {
+                if( it != members.end() && 
+                    ( it->first & ( pages_per_page - 1 ) ) == i )
+                {
+                    stream << ( pass == 0 ? it->second->read_access.to_string() 
+                                          : it->second->write_access.to_string() );
+                    ++it;
+                }
+                else
+                {
+                    stream << absent;
+                }
+            }
+            stream << ( pass == 0 ? ", " : "\n" );
+        }
+        members.clear();
+    };
 
-    if( ostream_1M.is_open() )
+    for( const auto key : keys )
     {
-        auto it = _1M_stats->begin();
-        auto end = _1M_stats->end();
-        for( ; it != end; ++it )
+        const auto &region( _regions->at( key ) );
+        for( int i( 255 ); i >= 0; i-- )
         {
-            const auto actual_addy = 
-                (std::uintptr_t)( (*it).first ) << 20;
-            ostream_1M << "0x" << std::hex << actual_addy << std::dec << ", " << (*it).second << "\n";
+            if( region._4K[ i ].counter == 0 )
+            {
+                continue;
+            }
+            const std::uint64_t base_page( ( key << 8 ) | i );
+            if( ! members.empty() && 
+                ( members.front().first >> shift ) != ( base_page >> shift ) )
+            {
+                flush();
+            }
+            members.emplace_back( base_page, &region._4K[ i ] );
         }
-        ostream_1M.flush();
-        ostream_1M.close();
     }
-    else
+    if( ! members.empty() )
     {
-        std::cout << "error, failed to open file\n";
+        flush();
     }
+}
 
+void
+page_stats_impl::write( const std::string &path_prefix )
+{
+    if( stats_writer == nullptr || _regions == nullptr )
+    {
+        write_now( path_prefix );
+        return;
+    }
+    /** the writer thread takes the table, nothing updates it after this **/
+    auto *pending( new page_stats_impl() );
+    pending->_regions          = _regions;
+    pending->page_stats_bits   = page_stats_bits;
+    pending->page_stats_format = page_stats_format;
+    _regions = nullptr;
+    stats_writer->submit( [ pending, path_prefix ]()
+    {
+        pending->write_now( path_prefix );
+        pending->destroy();
+        delete( pending );
+    } );
+}
+
+void
+page_stats_impl::write_now( const std::string &path_prefix )
+{
+    if( _regions == nullptr )
+    {
+        return;
+    }
+    /** highest address first within each file, as before **/
+    const auto keys( _regions->sorted_keys() );
+    for( const auto page_bits : page_stats_bits )
+    {
+        const auto path( path_prefix + "_" + page_size_name( page_bits ) + 
+                         stats_format_extension( page_stats_format ) );
+        if( page_stats_format != STATS_FORMAT_TEXT )
+        {
+            stats_file_writer_t writer( path, 
+                                        STATS_FILE_PAGE_USAGE, 
+                                        page_bits,
+                                        page_stats_format == STATS_FORMAT_BINARY_GZ );
+            if( ! writer.is_open() )
+            {
+                std::cout << "error, failed to open file\n";
+                continue;
+            }
+            write_granularity( nullptr, &writer, keys, page_bits );
+            continue;
+        }
+        std::ofstream stream( path );
+        if( ! stream.is_open() )
+        {
+            std::cout << "error, failed to open file\n";
+            continue;
+        }
+        write_granularity( &stream, nullptr, keys, page_bits );
+        stream.flush();
+    }
 }
 
 void 
 page_stats_impl::destroy()
 {
-    delete( _4K_stats  );
-    delete( _64K_stats );
-    delete( _1M_stats  );
+    delete( _regions );
+    _regions = nullptr;
+    if( stats_writer != nullptr )
+    {
+        stats_writer = nullptr;
+        stats_writer_t::release();
+    }
 }
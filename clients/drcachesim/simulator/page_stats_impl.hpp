@@ -21,10 +21,68 @@
 #define PAGE_STATS_IMPL_HPP  1
 
 #include "page_stats.tcc"
+#include "sparse_table.h"
+#include "stats_file.h"
+#include "stats_writer.h"
 #include <fstream>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
 #include "memref.h"
 #include "defs.h"
 
+/** only 4KiB pages are tracked, larger ones are derived from them **/
+using base_page_stats = page_stats< 64, 12 >;
+
+static constexpr int BASE_PAGE_BITS = 12;
+
+/**
+ * page_region - stats for the 256 4KiB pages of one 1MiB-aligned region 
+ * of the address space, so a single lookup by region number finds them.
+ * A page has been touched iff its counter is non-zero.
+ */
+struct page_region
+{
+    base_page_stats     _4K[ 256 ];
+};
+
+/**
+ * page_region_table - sparse_table from region number (address >> 20) 
+ * to the page_region for it.  The regions themselves are allocated 
+ * individually so references stay valid when the table grows.  Entries 
+ * are unordered, sorting only happens when the stats are written out.
+ */
+class page_region_table
+{
+public:
+    page_region_table() = default;
+
+    ~page_region_table();
+
+    page_region_table( const page_region_table &other ) = delete;
+    page_region_table& operator = ( const page_region_table &other ) = delete;
+
+    inline page_region& operator [] ( const std::uint64_t region_num )
+    {
+        auto &region( regions[ region_num ] );
+        if( region == nullptr )
+        {
+            region = new page_region();
+        }
+        return( *region );
+    }
+
+    /** region numbers of all regions present, highest first **/
+    std::vector< std::uint64_t > sorted_keys() const;
+
+    /** only valid for a key returned by sorted_keys() **/
+    const page_region& at( const std::uint64_t region_num ) const;
+
+private:
+    sparse_table_t< page_region* > regions;
+};
+
 class page_stats_impl
 {
 public:    
@@ -37,14 +95,66 @@ public:
     
     virtual void update( const memref_t &memref );
     
-    virtual void write( std::ofstream &ostream_4, std::ofstream &ostream_64, std::ofstream &ostream_1M );
+    /** 
+     * writes path_prefix_<size>.dat for each page size set by 
+     * set_page_stats_sizes(), e.g., path_prefix_4KiB.dat, or .bin/.bin.gz 
+     * for the binary formats.  The stats are handed to the stats writer 
+     * thread, which writes them in the background, so this must be the 
+     * last call before destroy(); the files are complete once every user 
+     * of the writer has called destroy().
+     */
+    virtual void write( const std::string &path_prefix );
     
     virtual void destroy();
 
+    /** 
+     * page sizes to write stats for, as log2 of the size, each at least 
+     * BASE_PAGE_BITS; defaults to 4KiB, 64KiB and 1MiB 
+     */
+    void set_page_stats_sizes( const std::vector< int > &page_bits );
+
+    void set_page_stats_format( const stats_format_t format );
+
+    /** 
+     * parses a comma-separated list of power-of-two sizes with a K, M or G
+     * suffix, e.g., "4K,64K,1M,2M", returns false if malformed
+     */
+    static bool parse_page_stats_sizes( const std::string &spec, 
+                                        std::vector< int > &page_bits );
+
+    /** 
+     * writes every 4KiB page touched so far and the access sequence 
+     * number for a checkpoint, only valid between init() and destroy()
+     */
+    void save_page_stats( stats_file_writer_t &out ) const;
+
+    /** 
+     * reads what save_page_stats() wrote into stats that have not been 
+     * updated yet, returns false if the file is truncated or malformed
+     */
+    bool restore_page_stats( stats_file_reader_t &in );
+
 protected:
-    gran_stats_t< 64    , 12> *_4K_stats     = nullptr;
-    gran_stats_t< 1024  , 16> *_64K_stats    = nullptr;
-    gran_stats_t< 16384 , 20> *_1M_stats     = nullptr;
+    /** writes the files for write() on the calling thread **/
+    void write_now( const std::string &path_prefix );
+
+    /** 
+     * writes one record per page of size (1 << page_bits), combining the 
+     * 4KiB pages within it exactly as if the page had been tracked directly,
+     * to exactly one of text or binary
+     */
+    void write_granularity( std::ostream *text, 
+                            stats_file_writer_t *binary,
+                            const std::vector< std::uint64_t > &keys,
+                            const int page_bits );
+
+    page_region_table  *_regions     = nullptr;
+    /** orders first accesses, see page_stats::first_access **/
+    std::uint64_t       update_count = 0;
+    std::vector< int >  page_stats_bits = { 12, 16, 20 };
+    stats_format_t      page_stats_format = STATS_FORMAT_TEXT;
+    /** held from init() to destroy() **/
+    stats_writer_t     *stats_writer = nullptr;
 };
 
 #endif /* END PAGE_STATS_IMPL_HPP */
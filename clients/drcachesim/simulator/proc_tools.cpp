@@ -41,7 +41,10 @@ proc_tools::get_bin_path_for_pid( const pid_t pid, std::string &path )
     const auto link_size = readlink(  buffer, sym_buffer, buffer_length );
     if( link_size == -1 )
     {
-        std::perror( "failed to get symlink" );
+        /** 
+         * expected for a process that is gone, the caller 
+         * decides whether that's worth reporting, errno is set 
+         */
         return( false );
     }
     else if( link_size >= buffer_length )
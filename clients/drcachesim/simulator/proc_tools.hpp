@@ -25,6 +25,10 @@
 struct proc_tools
 {
 
+/** 
+ * returns false with errno set and prints nothing if the
+ * process is gone or /proc is unavailable 
+ */
 static bool get_bin_path_for_pid( const pid_t pid, std::string &path );
 
 }; 
@@ -0,0 +1,190 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "region_stats.h"
+#include <algorithm>
+#include <iomanip>
+
+region_stats_t::region_stats_t(std::map<memref_pid_t, vm_memory_map *> *process_maps)
+    : process_maps_(process_maps)
+{
+}
+
+void
+region_stats_t::switch_process(memref_pid_t pid)
+{
+    process_t &process = processes_[pid];
+    if (process.map == nullptr) {
+        // The simulator adds a process's map before its first reference reaches
+        // the caches, but look again in case we were asked first.
+        auto it = process_maps_->find(pid);
+        if (it != process_maps_->end()) {
+            process.map = it->second;
+            process.regions.resize(process.map->region_count());
+        }
+    }
+    last_pid_ = pid;
+    last_process_ = &process;
+}
+
+void
+region_stats_t::reset()
+{
+    for (auto &pid_process : processes_) {
+        process_t &process = pid_process.second;
+        std::fill(process.regions.begin(), process.regions.end(), counters_t());
+        process.unmapped = counters_t();
+    }
+}
+
+// Each counter is written as accesses, bytes, LLC hits and LLC misses.
+void
+region_stats_t::save_state(stats_file_writer_t &out) const
+{
+    auto write_counters = [&out](const counters_t &counters) {
+        out.write_varint(counters.accesses);
+        out.write_varint(counters.bytes);
+        out.write_varint(counters.llc_hits);
+        out.write_varint(counters.llc_misses);
+    };
+    out.write_varint(processes_.size());
+    for (const auto &pid_process : processes_) {
+        out.write_varint((std::uint64_t)pid_process.first);
+        out.write_varint(pid_process.second.regions.size());
+        for (const counters_t &counters : pid_process.second.regions)
+            write_counters(counters);
+        write_counters(pid_process.second.unmapped);
+    }
+}
+
+bool
+region_stats_t::restore_state(stats_file_reader_t &in)
+{
+    auto read_counters = [&in](counters_t &counters) {
+        std::uint64_t accesses, bytes, llc_hits, llc_misses;
+        if (!in.read_varint(&accesses) || !in.read_varint(&bytes) ||
+            !in.read_varint(&llc_hits) || !in.read_varint(&llc_misses))
+            return false;
+        counters.accesses = (int_least64_t)accesses;
+        counters.bytes = (int_least64_t)bytes;
+        counters.llc_hits = (int_least64_t)llc_hits;
+        counters.llc_misses = (int_least64_t)llc_misses;
+        return true;
+    };
+    std::uint64_t count;
+    if (!in.read_varint(&count))
+        return false;
+    for (std::uint64_t i = 0; i < count; i++) {
+        std::uint64_t pid, region_count;
+        if (!in.read_varint(&pid) || !in.read_varint(&region_count))
+            return false;
+        switch_process((memref_pid_t)pid);
+        if (region_count != last_process_->regions.size())
+            return false;
+        for (counters_t &counters : last_process_->regions) {
+            if (!read_counters(counters))
+                return false;
+        }
+        if (!read_counters(last_process_->unmapped))
+            return false;
+    }
+    return true;
+}
+
+void
+region_stats_t::print(std::ostream &stream) const
+{
+    struct row_t {
+        memref_pid_t pid;
+        const vm_maps_entry_t *entry; // nullptr for the unmapped row.
+        const counters_t *counters;
+    };
+    std::vector<row_t> rows;
+    int_least64_t total_llc_misses = 0;
+    for (const auto &pid_process : processes_) {
+        const process_t &process = pid_process.second;
+        for (std::size_t i = 0; i < process.regions.size(); ++i) {
+            const counters_t &counters = process.regions[i];
+            if (counters.accesses == 0 && counters.llc_hits == 0 &&
+                counters.llc_misses == 0)
+                continue;
+            rows.push_back({ pid_process.first, &process.map->region(i), &counters });
+            total_llc_misses += counters.llc_misses;
+        }
+        if (process.unmapped.accesses > 0 || process.unmapped.llc_hits > 0 ||
+            process.unmapped.llc_misses > 0) {
+            rows.push_back({ pid_process.first, nullptr, &process.unmapped });
+            total_llc_misses += process.unmapped.llc_misses;
+        }
+    }
+    std::sort(rows.begin(), rows.end(), [](const row_t &l, const row_t &r) {
+        return l.counters->llc_misses > r.counters->llc_misses;
+    });
+
+    stream << std::setw(8) << "pid" << std::setw(20) << "start" << std::setw(20)
+           << "end" << std::setw(6) << "perms" << std::setw(16) << "accesses"
+           << std::setw(16) << "bytes" << std::setw(14) << "LLC hits" << std::setw(14)
+           << "LLC misses" << std::setw(12) << "miss rate" << std::setw(12)
+           << "% misses"
+           << "  mapping\n";
+    for (const row_t &row : rows) {
+        const counters_t &c = *row.counters;
+        const int_least64_t llc_accesses = c.llc_hits + c.llc_misses;
+        stream << std::setw(8) << row.pid;
+        if (row.entry != nullptr) {
+            const char perms[] = {
+                (row.entry->perms & vm_maps_entry_t::read) != 0 ? 'r' : '-',
+                (row.entry->perms & vm_maps_entry_t::write) != 0 ? 'w' : '-',
+                (row.entry->perms & vm_maps_entry_t::execute) != 0 ? 'x' : '-',
+                (row.entry->perms & vm_maps_entry_t::shared) != 0 ? 's' : 'p', '\0'
+            };
+            stream << std::hex << std::setw(20) << row.entry->start << std::setw(20)
+                   << row.entry->end << std::dec << std::setw(6) << perms;
+        } else
+            stream << std::setw(20) << "-" << std::setw(20) << "-" << std::setw(6) << "-";
+        stream << std::setw(16) << c.accesses << std::setw(16) << c.bytes
+               << std::setw(14) << c.llc_hits << std::setw(14) << c.llc_misses
+               << std::fixed << std::setprecision(4) << std::setw(12)
+               << (llc_accesses == 0 ? 0.0 : (double)c.llc_misses / llc_accesses)
+               << std::setprecision(2) << std::setw(12)
+               << (total_llc_misses == 0 ? 0.0
+                                         : 100.0 * c.llc_misses / total_llc_misses)
+               << "  ";
+        if (row.entry == nullptr)
+            stream << "<unmapped>";
+        else if (row.entry->pathname[0] == '\0')
+            stream << "<anon>";
+        else
+            stream << row.entry->pathname;
+        stream << "\n";
+    }
+}
@@ -0,0 +1,129 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* region_stats: attributes each reference and each last-level cache access to the
+ * mapping of the traced process that it touches, to show which mappings
+ * (heap, a particular mmap, a library, a thread stack) cause the LLC pressure.
+ */
+
+#ifndef _REGION_STATS_H_
+#define _REGION_STATS_H_ 1
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "memorymap.hpp"
+#include "memref.h"
+#include "stats_file.h"
+
+class region_stats_t {
+public:
+    // The maps are the simulator's per-process maps, which must outlive us.
+    explicit region_stats_t(std::map<memref_pid_t, vm_memory_map *> *process_maps);
+
+    // Called for each instruction fetch or data reference given to an L1 cache.
+    void
+    access(const memref_t &memref)
+    {
+        counters_t &counters = lookup(memref);
+        counters.accesses++;
+        counters.bytes += memref.data.size;
+    }
+
+    // Called for each access of a last-level cache.
+    void
+    llc_access(const memref_t &memref, bool hit)
+    {
+        counters_t &counters = lookup(memref);
+        if (hit)
+            counters.llc_hits++;
+        else
+            counters.llc_misses++;
+    }
+
+    void
+    reset();
+
+    // Writes the counters of each process for a checkpoint.
+    void
+    save_state(stats_file_writer_t &out) const;
+    // Reads what save_state() wrote, once the simulator has restored the
+    // process maps.  Returns false if a process's mappings differ or the file
+    // is truncated.
+    bool
+    restore_state(stats_file_reader_t &in);
+
+    // Prints one row per mapping that was touched, most LLC misses first.
+    void
+    print(std::ostream &stream) const;
+
+private:
+    struct counters_t {
+        int_least64_t accesses = 0;
+        int_least64_t bytes = 0;
+        int_least64_t llc_hits = 0;
+        int_least64_t llc_misses = 0;
+    };
+    struct process_t {
+        vm_memory_map *map = nullptr;
+        // Indexed by vm_memory_map::find_region().
+        std::vector<counters_t> regions;
+        // References outside every mapping, or with no map at all.
+        counters_t unmapped;
+    };
+
+    counters_t &
+    lookup(const memref_t &memref)
+    {
+        if (memref.data.pid != last_pid_ || last_process_ == nullptr)
+            switch_process(memref.data.pid);
+        if (last_process_->map == nullptr)
+            return last_process_->unmapped;
+        const std::size_t index = last_process_->map->find_region(memref.data.addr);
+        if (index == vm_region_index::npos)
+            return last_process_->unmapped;
+        return last_process_->regions[index];
+    }
+
+    void
+    switch_process(memref_pid_t pid);
+
+    std::map<memref_pid_t, vm_memory_map *> *process_maps_;
+    std::unordered_map<memref_pid_t, process_t> processes_;
+    memref_pid_t last_pid_ = 0;
+    process_t *last_process_ = nullptr;
+};
+
+#endif /* _REGION_STATS_H_ */
@@ -140,37 +140,25 @@ simulator_t::core_and_va_activation_for_thread( const memref_t &ref )
     }
     /** 
      * if thread already exists, VA space already activated, if we're 
-     * here then it doesn't exist. 
+     * here then it doesn't exist. Other threads of the same process
+     * share its map, so only the first thread of a pid adds one.
      */
-    auto proc_map_exists = os_process_map_.find( ref.data.pid );
-    if( proc_map_exists != os_process_map_.end() )
+    if( os_process_map_.find( ref.data.pid ) == os_process_map_.end() )
     {
         /**
-         * shouldn't be here, but if we are we recycled the PID, delete 
-         * entry and add our new one. 
+         * cheap, the map is only read from the snapshot (or /proc 
+         * when online) the first time it is queried.
          */
-        if( knobs_->verbose >= 1 )
-        {
-           std::cerr << 
-            "Process in os_process_map exists, likely wrapped, deleting entry with id (" <<
-                          ref.data.pid << ")\n";
-        }
-        /** delete ptr **/
-        delete( (*proc_map_exists).second );
-        /** erase entry **/
-        os_process_map_.erase( proc_map_exists );
+        auto *temp_map_ptr = new vm_memory_map( ref.data.pid, 
+                                                 knobs_->vm_maps_file,
+                                                 knobs_->verbose );
+        os_process_map_.emplace( 
+            std::make_pair( 
+                ref.data.pid, 
+                temp_map_ptr
+            )
+        );
     }
-    /**
-     * add map/will block while it processes smaps file,
-     * keeping as a sep. var for now to debug easier. 
-     */
-    auto *temp_map_ptr = new vm_memory_map( ref.data.pid );
-    os_process_map_.emplace( 
-        std::make_pair( 
-            ref.data.pid, 
-            temp_map_ptr
-        )
-    );
     
 
     // Either knob_cpu_scheduling_is off and we're ignoring cpu
@@ -207,3 +195,81 @@ simulator_t::handle_thread_exit(memref_tid_t tid)
     }
     thread2core_.erase(tid);
 }
+
+// Counts are written per core and mappings as key and core pairs; the
+// order of the unordered maps does not matter.
+void
+simulator_t::save_state(stats_file_writer_t &out) const
+{
+    out.write_varint(knobs_->num_cores);
+    for (unsigned int i = 0; i < knobs_->num_cores; i++) {
+        out.write_varint(cpu_counts_[i]);
+        out.write_varint(thread_counts_[i]);
+        out.write_varint(thread_ever_counts_[i]);
+    }
+    out.write_varint(cpu2core_.size());
+    for (const auto &cpu : cpu2core_) {
+        out.write_varint(cpu.first);
+        out.write_varint(cpu.second);
+    }
+    out.write_varint(thread2core_.size());
+    for (const auto &thread : thread2core_) {
+        out.write_varint((std::uint64_t)thread.first);
+        out.write_varint(thread.second);
+    }
+    out.write_varint((std::uint64_t)last_thread_);
+    out.write_varint(last_core_);
+    out.write_varint(record ? 1 : 0);
+    out.write_varint(os_process_map_.size());
+    for (const auto &process : os_process_map_)
+        out.write_varint((std::uint64_t)process.first);
+}
+
+bool
+simulator_t::restore_state(stats_file_reader_t &in)
+{
+    std::uint64_t num_cores, count, key, value;
+    if (!in.read_varint(&num_cores) || num_cores != knobs_->num_cores)
+        return false;
+    for (unsigned int i = 0; i < knobs_->num_cores; i++) {
+        std::uint64_t cpus, threads, ever;
+        if (!in.read_varint(&cpus) || !in.read_varint(&threads) ||
+            !in.read_varint(&ever))
+            return false;
+        cpu_counts_[i] = (int)cpus;
+        thread_counts_[i] = (int)threads;
+        thread_ever_counts_[i] = (int)ever;
+    }
+    if (!in.read_varint(&count))
+        return false;
+    for (std::uint64_t i = 0; i < count; i++) {
+        if (!in.read_varint(&key) || !in.read_varint(&value) || value >= num_cores)
+            return false;
+        cpu2core_[(int)key] = (int)value;
+    }
+    if (!in.read_varint(&count))
+        return false;
+    for (std::uint64_t i = 0; i < count; i++) {
+        if (!in.read_varint(&key) || !in.read_varint(&value) || value >= num_cores)
+            return false;
+        thread2core_[(memref_tid_t)key] = (int)value;
+    }
+    if (!in.read_varint(&key) || !in.read_varint(&value) || value >= num_cores)
+        return false;
+    last_thread_ = (memref_tid_t)key;
+    last_core_ = (int)value;
+    if (!in.read_varint(&value))
+        return false;
+    record = value != 0;
+    if (!in.read_varint(&count))
+        return false;
+    for (std::uint64_t i = 0; i < count; i++) {
+        if (!in.read_varint(&key))
+            return false;
+        const memref_pid_t pid = (memref_pid_t)key;
+        if (os_process_map_.find(pid) == os_process_map_.end())
+            os_process_map_.emplace(
+                pid, new vm_memory_map(pid, knobs_->vm_maps_file, knobs_->verbose));
+    }
+    return true;
+}
@@ -74,6 +74,15 @@ protected:
     virtual void
     handle_thread_exit(memref_tid_t tid);
 
+    // Writes the cpu and thread to core mappings, the current thread and the
+    // traced processes, for a checkpoint.
+    void
+    save_state(stats_file_writer_t &out) const;
+    // Reads what save_state() wrote, creating a memory map for each process.
+    // Returns false on a mismatch or a truncated file.
+    bool
+    restore_state(stats_file_reader_t &in);
+
     simulator_knobs_t   *knobs_ = nullptr; 
 
     /** FIXME - finish sdt implementation and set this to false **/
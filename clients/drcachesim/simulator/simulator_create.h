@@ -31,6 +31,8 @@ struct simulator_knobs_t
     uint64_t sim_refs               = std::numeric_limits< std::uint64_t >::max();
     bool cpu_scheduling             = false;
     std::string stats_dir           = "";
+    /** snapshot of the traced process's memory map, empty for online **/
+    std::string vm_maps_file        = "";
     unsigned int verbose            = 0;
     std::uint64_t start_pc          = 0;
     std::uint64_t stop_pc           = 0;
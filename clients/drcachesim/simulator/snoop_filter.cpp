@@ -41,84 +41,193 @@ snoop_filter_t::snoop_filter_t(void)
 }
 
 bool
-snoop_filter_t::init(cache_t **caches, int num_snooped_caches)
+snoop_filter_t::init(cache_t **caches, int num_snooped_caches, uint64_t max_entries)
 {
     caches_ = caches;
     num_snooped_caches_ = num_snooped_caches;
     num_writes_ = 0;
     num_writebacks_ = 0;
     num_invalidates_ = 0;
+    num_directory_evictions_ = 0;
 
+    sharer_words_ = (num_snooped_caches + 63) / 64;
+    slot_words_ = 2 + sharer_words_;
+    max_entries_ = max_entries;
+    num_entries_ = 0;
+    resize(INITIAL_SLOTS);
     return true;
 }
 
-/*  This function should be called for all misses in snooped caches_ as well as
- *  all writes to coherent caches_.
+int
+snoop_filter_t::count_sharers(size_t slot)
+{
+    const uint64_t *sharers = slot_sharers(slot);
+    int count = 0;
+    for (size_t w = 0; w < sharer_words_; w++)
+        count += __builtin_popcountll(sharers[w]);
+    return count;
+}
+
+void
+snoop_filter_t::resize(size_t num_slots)
+{
+    std::vector<uint64_t> old_table;
+    old_table.swap(table_);
+    const size_t old_slots = old_table.size() / (slot_words_ == 0 ? 1 : slot_words_);
+    table_.assign(num_slots * slot_words_, 0);
+    slot_mask_ = num_slots - 1;
+    hash_shift_ = 64 - compute_log2((int)num_slots);
+    for (size_t slot = 0; slot < num_slots; slot++)
+        slot_tag(slot) = TAG_INVALID;
+    for (size_t old = 0; old < old_slots; old++) {
+        const uint64_t *entry = &old_table[old * slot_words_];
+        if (entry[0] == TAG_INVALID)
+            continue;
+        const size_t slot = find_slot(entry[0]);
+        std::copy(entry, entry + slot_words_, &table_[slot * slot_words_]);
+    }
+}
+
+size_t
+snoop_filter_t::insert(addr_t tag, size_t slot)
+{
+    if (max_entries_ > 0 && num_entries_ >= max_entries_) {
+        evict_for(tag);
+        slot = find_slot(tag);
+    }
+    // Keep the load factor under 0.7 so that probe sequences stay short.
+    if ((num_entries_ + 1) * 10 > (slot_mask_ + 1) * 7) {
+        resize(2 * (slot_mask_ + 1));
+        slot = find_slot(tag);
+    }
+    slot_tag(slot) = tag;
+    num_entries_++;
+    return slot;
+}
+
+/* Backward-shift deletion: later entries of the probe run that may live in the
+ * hole are moved into it, so lookups never need tombstones.
  */
 void
-snoop_filter_t::snoop(addr_t tag, int id, bool is_write)
+snoop_filter_t::remove(size_t hole)
 {
-    coherence_table_entry_t *coherence_entry = &coherence_table_[tag];
-    // Initialize new snoop filter entry.
-    if (coherence_entry->sharers.empty()) {
-        coherence_entry->sharers.resize(num_snooped_caches_, false);
-        coherence_entry->dirty = false;
+    for (size_t slot = (hole + 1) & slot_mask_; slot_tag(slot) != TAG_INVALID;
+         slot = (slot + 1) & slot_mask_) {
+        const size_t home = home_slot(slot_tag(slot));
+        // The entry may move back if the hole lies between its home and it.
+        if (((slot - home) & slot_mask_) >= ((slot - hole) & slot_mask_)) {
+            std::copy(&table_[slot * slot_words_], &table_[(slot + 1) * slot_words_],
+                      &table_[hole * slot_words_]);
+            hole = slot;
+        }
     }
+    std::fill(&table_[hole * slot_words_], &table_[(hole + 1) * slot_words_], 0);
+    slot_tag(hole) = TAG_INVALID;
+    num_entries_--;
+}
 
-    auto num_sharers = std::count(coherence_entry->sharers.begin(),
-                                  coherence_entry->sharers.end(), true);
+/* Makes room in a full bounded directory.  The victim is the first entry at or
+ * after the new tag's home slot, which is as good as random and needs no
+ * replacement state.
+ */
+void
+snoop_filter_t::evict_for(addr_t tag)
+{
+    size_t victim = home_slot(tag);
+    while (slot_tag(victim) == TAG_INVALID)
+        victim = (victim + 1) & slot_mask_;
+    const addr_t victim_tag = slot_tag(victim);
+    const uint64_t *sharers = slot_sharers(victim);
+    for (size_t w = 0; w < sharer_words_; w++) {
+        for (uint64_t bits = sharers[w]; bits != 0; bits &= bits - 1) {
+            const int i = (int)(w * 64) + __builtin_ctzll(bits);
+            caches_[i]->invalidate(victim_tag, INVALIDATION_COHERENCE);
+            num_invalidates_++;
+        }
+    }
+    if ((slot_flags(victim) & DIRTY) != 0)
+        num_writebacks_++;
+    num_directory_evictions_++;
+    remove(victim);
+}
 
+/*  This function should be called for all misses in snooped caches_ as well as
+ *  all writes to coherent caches_.
+ */
+void
+snoop_filter_t::snoop(addr_t tag, int id, bool is_write)
+{
     // Check that cache id is valid.
     assert(id >= 0 && id < num_snooped_caches_);
     // Check that tag is valid.
     assert(tag != TAG_INVALID);
+
+    size_t slot = find_slot(tag);
+    // Initialize new snoop filter entry.
+    if (slot_tag(slot) == TAG_INVALID)
+        slot = insert(tag, slot);
+
+    uint64_t &flags = slot_flags(slot);
+    uint64_t *sharers = slot_sharers(slot);
+    const int num_sharers = count_sharers(slot);
+
     // Check that any dirty line is only held in one snooped cache.
-    assert(!coherence_entry->dirty || num_sharers == 1);
+    assert((flags & DIRTY) == 0 || num_sharers == 1);
 
     // Check if this request causes a writeback.
-    if (!coherence_entry->sharers[id] && coherence_entry->dirty) {
+    if (!is_sharer(slot, id) && (flags & DIRTY) != 0) {
         num_writebacks_++;
-        coherence_entry->dirty = false;
+        flags &= ~DIRTY;
     }
 
+    const size_t id_word = id / 64;
+    const uint64_t id_bit = 1ULL << (id % 64);
     if (is_write) {
         num_writes_++;
-        coherence_entry->dirty = true;
+        flags |= DIRTY;
         if (num_sharers > 0) {
             // Writes will invalidate other caches_.
-            for (int i = 0; i < num_snooped_caches_; i++) {
-                if (coherence_entry->sharers[i] && id != i) {
+            for (size_t w = 0; w < sharer_words_; w++) {
+                uint64_t others = sharers[w] & (w == id_word ? ~id_bit : ~0ULL);
+                for (; others != 0; others &= others - 1) {
+                    const int i = (int)(w * 64) + __builtin_ctzll(others);
                     caches_[i]->invalidate(tag, INVALIDATION_COHERENCE);
                     num_invalidates_++;
-                    coherence_entry->sharers[i] = false;
                 }
+                sharers[w] &= (w == id_word ? id_bit : 0);
             }
         }
     }
-    coherence_entry->sharers[id] = true;
+    sharers[id_word] |= id_bit;
 }
 
 /* This function is called whenever a coherent cache evicts a line. */
 void
 snoop_filter_t::snoop_eviction(addr_t tag, int id)
 {
-    coherence_table_entry_t *coherence_entry = &coherence_table_[tag];
-
-    // Check if sharer list is initialized.
-    assert(coherence_entry->sharers.size() == (uint64_t)num_snooped_caches_);
     // Check that cache id is valid.
     assert(id >= 0 && id < num_snooped_caches_);
     // Check that tag is valid.
     assert(tag != TAG_INVALID);
+
+    const size_t slot = find_slot(tag);
+    // Check that we have an entry for this line.
+    assert(slot_tag(slot) == tag);
+    if (slot_tag(slot) != tag)
+        return;
     // Check that we currently have this cache marked as a sharer.
-    assert(coherence_entry->sharers[id]);
+    assert(is_sharer(slot, id));
 
-    if (coherence_entry->dirty) {
+    uint64_t &flags = slot_flags(slot);
+    if ((flags & DIRTY) != 0) {
         num_writebacks_++;
-        coherence_entry->dirty = false;
+        flags &= ~DIRTY;
     }
 
-    coherence_entry->sharers[id] = false;
+    slot_sharers(slot)[id / 64] &= ~(1ULL << (id % 64));
+    // An entry with no sharers is the same as no entry.
+    if (count_sharers(slot) == 0)
+        remove(slot);
 }
 
 void
@@ -133,5 +242,67 @@ snoop_filter_t::print_stats(void)
               << std::right << num_invalidates_ << std::endl;
     std::cerr << prefix << std::setw(18) << std::left << "Writebacks:" << std::setw(20)
               << std::right << num_writebacks_ << std::endl;
+    if (max_entries_ > 0) {
+        std::cerr << prefix << std::setw(20) << std::left
+                  << "Directory evictions:" << std::setw(18) << std::right
+                  << num_directory_evictions_ << std::endl;
+    }
     std::cerr.imbue(std::locale("C")); // Reset to avoid affecting later prints.
 }
+
+// Occupied slots are written at their position, as a bounded directory picks
+// its victim by probing from the home slot.
+void
+snoop_filter_t::save_state(stats_file_writer_t &out) const
+{
+    const size_t num_slots = slot_mask_ + 1;
+    out.write_varint(num_snooped_caches_);
+    out.write_varint(num_slots);
+    out.write_varint(num_entries_);
+    out.write_varint(num_writes_);
+    out.write_varint(num_writebacks_);
+    out.write_varint(num_invalidates_);
+    out.write_varint(num_directory_evictions_);
+    size_t prev_slot = 0;
+    for (size_t slot = 0; slot < num_slots; slot++) {
+        if (slot_tag(slot) == TAG_INVALID)
+            continue;
+        out.write_varint(slot - prev_slot);
+        prev_slot = slot;
+        for (size_t w = 0; w < slot_words_; w++)
+            out.write_varint(table_[slot * slot_words_ + w]);
+    }
+}
+
+bool
+snoop_filter_t::restore_state(stats_file_reader_t &in)
+{
+    uint64_t num_caches, num_slots, num_entries;
+    uint64_t writes, writebacks, invalidates, evictions;
+    if (!in.read_varint(&num_caches) || !in.read_varint(&num_slots) ||
+        !in.read_varint(&num_entries) || !in.read_varint(&writes) ||
+        !in.read_varint(&writebacks) || !in.read_varint(&invalidates) ||
+        !in.read_varint(&evictions))
+        return false;
+    if (num_caches != (uint64_t)num_snooped_caches_ || !IS_POWER_OF_2(num_slots) ||
+        num_slots < INITIAL_SLOTS || num_entries > num_slots)
+        return false;
+    resize((size_t)num_slots);
+    num_entries_ = num_entries;
+    num_writes_ = (int_least64_t)writes;
+    num_writebacks_ = (int_least64_t)writebacks;
+    num_invalidates_ = (int_least64_t)invalidates;
+    num_directory_evictions_ = (int_least64_t)evictions;
+    size_t slot = 0;
+    for (uint64_t i = 0; i < num_entries; i++) {
+        uint64_t delta;
+        if (!in.read_varint(&delta) || slot + delta >= num_slots)
+            return false;
+        slot += (size_t)delta;
+        for (size_t w = 0; w < slot_words_; w++) {
+            if (!in.read_varint(&table_[slot * slot_words_ + w]))
+                return false;
+        }
+    }
+    return true;
+}
@@ -34,37 +34,113 @@
 #define _SNOOP_FILTER_H_ 1
 
 #include "cache.h"
-#include <unordered_map>
+#include "stats_file.h"
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
-struct coherence_table_entry_t {
-    std::vector<bool> sharers;
-    bool dirty;
-};
-
+// The directory is keyed by tag with open addressing and linear probing.  Each
+// slot holds its tag, its dirty flag and a bitmask of the snooped caches sharing
+// the line inline, so a snoop touches one slot rather than a hashtable node and
+// a separately allocated sharer vector.  A slot is removed when its last sharer
+// evicts the line, so the directory only holds lines resident in some snooped
+// cache.
 class snoop_filter_t {
 public:
     snoop_filter_t(void);
     virtual ~snoop_filter_t()
     {
     }
+    // A non-zero max_entries bounds the directory like a real sparse directory:
+    // adding a line to a full directory evicts another entry, which invalidates
+    // that line in all of its sharers.
     virtual bool
-    init(cache_t **caches, int num_snooped_caches);
+    init(cache_t **caches, int num_snooped_caches, uint64_t max_entries = 0);
     virtual void
     snoop(addr_t tag, int id, bool is_write);
     virtual void
     snoop_eviction(addr_t tag, int id);
     void
     print_stats(void);
+    // Writes the directory, slot for slot, and the counters for a checkpoint.
+    void
+    save_state(stats_file_writer_t &out) const;
+    // Reads what save_state() wrote into a filter initialized for as many
+    // caches.  Returns false on a mismatch or a truncated file.
+    bool
+    restore_state(stats_file_reader_t &in);
 
 protected:
-    // XXX: This initial coherence implementation uses a perfect snoop filter.
-    std::unordered_map<addr_t, coherence_table_entry_t> coherence_table_;
+    static const uint64_t DIRTY = 1;
+    static const size_t INITIAL_SLOTS = 1024;
+
+    size_t
+    home_slot(addr_t tag) const
+    {
+        return (size_t)((tag * 0x9e3779b97f4a7c15ULL) >> hash_shift_);
+    }
+    // Returns the slot holding tag, or the empty slot where it would go.
+    size_t
+    find_slot(addr_t tag) const
+    {
+        size_t slot = home_slot(tag);
+        while (slot_tag(slot) != tag && slot_tag(slot) != TAG_INVALID)
+            slot = (slot + 1) & slot_mask_;
+        return slot;
+    }
+    addr_t &
+    slot_tag(size_t slot)
+    {
+        return table_[slot * slot_words_];
+    }
+    addr_t
+    slot_tag(size_t slot) const
+    {
+        return table_[slot * slot_words_];
+    }
+    uint64_t &
+    slot_flags(size_t slot)
+    {
+        return table_[slot * slot_words_ + 1];
+    }
+    uint64_t *
+    slot_sharers(size_t slot)
+    {
+        return &table_[slot * slot_words_ + 2];
+    }
+    bool
+    is_sharer(size_t slot, int id)
+    {
+        return (slot_sharers(slot)[id / 64] >> (id % 64)) & 1;
+    }
+    int
+    count_sharers(size_t slot);
+    // Claims the empty slot for tag, growing or, when bounded, evicting first.
+    size_t
+    insert(addr_t tag, size_t slot);
+    void
+    remove(size_t slot);
+    void
+    resize(size_t num_slots);
+    // Removes an entry to make room in a bounded directory.
+    void
+    evict_for(addr_t tag);
+
+    // Slots of slot_words_ words: the tag, the flags and the sharer bitmask.
+    std::vector<uint64_t> table_;
+    size_t slot_words_ = 0;
+    size_t sharer_words_ = 0;
+    size_t slot_mask_ = 0;
+    int hash_shift_ = 0;
+    uint64_t num_entries_ = 0;
+    uint64_t max_entries_ = 0;
+
     cache_t **caches_;
     int num_snooped_caches_;
     int_least64_t num_writes_;
     int_least64_t num_writebacks_;
     int_least64_t num_invalidates_;
+    int_least64_t num_directory_evictions_;
 };
 
 #endif /* _SNOOP_FILTER_H_ */
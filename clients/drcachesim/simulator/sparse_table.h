@@ -0,0 +1,183 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+/* sparse_table: open-addressing hash table keyed by the high bits of an
+ * address, for per-region state over a sparse address space.
+ */
+
+#ifndef _SPARSE_TABLE_H_
+#define _SPARSE_TABLE_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Maps a key, e.g., a region or page number, to a small value stored inline
+// next to it, so a lookup touches one cache line. Keys must not be all ones.
+// Values start value-initialized; a reference to one is only valid until the
+// next new key is added.
+template <class T> class sparse_table_t {
+public:
+    sparse_table_t()
+    {
+        entries_.assign(INITIAL_CAPACITY, entry_t());
+    }
+
+    // Returns the value of key, adding it if not present.
+    inline T &
+    operator[](std::uint64_t key)
+    {
+        if (key == last_key_)
+            return entries_[last_slot_].value;
+        return lookup(key);
+    }
+
+    // Returns the value of key, or nullptr if not present.
+    const T *
+    find(std::uint64_t key) const
+    {
+        for (std::size_t i = slot(key); entries_[i].key != EMPTY_KEY;
+             i = (i + 1) & (entries_.size() - 1)) {
+            if (entries_[i].key == key)
+                return &entries_[i].value;
+        }
+        return nullptr;
+    }
+
+    // Returns the keys present, in no particular order.
+    std::vector<std::uint64_t>
+    get_keys() const
+    {
+        std::vector<std::uint64_t> keys;
+        keys.reserve(count_);
+        for (const auto &e : entries_) {
+            if (e.key != EMPTY_KEY)
+                keys.push_back(e.key);
+        }
+        return keys;
+    }
+
+    // Calls f(key, value) for every key present.
+    template <class F>
+    void
+    for_each(F f)
+    {
+        for (auto &e : entries_) {
+            if (e.key != EMPTY_KEY)
+                f(e.key, e.value);
+        }
+    }
+
+    std::size_t
+    size() const
+    {
+        return count_;
+    }
+
+    void
+    clear()
+    {
+        entries_.assign(INITIAL_CAPACITY, entry_t());
+        count_ = 0;
+        shift_ = 64 - INITIAL_BITS;
+        last_key_ = EMPTY_KEY;
+        last_slot_ = 0;
+    }
+
+private:
+    static constexpr std::uint64_t EMPTY_KEY = ~(std::uint64_t)0;
+    static constexpr int INITIAL_BITS = 10;
+    static constexpr std::size_t INITIAL_CAPACITY = std::size_t(1) << INITIAL_BITS;
+
+    struct entry_t {
+        std::uint64_t key = EMPTY_KEY;
+        T value = T();
+    };
+
+    inline std::size_t
+    slot(std::uint64_t key) const
+    {
+        // Fibonacci hashing spreads the adjacent keys a sparse address space
+        // is full of.
+        return static_cast<std::size_t>((key * 0x9e3779b97f4a7c15ULL) >> shift_);
+    }
+
+    T &
+    lookup(std::uint64_t key)
+    {
+        std::size_t i = slot(key);
+        for (; entries_[i].key != EMPTY_KEY; i = (i + 1) & (entries_.size() - 1)) {
+            if (entries_[i].key == key) {
+                last_key_ = key;
+                last_slot_ = i;
+                return entries_[i].value;
+            }
+        }
+        // A new key: keep the load factor at or below one half.
+        if ((count_ + 1) * 2 > entries_.size()) {
+            grow();
+            for (i = slot(key); entries_[i].key != EMPTY_KEY;
+                 i = (i + 1) & (entries_.size() - 1))
+                ;
+        }
+        entries_[i].key = key;
+        count_++;
+        last_key_ = key;
+        last_slot_ = i;
+        return entries_[i].value;
+    }
+
+    void
+    grow()
+    {
+        std::vector<entry_t> old_entries(2 * entries_.size(), entry_t());
+        old_entries.swap(entries_);
+        shift_--;
+        for (const auto &e : old_entries) {
+            if (e.key == EMPTY_KEY)
+                continue;
+            std::size_t i = slot(e.key);
+            while (entries_[i].key != EMPTY_KEY)
+                i = (i + 1) & (entries_.size() - 1);
+            entries_[i] = e;
+        }
+        // The cached slot moved.
+        last_key_ = EMPTY_KEY;
+    }
+
+    std::vector<entry_t> entries_;
+    std::size_t count_ = 0;
+    int shift_ = 64 - INITIAL_BITS;
+    std::uint64_t last_key_ = EMPTY_KEY;
+    std::size_t last_slot_ = 0;
+};
+
+#endif /* _SPARSE_TABLE_H_ */
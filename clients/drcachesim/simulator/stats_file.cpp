@@ -0,0 +1,386 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "stats_file.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <ios>
+#include <vector>
+
+static const char STATS_FILE_MAGIC[8] = { 'D', 'R', 'C', 'S', 'T', 'A', 'T', 'S' };
+static const std::size_t STATS_FILE_HEADER_SIZE = sizeof(STATS_FILE_MAGIC) + 4 * 4;
+
+static const char *const page_type_names[] = { "unknown", "instructions", "data",
+                                               "mixed" };
+
+bool
+stats_format_from_string(const std::string &name, stats_format_t *format)
+{
+    if (name == "text")
+        *format = STATS_FORMAT_TEXT;
+    else if (name == "binary")
+        *format = STATS_FORMAT_BINARY;
+#ifdef HAS_ZLIB
+    else if (name == "binary_gz")
+        *format = STATS_FORMAT_BINARY_GZ;
+#endif
+    else
+        return false;
+    return true;
+}
+
+const char *
+stats_format_extension(stats_format_t format)
+{
+    switch (format) {
+    case STATS_FORMAT_BINARY: return ".bin";
+    case STATS_FORMAT_BINARY_GZ: return ".bin.gz";
+    default: return ".dat";
+    }
+}
+
+static void
+encode_u32(unsigned char *out, std::uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+
+static std::uint32_t
+decode_u32(const unsigned char *in)
+{
+    std::uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+        value |= static_cast<std::uint32_t>(in[i]) << (8 * i);
+    return value;
+}
+
+stats_file_writer_t::stats_file_writer_t(const std::string &path,
+                                         stats_file_type_t type, std::uint32_t param,
+                                         bool compress)
+    : compress_(compress)
+{
+#ifdef HAS_ZLIB
+    if (compress_) {
+        // These dumps are large and written at exit, so favor speed: level 1
+        // already removes most of the redundancy in the sparse bitmaps.
+        gzfile_ = gzopen(path.c_str(), "wb1");
+        is_open_ = gzfile_ != nullptr;
+    } else
+#endif
+    {
+        compress_ = false;
+        file_ = fopen(path.c_str(), "wb");
+        is_open_ = file_ != nullptr;
+    }
+    if (!is_open_)
+        return;
+    buf_ = new unsigned char[BUFFER_SIZE];
+    unsigned char header[STATS_FILE_HEADER_SIZE];
+    memcpy(header, STATS_FILE_MAGIC, sizeof(STATS_FILE_MAGIC));
+    encode_u32(header + 8, STATS_FILE_VERSION);
+    encode_u32(header + 12, type);
+    encode_u32(header + 16, compress_ ? 1 : 0);
+    encode_u32(header + 20, param);
+    write_bytes(header, sizeof(header));
+}
+
+stats_file_writer_t::~stats_file_writer_t()
+{
+    if (!is_open_)
+        return;
+    flush();
+#ifdef HAS_ZLIB
+    if (gzfile_ != nullptr)
+        gzclose(gzfile_);
+#endif
+    if (file_ != nullptr)
+        fclose(file_);
+    delete[] buf_;
+}
+
+void
+stats_file_writer_t::write_bytes(const void *data, std::size_t size)
+{
+    const unsigned char *src = static_cast<const unsigned char *>(data);
+    while (size > 0) {
+        if (pos_ == BUFFER_SIZE)
+            flush();
+        const std::size_t chunk = std::min(size, BUFFER_SIZE - pos_);
+        memcpy(buf_ + pos_, src, chunk);
+        pos_ += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+}
+
+void
+stats_file_writer_t::flush()
+{
+    if (pos_ == 0 || !is_open_)
+        return;
+#ifdef HAS_ZLIB
+    if (gzfile_ != nullptr)
+        gzwrite(gzfile_, buf_, static_cast<unsigned int>(pos_));
+#endif
+    if (file_ != nullptr)
+        fwrite(buf_, 1, pos_, file_);
+    pos_ = 0;
+}
+
+stats_file_reader_t::stats_file_reader_t(const std::string &path)
+{
+    // gzread() passes uncompressed files through unchanged, so one path
+    // handles both.
+#ifdef HAS_ZLIB
+    file_ = gzopen(path.c_str(), "rb");
+#else
+    file_ = fopen(path.c_str(), "rb");
+#endif
+    if (file_ == nullptr) {
+        error_ = "failed to open " + path;
+        return;
+    }
+    buf_ = new unsigned char[BUFFER_SIZE];
+    unsigned char header[STATS_FILE_HEADER_SIZE];
+    if (!read_bytes(header, sizeof(header)) ||
+        memcmp(header, STATS_FILE_MAGIC, sizeof(STATS_FILE_MAGIC)) != 0) {
+        error_ = path + " is not a stats file";
+        return;
+    }
+    if (decode_u32(header + 8) != STATS_FILE_VERSION) {
+        error_ = path + " has unsupported version " +
+            std::to_string(decode_u32(header + 8));
+        return;
+    }
+    const std::uint32_t type = decode_u32(header + 12);
+    if (type != STATS_FILE_PAGE_USAGE && type != STATS_FILE_LINE_UTILIZATION &&
+        type != STATS_FILE_CHECKPOINT && type != STATS_FILE_MISS_STREAM) {
+        error_ = path + " has unknown type " + std::to_string(type);
+        return;
+    }
+#ifndef HAS_ZLIB
+    if (decode_u32(header + 16) != 0) {
+        error_ = path + " is compressed but zlib support is not available";
+        return;
+    }
+#endif
+    type_ = static_cast<stats_file_type_t>(type);
+    param_ = decode_u32(header + 20);
+    if (type_ == STATS_FILE_PAGE_USAGE && (param_ < 12 || param_ > 40))
+        error_ = path + " has invalid page size";
+}
+
+stats_file_reader_t::~stats_file_reader_t()
+{
+    if (file_ != nullptr) {
+#ifdef HAS_ZLIB
+        gzclose(file_);
+#else
+        fclose(file_);
+#endif
+    }
+    delete[] buf_;
+}
+
+bool
+stats_file_reader_t::fill()
+{
+#ifdef HAS_ZLIB
+    const int res = gzread(file_, buf_, static_cast<unsigned int>(BUFFER_SIZE));
+    len_ = res > 0 ? res : 0;
+#else
+    len_ = fread(buf_, 1, BUFFER_SIZE, file_);
+#endif
+    pos_ = 0;
+    return len_ > 0;
+}
+
+bool
+stats_file_reader_t::read_varint(std::uint64_t *value)
+{
+    std::uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos_ == len_ && !fill())
+            return false;
+        const unsigned char byte = buf_[pos_++];
+        result |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+stats_file_reader_t::read_bytes(void *data, std::size_t size)
+{
+    unsigned char *dst = static_cast<unsigned char *>(data);
+    while (size > 0) {
+        if (pos_ == len_ && !fill())
+            return false;
+        const std::size_t chunk = std::min(size, len_ - pos_);
+        memcpy(dst, buf_ + pos_, chunk);
+        pos_ += chunk;
+        dst += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+static inline std::uint64_t
+unzigzag(std::uint64_t value)
+{
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+bool
+stats_file_reader_t::read_miss_record(miss_record_t *record)
+{
+    std::uint64_t pc, addr, type, tid, timestamp;
+    if (!read_varint(&pc))
+        return false;
+    if (!read_varint(&addr) || !read_varint(&type) || !read_varint(&tid) ||
+        !read_varint(&timestamp)) {
+        error_ = "truncated miss record";
+        return false;
+    }
+    prev_miss_.pc += unzigzag(pc);
+    prev_miss_.addr += unzigzag(addr);
+    prev_miss_.type = static_cast<std::uint16_t>(type);
+    prev_miss_.tid += static_cast<std::int64_t>(unzigzag(tid));
+    prev_miss_.timestamp += timestamp;
+    *record = prev_miss_;
+    return true;
+}
+
+bool
+stats_file_reader_t::convert_to_text(std::ostream &out)
+{
+    if (!error_.empty())
+        return false;
+    if (type_ == STATS_FILE_CHECKPOINT) {
+        error_ = "a checkpoint has no text form";
+        return false;
+    }
+    if (type_ == STATS_FILE_PAGE_USAGE)
+        return convert_page_usage(out);
+    if (type_ == STATS_FILE_MISS_STREAM)
+        return convert_miss_stream(out);
+    return convert_line_utilization(out);
+}
+
+// Matches page_stats_impl::write() in text mode, which prints std::bitset
+// strings: most significant granule first.
+static void
+append_bits(std::string &line, const std::vector<unsigned char> &bitmap,
+            std::size_t num_bits)
+{
+    for (std::size_t i = num_bits; i-- > 0;)
+        line += ((bitmap[i >> 3] >> (i & 7)) & 1) ? '1' : '0';
+}
+
+bool
+stats_file_reader_t::convert_page_usage(std::ostream &out)
+{
+    const int page_bits = static_cast<int>(param_);
+    const std::size_t num_granules = static_cast<std::size_t>(1) << (page_bits - 6);
+    std::vector<unsigned char> read_bits(num_granules / 8), write_bits(num_granules / 8);
+    std::uint64_t page = 0, delta, counter;
+    bool first = true;
+    std::string line;
+    while (read_varint(&delta)) {
+        unsigned char type;
+        if (!read_varint(&counter) || !read_bytes(&type, 1) ||
+            !read_bytes(read_bits.data(), read_bits.size()) ||
+            !read_bytes(write_bits.data(), write_bits.size())) {
+            error_ = "truncated page record";
+            return false;
+        }
+        page = first ? delta : page - delta;
+        first = false;
+        out << "0x" << std::hex << (page << page_bits) << std::dec << ", " << counter
+            << ", " << page_type_names[type < 4 ? type : 0] << ", ";
+        line.clear();
+        append_bits(line, read_bits, num_granules);
+        line += ", ";
+        append_bits(line, write_bits, num_granules);
+        line += "\n";
+        out << line;
+    }
+    return true;
+}
+
+bool
+stats_file_reader_t::convert_line_utilization(std::ostream &out)
+{
+    const std::size_t length = param_;
+    std::uint64_t req_counter, pc, value, bytes_used, bytes_requested;
+    while (read_varint(&req_counter)) {
+        if (!read_varint(&pc)) {
+            error_ = "truncated utilization record";
+            return false;
+        }
+        out << "{{" << req_counter << ", " << pc << "},";
+        out << "{";
+        for (std::size_t index = 0; index < length; index++) {
+            if (!read_varint(&value)) {
+                error_ = "truncated utilization record";
+                return false;
+            }
+            out << value;
+            if (index < length - 1)
+                out << ", ";
+        }
+        if (!read_varint(&bytes_used) || !read_varint(&bytes_requested)) {
+            error_ = "truncated utilization record";
+            return false;
+        }
+        out << "}, " << ((double)bytes_used / (double)bytes_requested) << ", "
+            << bytes_used << ", " << bytes_requested << "},\n";
+    }
+    return true;
+}
+
+// The first two fields match the text -LL_miss_file lines.
+bool
+stats_file_reader_t::convert_miss_stream(std::ostream &out)
+{
+    miss_record_t record;
+    while (read_miss_record(&record)) {
+        out << "0x" << std::hex << record.pc << ",0x" << record.addr << std::dec << ","
+            << record.type << "," << record.tid << "," << record.timestamp << "\n";
+    }
+    return error_.empty();
+}
@@ -0,0 +1,250 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* stats_file: a versioned binary format for the page usage and line
+ * utilization dumps, optionally zlib-compressed, along with the reader
+ * used to convert it back into the text format.
+ *
+ * A file starts with a fixed header: the 8-byte magic "DRCSTATS" followed by
+ * four little-endian 32-bit fields: the format version, the file type
+ * (stats_file_type_t), whether the rest of the file is compressed and a
+ * type-specific parameter.  With compression the whole file, header
+ * included, is a gzip stream.  The records that follow are a sequence of
+ * LEB128 varints and packed bitmaps:
+ *
+ * STATS_FILE_PAGE_USAGE, parameter = log2 of the page size.  Per page,
+ * in decreasing address order:
+ *   varint   page number for the first page, else previous page number
+ *            minus this one
+ *   varint   access count
+ *   byte     page type: 0 unknown, 1 instructions, 2 data, 3 mixed
+ *   bitmap   read granules, one bit per 64 bytes, least significant first
+ *   bitmap   write granules
+ *
+ * STATS_FILE_LINE_UTILIZATION, parameter = line size in bytes.  Per
+ * snapshot:
+ *   varint   request count
+ *   varint   pc
+ *   varint   per-byte-offset use count, line size of them
+ *   varint   bytes used
+ *   varint   bytes requested
+ */
+
+#ifndef _STATS_FILE_H_
+#define _STATS_FILE_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#ifdef HAS_ZLIB
+#    include <zlib.h>
+#endif
+
+static const std::uint32_t STATS_FILE_VERSION = 1;
+
+enum stats_file_type_t {
+    STATS_FILE_PAGE_USAGE = 1,
+    STATS_FILE_LINE_UTILIZATION = 2,
+    // Simulator state written by -checkpoint_out, see cache_simulator_t.
+    STATS_FILE_CHECKPOINT = 3,
+    // Last-level cache misses written by -LL_miss_file in a binary format.
+    STATS_FILE_MISS_STREAM = 4,
+};
+
+// One miss in a STATS_FILE_MISS_STREAM.  The timestamp is the number of
+// accesses the cache had seen, warmup included, so it orders the misses and
+// spaces them by the references between them.
+struct miss_record_t {
+    std::uint64_t pc = 0;
+    std::uint64_t addr = 0;
+    std::uint16_t type = 0;
+    std::int64_t tid = 0;
+    std::uint64_t timestamp = 0;
+};
+
+// How the page usage and line utilization stats are written out.
+enum stats_format_t {
+    STATS_FORMAT_TEXT,
+    STATS_FORMAT_BINARY,
+    // Only available with HAS_ZLIB.
+    STATS_FORMAT_BINARY_GZ,
+};
+
+// Parses "text", "binary" or "binary_gz".  Returns false for anything else,
+// including "binary_gz" in a build without zlib.
+bool
+stats_format_from_string(const std::string &name, stats_format_t *format);
+
+// The file extension, including the dot, used for the given format.
+const char *
+stats_format_extension(stats_format_t format);
+
+class stats_file_writer_t {
+public:
+    stats_file_writer_t(const std::string &path, stats_file_type_t type,
+                        std::uint32_t param, bool compress);
+    ~stats_file_writer_t();
+
+    stats_file_writer_t(const stats_file_writer_t &) = delete;
+    stats_file_writer_t &
+    operator=(const stats_file_writer_t &) = delete;
+
+    bool
+    is_open() const
+    {
+        return is_open_;
+    }
+
+    inline void
+    write_varint(std::uint64_t value)
+    {
+        if (pos_ + MAX_VARINT_BYTES > BUFFER_SIZE)
+            flush();
+        while (value >= 0x80) {
+            buf_[pos_++] = static_cast<unsigned char>(value | 0x80);
+            value >>= 7;
+        }
+        buf_[pos_++] = static_cast<unsigned char>(value);
+    }
+
+    void
+    write_bytes(const void *data, std::size_t size);
+
+    // Appends a miss, delta-encoded against the previous one: consecutive
+    // misses mostly share a thread and have nearby pcs and addresses.
+    void
+    write_miss_record(const miss_record_t &record)
+    {
+        write_varint(zigzag(record.pc - prev_miss_.pc));
+        write_varint(zigzag(record.addr - prev_miss_.addr));
+        write_varint(record.type);
+        write_varint(zigzag(static_cast<std::uint64_t>(record.tid - prev_miss_.tid)));
+        write_varint(record.timestamp - prev_miss_.timestamp);
+        prev_miss_ = record;
+    }
+
+    // Writes the buffered data through to the file.
+    void
+    flush();
+
+private:
+    static const std::size_t BUFFER_SIZE = 64 * 1024;
+    static const std::size_t MAX_VARINT_BYTES = 10;
+
+    bool is_open_ = false;
+    bool compress_ = false;
+    FILE *file_ = nullptr;
+#ifdef HAS_ZLIB
+    gzFile gzfile_ = nullptr;
+#endif
+    unsigned char *buf_ = nullptr;
+    std::size_t pos_ = 0;
+    miss_record_t prev_miss_;
+
+    // Maps small negative deltas to small varints.
+    static inline std::uint64_t
+    zigzag(std::uint64_t delta)
+    {
+        return (delta << 1) ^ (0 - (delta >> 63));
+    }
+};
+
+class stats_file_reader_t {
+public:
+    // Opens and validates the header of path, compressed or not.
+    explicit stats_file_reader_t(const std::string &path);
+    ~stats_file_reader_t();
+
+    stats_file_reader_t(const stats_file_reader_t &) = delete;
+    stats_file_reader_t &
+    operator=(const stats_file_reader_t &) = delete;
+
+    // Returns the empty string if the file was opened successfully.
+    const std::string &
+    get_error() const
+    {
+        return error_;
+    }
+    stats_file_type_t
+    get_type() const
+    {
+        return type_;
+    }
+    std::uint32_t
+    get_param() const
+    {
+        return param_;
+    }
+
+    // Each returns false at the end of the file or on a truncated record.
+    bool
+    read_varint(std::uint64_t *value);
+    bool
+    read_bytes(void *data, std::size_t size);
+    // Reads the next miss of a STATS_FILE_MISS_STREAM.
+    bool
+    read_miss_record(miss_record_t *record);
+
+    // Writes the remaining records out in the text format the simulator
+    // produces when binary output is not requested.
+    bool
+    convert_to_text(std::ostream &out);
+
+private:
+    bool
+    fill();
+    bool
+    convert_page_usage(std::ostream &out);
+    bool
+    convert_line_utilization(std::ostream &out);
+    bool
+    convert_miss_stream(std::ostream &out);
+
+    static const std::size_t BUFFER_SIZE = 64 * 1024;
+
+    std::string error_;
+    stats_file_type_t type_ = STATS_FILE_PAGE_USAGE;
+    std::uint32_t param_ = 0;
+#ifdef HAS_ZLIB
+    gzFile file_ = nullptr;
+#else
+    FILE *file_ = nullptr;
+#endif
+    unsigned char *buf_ = nullptr;
+    std::size_t pos_ = 0;
+    std::size_t len_ = 0;
+    miss_record_t prev_miss_;
+};
+
+#endif /* _STATS_FILE_H_ */
@@ -0,0 +1,187 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "stats_writer.h"
+#include <algorithm>
+
+std::mutex stats_writer_t::instance_mutex_;
+stats_writer_t *stats_writer_t::instance_ = nullptr;
+int stats_writer_t::references_ = 0;
+
+stats_writer_t *
+stats_writer_t::acquire()
+{
+    std::lock_guard<std::mutex> guard(instance_mutex_);
+    if (instance_ == nullptr)
+        instance_ = new stats_writer_t();
+    references_++;
+    return instance_;
+}
+
+void
+stats_writer_t::release()
+{
+    stats_writer_t *writer;
+    {
+        std::lock_guard<std::mutex> guard(instance_mutex_);
+        if (references_ == 0 || --references_ > 0)
+            return;
+        writer = instance_;
+        instance_ = nullptr;
+    }
+    delete writer;
+}
+
+stats_writer_t::~stats_writer_t()
+{
+    if (started_) {
+        {
+            std::lock_guard<std::mutex> guard(wake_mutex_);
+            stop_ = true;
+        }
+        wake_cv_.notify_one();
+        thread_.join();
+    }
+}
+
+void
+stats_writer_t::start_locked()
+{
+    if (started_)
+        return;
+    started_ = true;
+    thread_ = std::thread(&stats_writer_t::thread_loop, this);
+}
+
+void
+stats_writer_t::add_source(const void *owner, std::function<bool()> drain)
+{
+    {
+        std::lock_guard<std::mutex> guard(sources_mutex_);
+        sources_.push_back({ owner, std::move(drain) });
+    }
+    std::lock_guard<std::mutex> guard(wake_mutex_);
+    start_locked();
+}
+
+void
+stats_writer_t::remove_source(const void *owner)
+{
+    std::function<bool()> drain;
+    {
+        std::lock_guard<std::mutex> guard(sources_mutex_);
+        auto it = std::find_if(sources_.begin(), sources_.end(),
+                               [owner](const source_t &s) { return s.owner == owner; });
+        if (it == sources_.end())
+            return;
+        drain = std::move(it->drain);
+        sources_.erase(it);
+    }
+    while (drain()) {
+    }
+}
+
+void
+stats_writer_t::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> guard(jobs_mutex_);
+        jobs_.push_back(std::move(job));
+    }
+    std::lock_guard<std::mutex> guard(wake_mutex_);
+    start_locked();
+    pending_ = true;
+    wake_cv_.notify_one();
+}
+
+void
+stats_writer_t::wake()
+{
+    // Pairs with the fence in thread_loop(): either the writer sees the work
+    // published before this call or this call sees the writer idle.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!idle_.load(std::memory_order_relaxed))
+        return;
+    std::lock_guard<std::mutex> guard(wake_mutex_);
+    pending_ = true;
+    wake_cv_.notify_one();
+}
+
+bool
+stats_writer_t::run_once()
+{
+    bool worked = false;
+    {
+        std::lock_guard<std::mutex> guard(sources_mutex_);
+        for (auto &source : sources_)
+            worked = source.drain() || worked;
+    }
+    while (true) {
+        std::function<void()> job;
+        {
+            std::lock_guard<std::mutex> guard(jobs_mutex_);
+            if (jobs_.empty())
+                break;
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        job();
+        worked = true;
+    }
+    return worked;
+}
+
+void
+stats_writer_t::thread_loop()
+{
+    while (true) {
+        if (run_once())
+            continue;
+        // Announce that we are going to sleep and then look for work once
+        // more.  A producer that published before seeing idle_ set is caught
+        // by that pass and one that publishes later sets pending_.
+        idle_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const bool worked = run_once();
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        if (!worked)
+            wake_cv_.wait(lock, [this] { return stop_ || pending_; });
+        pending_ = false;
+        idle_.store(false, std::memory_order_relaxed);
+        if (stop_)
+            break;
+    }
+    // Every producer is gone once stop_ is set, so one more pass picks up
+    // whatever they published after the last one.
+    while (run_once()) {
+    }
+}
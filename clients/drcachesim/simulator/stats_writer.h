@@ -0,0 +1,125 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* stats_writer: a background thread that formats, compresses and writes
+ * the simulator's statistics dumps so that the simulation threads never
+ * wait on the disk.
+ *
+ * Two kinds of work are handed to the thread.  A source is polled
+ * repeatedly; the caching device stats register one that drains the
+ * line utilization snapshots the simulation thread publishes into a
+ * small lock-free ring.  A job runs once; the page stats dumps, which
+ * happen at teardown, are submitted as jobs that own the data they write.
+ *
+ * The thread is shared by all users in the process, which hold a
+ * reference through acquire() and release().  It is started on first use
+ * and the last release() waits for all outstanding work to be written.
+ */
+
+#ifndef _STATS_WRITER_H_
+#define _STATS_WRITER_H_ 1
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class stats_writer_t {
+public:
+    // Returns the shared writer, creating it if needed.  Each call must be
+    // paired with a call to release().
+    static stats_writer_t *
+    acquire();
+    // Drops a reference.  The last one writes out everything pending and
+    // stops the thread.
+    static void
+    release();
+
+    // Registers drain, which is invoked repeatedly on the writer thread
+    // under owner until remove_source() and must return whether it wrote
+    // anything.
+    void
+    add_source(const void *owner, std::function<bool()> drain);
+    // Unregisters owner's source once it is not running and drains it one
+    // final time on the calling thread.
+    void
+    remove_source(const void *owner);
+
+    // Runs job once on the writer thread.
+    void
+    submit(std::function<void()> job);
+
+    // Called by a producer after publishing work.  It is cheap unless the
+    // writer thread is asleep.
+    void
+    wake();
+
+private:
+    stats_writer_t() = default;
+    ~stats_writer_t();
+
+    void
+    start_locked();
+    void
+    thread_loop();
+    bool
+    run_once();
+
+    struct source_t {
+        const void *owner;
+        std::function<bool()> drain;
+    };
+
+    std::thread thread_;
+    bool started_ = false;
+
+    std::mutex sources_mutex_;
+    std::vector<source_t> sources_;
+
+    std::mutex jobs_mutex_;
+    std::deque<std::function<void()>> jobs_;
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cv_;
+    std::atomic<bool> idle_ { false };
+    bool pending_ = false;
+    bool stop_ = false;
+
+    static std::mutex instance_mutex_;
+    static stats_writer_t *instance_;
+    static int references_;
+};
+
+#endif /* _STATS_WRITER_H_ */
@@ -0,0 +1,160 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "tag_match.h"
+
+#if defined(X64) && (defined(__GNUC__) || defined(__clang__))
+#    if defined(__x86_64__)
+#        include <immintrin.h>
+#        define TAG_MATCH_HAS_X86 1
+#    elif defined(__aarch64__)
+#        include <arm_neon.h>
+#        define TAG_MATCH_HAS_NEON 1
+#    endif
+#endif
+
+static std::uint64_t
+tag_match_scalar(const addr_t *tags, int num_ways, addr_t tag)
+{
+    std::uint64_t mask = 0;
+    for (int way = 0; way < num_ways; ++way) {
+        if (tags[way] == tag)
+            mask |= (std::uint64_t)1 << way;
+    }
+    return mask;
+}
+
+#ifdef TAG_MATCH_HAS_X86
+// pcmpeqq is technically SSE4.1, but we key off of SSE4.2 as that is what
+// every CPU with it that we care about advertises.
+__attribute__((target("sse4.2"))) static std::uint64_t
+tag_match_sse42(const addr_t *tags, int num_ways, addr_t tag)
+{
+    const __m128i needle = _mm_set1_epi64x((long long)tag);
+    std::uint64_t mask = 0;
+    int way = 0;
+    for (; way + 2 <= num_ways; way += 2) {
+        const __m128i set = _mm_loadu_si128((const __m128i *)(tags + way));
+        const __m128i eq = _mm_cmpeq_epi64(set, needle);
+        mask |= (std::uint64_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) << way;
+    }
+    if (way < num_ways && tags[way] == tag)
+        mask |= (std::uint64_t)1 << way;
+    return mask;
+}
+
+__attribute__((target("avx2"))) static std::uint64_t
+tag_match_avx2(const addr_t *tags, int num_ways, addr_t tag)
+{
+    const __m256i needle = _mm256_set1_epi64x((long long)tag);
+    std::uint64_t mask = 0;
+    int way = 0;
+    for (; way + 4 <= num_ways; way += 4) {
+        const __m256i set = _mm256_loadu_si256((const __m256i *)(tags + way));
+        const __m256i eq = _mm256_cmpeq_epi64(set, needle);
+        mask |= (std::uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << way;
+    }
+    for (; way < num_ways; ++way) {
+        if (tags[way] == tag)
+            mask |= (std::uint64_t)1 << way;
+    }
+    return mask;
+}
+#endif
+
+#ifdef TAG_MATCH_HAS_NEON
+static std::uint64_t
+tag_match_neon(const addr_t *tags, int num_ways, addr_t tag)
+{
+    const uint64x2_t needle = vdupq_n_u64(tag);
+    std::uint64_t mask = 0;
+    int way = 0;
+    for (; way + 2 <= num_ways; way += 2) {
+        const uint64x2_t eq = vceqq_u64(vld1q_u64((const uint64_t *)(tags + way)), needle);
+        mask |= (vgetq_lane_u64(eq, 0) & 1) << way;
+        mask |= (vgetq_lane_u64(eq, 1) & 1) << (way + 1);
+    }
+    if (way < num_ways && tags[way] == tag)
+        mask |= (std::uint64_t)1 << way;
+    return mask;
+}
+#endif
+
+tag_match_func_t
+tag_match_get_kernel(tag_match_kernel_t kernel)
+{
+#ifdef TAG_MATCH_HAS_X86
+    // We may be called from a static initializer ahead of libgcc's own.
+    __builtin_cpu_init();
+#endif
+    switch (kernel) {
+    case TAG_MATCH_SCALAR: return tag_match_scalar;
+#ifdef TAG_MATCH_HAS_X86
+    case TAG_MATCH_SSE42:
+        return __builtin_cpu_supports("sse4.2") ? tag_match_sse42 : nullptr;
+    case TAG_MATCH_AVX2:
+        return __builtin_cpu_supports("avx2") ? tag_match_avx2 : nullptr;
+#endif
+#ifdef TAG_MATCH_HAS_NEON
+    // NEON is part of the AArch64 baseline.
+    case TAG_MATCH_NEON: return tag_match_neon;
+#endif
+    default: return nullptr;
+    }
+}
+
+const char *
+tag_match_kernel_name(tag_match_kernel_t kernel)
+{
+    switch (kernel) {
+    case TAG_MATCH_SCALAR: return "scalar";
+    case TAG_MATCH_SSE42: return "sse4.2";
+    case TAG_MATCH_AVX2: return "avx2";
+    case TAG_MATCH_NEON: return "neon";
+    default: return "unknown";
+    }
+}
+
+static tag_match_func_t
+tag_match_select()
+{
+    static const tag_match_kernel_t preferred[] = { TAG_MATCH_AVX2, TAG_MATCH_NEON,
+                                                    TAG_MATCH_SSE42 };
+    for (tag_match_kernel_t kernel : preferred) {
+        tag_match_func_t func = tag_match_get_kernel(kernel);
+        if (func != nullptr)
+            return func;
+    }
+    return tag_match_scalar;
+}
+
+tag_match_func_t tag_match_ways = tag_match_select();
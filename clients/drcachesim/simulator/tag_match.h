@@ -0,0 +1,70 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* tag_match: compares a tag against every way of a set at once.
+ */
+
+#ifndef _TAG_MATCH_H_
+#define _TAG_MATCH_H_ 1
+
+#include <cstdint>
+#include "memref.h"
+
+// Returns a mask with bit i set iff tags[i] == tag, for 0 <= i < num_ways.
+// num_ways must be at most TAG_MATCH_MAX_WAYS.  tags need not be aligned.
+typedef std::uint64_t (*tag_match_func_t)(const addr_t *tags, int num_ways, addr_t tag);
+
+static const int TAG_MATCH_MAX_WAYS = 64;
+
+// Sets of at most this many ways are matched with an inline scalar loop,
+// which is as fast as any kernel there and avoids the indirect call.
+static const int TAG_MATCH_INLINE_WAYS = 8;
+
+enum tag_match_kernel_t {
+    TAG_MATCH_SCALAR,
+    TAG_MATCH_SSE42,
+    TAG_MATCH_AVX2,
+    TAG_MATCH_NEON,
+};
+
+// The fastest kernel supported by the host, chosen via CPUID at startup.
+extern tag_match_func_t tag_match_ways;
+
+// Returns the given kernel, or nullptr if this build or the host CPU does not
+// support it.  Intended for benchmarking and for cross-checking kernels.
+tag_match_func_t
+tag_match_get_kernel(tag_match_kernel_t kernel);
+
+const char *
+tag_match_kernel_name(tag_match_kernel_t kernel);
+
+#endif /* _TAG_MATCH_H_ */
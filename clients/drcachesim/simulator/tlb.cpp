@@ -31,8 +31,15 @@
  */
 
 #include "tlb.h"
+#include "tag_match.h"
 #include "../common/utils.h"
 #include <assert.h>
+#include <algorithm>
+
+tlb_t::~tlb_t()
+{
+    delete[] flat_pids_;
+}
 
 void
 tlb_t::init_blocks( const std::size_t line_size )
@@ -43,6 +50,48 @@ tlb_t::init_blocks( const std::size_t line_size )
     }
 }
 
+void
+tlb_t::init_flat_blocks()
+{
+    caching_device_t::init_flat_blocks();
+    flat_pids_ = new memref_pid_t[settings_.num_blocks]();
+}
+
+int
+tlb_t::find_tlb_way(int block_idx, addr_t tag, memref_pid_t pid)
+{
+    if (!use_flat_storage_) {
+        for (int way = 0; way < settings_.associativity; ++way) {
+            caching_device_block_t *tlb_entry = blocks_[block_idx + way];
+            if (tlb_entry->tag_ == tag && ((tlb_entry_t *)tlb_entry)->pid_ == pid)
+                return way;
+        }
+        return -1;
+    }
+    const addr_t *set_tags = flat_tags_ + block_idx;
+    if (tag_match_ == nullptr) {
+        for (int way = 0; way < settings_.associativity; ++way) {
+            if (set_tags[way] == tag && flat_pids_[block_idx + way] == pid)
+                return way;
+        }
+        return -1;
+    }
+    // Match the tags of the whole set at once, then check the pid of just
+    // the (typically zero or one) ways whose tag matched.
+    for (int base = 0; base < settings_.associativity; base += TAG_MATCH_MAX_WAYS) {
+        std::uint64_t mask = tag_match_(
+            set_tags + base, std::min(settings_.associativity - base, TAG_MATCH_MAX_WAYS),
+            tag);
+        while (mask != 0) {
+            const int way = base + __builtin_ctzll(mask);
+            if (flat_pids_[block_idx + way] == pid)
+                return way;
+            mask &= mask - 1;
+        }
+    }
+    return -1;
+}
+
 void
 tlb_t::request(const memref_t &memref_in)
 {
@@ -68,11 +117,10 @@ tlb_t::request(const memref_t &memref_in)
     // Optimization: check last tag and pid if single-block
     if (tag == final_tag && tag == last_tag_ && pid == last_pid_) {
         // Make sure last_tag_ and pid are properly in sync.
-        caching_device_block_t *tlb_entry =
-            &get_caching_device_block(last_block_idx_, last_way_);
-        assert(tag != TAG_INVALID && tag == tlb_entry->tag_ &&
-               pid == ((tlb_entry_t *)tlb_entry)->pid_);
-        record_access_stats(memref_in, true /*hit*/, tlb_entry);
+        assert(tag != TAG_INVALID && tag == get_block_tag(last_block_idx_, last_way_) &&
+               pid == get_block_pid(last_block_idx_, last_way_));
+        record_access_stats(memref_in, true /*hit*/,
+                            get_caching_device_block_ptr(last_block_idx_, last_way_));
         access_update(last_block_idx_, last_way_);
         return;
     }
@@ -85,28 +133,25 @@ tlb_t::request(const memref_t &memref_in)
         if (tag + 1 <= final_tag)
             memref.data.size = ((tag + 1) << block_size_bits_) - memref.data.addr;
 
-        for (way = 0; way < settings_.associativity; ++way) {
-            caching_device_block_t *tlb_entry = &get_caching_device_block(block_idx, way);
-            if (tlb_entry->tag_ == tag && ((tlb_entry_t *)tlb_entry)->pid_ == pid) {
-                record_access_stats(memref, true /*hit*/, tlb_entry);
-                break;
-            }
+        way = find_tlb_way(block_idx, tag, pid);
+        if (way >= 0) {
+            record_access_stats(memref, true /*hit*/,
+                                get_caching_device_block_ptr(block_idx, way));
         }
-
-        if( way == settings_.associativity ) 
+        else
         {
             way = replace_which_way(block_idx);
-            caching_device_block_t *tlb_entry = &get_caching_device_block(block_idx, way);
 
-            record_access_stats(memref, false /*miss*/, tlb_entry);
+            record_access_stats(memref, false /*miss*/,
+                                get_caching_device_block_ptr(block_idx, way));
             // If no parent we assume we get the data from main memory
             if (parent_ != NULL)
                 parent_->request(memref);
 
             // XXX: do we need to handle TLB coherency?
 
-            tlb_entry->tag_ = tag;
-            ((tlb_entry_t *)tlb_entry)->pid_ = pid;
+            get_block_tag(block_idx, way) = tag;
+            get_block_pid(block_idx, way) = pid;
         }
 
         access_update(block_idx, way);
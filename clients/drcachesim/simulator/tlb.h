@@ -43,6 +43,8 @@
 
 class tlb_t : public caching_device_t {
 public:
+    virtual ~tlb_t();
+
     void
     request(const memref_t &memref) override;
 
@@ -62,6 +64,24 @@ protected:
     void
     init_blocks( const std::size_t line_size ) override;
 
+    void
+    init_flat_blocks() override;
+
+    inline memref_pid_t &
+    get_block_pid(int block_idx, int way)
+    {
+        if (use_flat_storage_)
+            return flat_pids_[block_idx + way];
+        return ((tlb_entry_t *)blocks_[block_idx + way])->pid_;
+    }
+
+    // Returns the way of the set at block_idx holding both tag and pid, or -1.
+    int
+    find_tlb_way(int block_idx, addr_t tag, memref_pid_t pid);
+
+    // Side array of pids for flat block storage.
+    memref_pid_t *flat_pids_ = nullptr;
+
     // Optimization: remember last pid in addition to last tag
     memref_pid_t last_pid_;
 
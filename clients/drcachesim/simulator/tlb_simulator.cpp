@@ -87,6 +87,10 @@ tlb_simulator_t::tlb_simulator_t( tlb_simulator_knobs_t *knobs )
             return;
         }
 
+        itlbs_[i]->set_flat_storage_use(knobs_->flat_block_storage);
+        dtlbs_[i]->set_flat_storage_use(knobs_->flat_block_storage);
+        lltlbs_[i]->set_flat_storage_use(knobs_->flat_block_storage);
+
         if (!itlbs_[i]->init(   tlb_device_settings_t( knobs_->TLB_L1I_assoc, 
                                                        knobs_->page_size,
                                                        knobs_->TLB_L1I_entries, 
@@ -207,6 +211,7 @@ tlb_simulator_t::process_memref(const memref_t &memref)
         knobs_->warmup_refs--;
         // reset tlb stats when warming up is completed
         if (knobs_->warmup_refs == 0) {
+            report_child_hits();
             for (unsigned int i = 0; i < knobs_->num_cores; i++) {
                 itlbs_[i]->get_stats()->reset();
                 dtlbs_[i]->get_stats()->reset();
@@ -219,9 +224,20 @@ tlb_simulator_t::process_memref(const memref_t &memref)
     return true;
 }
 
+void
+tlb_simulator_t::report_child_hits() const
+{
+    for (unsigned int i = 0; i < knobs_->num_cores; i++) {
+        itlbs_[i]->report_child_hits();
+        dtlbs_[i]->report_child_hits();
+        lltlbs_[i]->report_child_hits();
+    }
+}
+
 bool
 tlb_simulator_t::print_results()
 {
+    report_child_hits();
     std::cerr << "TLB simulation results:\n";
     for (unsigned int i = 0; i < knobs_->num_cores; i++) {
         if (thread_ever_counts_[i] > 0) 
@@ -60,6 +60,11 @@ protected:
     virtual tlb_t *
     create_tlb(std::string policy);
 
+    // Credits each TLB's hits to its ancestors' child hits, which must be
+    // done before they are read or reset.
+    void
+    report_child_hits() const;
+
     tlb_simulator_knobs_t *knobs_ = nullptr;
 
     // Each CPU core contains a L1 ITLB, L1 DTLB and L2 TLB.
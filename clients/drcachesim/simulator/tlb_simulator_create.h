@@ -68,6 +68,7 @@ struct tlb_simulator_knobs_t : simulator_knobs_t
     unsigned int    TLB_L2_entries      = 1024;
     unsigned int    TLB_L2_assoc        = 4;
     std::string     TLB_replace_policy  = "LFU";
+    bool            flat_block_storage  = false;
 };
 
 /** Creates an instance of a TLB simulator. */
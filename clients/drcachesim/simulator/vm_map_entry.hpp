@@ -61,7 +61,7 @@ struct vm_maps_entry_t
     std::uint32_t   maj_dev = 0;
     std::uint32_t   min_dev = 0;
     std::uint64_t   inode   = 0;
-    char            pathname[ PATH_MAX /** use linux vs. POSIX path length **/ ];
+    char            pathname[ PATH_MAX /** use linux vs. POSIX path length **/ ] = { '\0' };
     /** this one is derived (end-start)+1 **/
     address_t       addy_range = 0;
 
@@ -0,0 +1,122 @@
+/**
+ * vm_region_index.hpp - 
+ * @author: Jonathan Beard
+ * @version: Sat Oct 17 09:12:40 2026
+ * 
+ * Copyright 2026 Jonathan Beard
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef VM_REGION_INDEX_HPP
+#define VM_REGION_INDEX_HPP  1
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "vm_map_db.hpp"
+#include "vm_map_entry.hpp"
+
+/**
+ * vm_region_index - flat sorted copy of the intervals in a 
+ * vm_maps_db_t for per-reference lookups. Consecutive references
+ * nearly always fall in the same mapping, so the last hit is 
+ * checked before falling back to a binary search, which keeps 
+ * the lookup O(1) amortized without touching the std::map.
+ */
+class vm_region_index
+{
+public:
+    using address_t = vm_maps_entry_t::address_t;
+
+    /** returned by find() for an address outside every mapping **/
+    static constexpr std::size_t npos = ~static_cast< std::size_t >( 0 );
+
+    struct region_t
+    {
+        address_t        start  = 0;
+        /** exclusive, as in /proc/<id>/maps **/
+        address_t        end    = 0;
+        vm_maps_entry_t *entry  = nullptr;
+    };
+
+    vm_region_index() = default;
+
+    /**
+     * build - replace the index with the mappings in db, which
+     * stays the owner of the entries.
+     * @param db - mappings keyed by start address
+     */
+    void build( const vm_maps_db_t &db )
+    {
+        regions.clear();
+        regions.reserve( db.size() );
+        for( const auto &pair : db )
+        {
+            region_t r;
+            r.start = pair.second->start;
+            r.end   = pair.second->end;
+            r.entry = pair.second;
+            regions.push_back( r );
+        }
+        last_hit = 0;
+    }
+
+    /**
+     * find - index of the mapping containing address, or npos.
+     */
+    inline std::size_t find( const address_t address )
+    {
+        if( last_hit < regions.size() && 
+            ( address - regions[ last_hit ].start ) < 
+                ( regions[ last_hit ].end - regions[ last_hit ].start ) )
+        {
+            return( last_hit );
+        }
+        /** first region starting above address, ours is the one before **/
+        auto it = std::upper_bound( regions.begin(), 
+                                    regions.end(), 
+                                    address,
+                                    []( const address_t a, const region_t &r )
+                                    {
+                                        return( a < r.start );
+                                    } );
+        if( it == regions.begin() )
+        {
+            return( npos );
+        }
+        --it;
+        if( address >= it->end )
+        {
+            return( npos );
+        }
+        last_hit = static_cast< std::size_t >( it - regions.begin() );
+        return( last_hit );
+    }
+
+    const region_t& operator []( const std::size_t index ) const
+    {
+        return( regions[ index ] );
+    }
+
+    std::size_t size() const
+    {
+        return( regions.size() );
+    }
+
+private:
+    std::vector< region_t > regions;
+    std::size_t             last_hit = 0;
+};
+
+#endif /* END VM_REGION_INDEX_HPP */
@@ -30,10 +30,13 @@
  * DAMAGE.
  */
 
+#include <cstdio>
 #include <iostream>
+#include <string>
 
 #include "../simulator/cache_miss_analyzer.h"
 #include "../simulator/cache_simulator.h"
+#include "../simulator/stats_file.h"
 #include "../common/memref.h"
 
 static memref_t
@@ -62,7 +65,7 @@ no_dominant_stride()
     knobs.data_prefetcher = "none";
 
     // Create the cache miss analyzer object.
-    cache_miss_analyzer_t analyzer(knobs, 1000, 0.01, 0.75);
+    cache_miss_analyzer_t analyzer(&knobs, 1000, 0.01, 0.75);
 
     // Analyze a stream of memory load references with no dominant stride.
     addr_t addr = 0x1000;
@@ -105,7 +108,7 @@ one_dominant_stride()
     knobs.data_prefetcher = "none";
 
     // Create the cache miss analyzer object.
-    cache_miss_analyzer_t analyzer(knobs, 1000, 0.01, 0.75);
+    cache_miss_analyzer_t analyzer(&knobs, 1000, 0.01, 0.75);
 
     // Analyze a stream of memory load references with one dominant stride.
     addr_t addr = 0x1000;
@@ -159,7 +162,7 @@ two_dominant_strides()
     knobs.data_prefetcher = "none";
 
     // Create the cache miss analyzer object.
-    cache_miss_analyzer_t analyzer(knobs, 1000, 0.01, 0.75);
+    cache_miss_analyzer_t analyzer(&knobs, 1000, 0.01, 0.75);
 
     // Analyze a stream of memory load references with two dominant strides.
     addr_t addr1 = 0x1000;
@@ -206,10 +209,71 @@ two_dominant_strides()
     }
 }
 
+// A test reading one dominant stride back from a binary miss stream.
+bool
+one_dominant_stride_from_miss_stream()
+{
+    const int kStride = 5;
+    const unsigned int kLineSize = 64;
+    const std::string kPath = "miss_analyzer_test_misses.bin";
+
+    // Write the misses of two loads, one of them with a dominant stride,
+    // as the simulator does for -LL_miss_file with a binary -stats_format.
+    {
+        stats_file_writer_t writer(kPath, STATS_FILE_MISS_STREAM, 0, false);
+        if (!writer.is_open()) {
+            std::cerr << "one_dominant_stride_from_miss_stream test failed: "
+                      << "cannot write " << kPath << std::endl;
+            return false;
+        }
+        miss_record_t record;
+        record.type = TRACE_TYPE_READ;
+        record.tid = 22222;
+        addr_t addr = 0x100000;
+        unsigned int seed = 1;
+        for (int i = 0; i < 20000; ++i) {
+            record.pc = 0xAAAA;
+            record.addr = addr;
+            record.timestamp += 10;
+            writer.write_miss_record(record);
+            addr += kLineSize * kStride;
+            record.pc = 0xBBBB;
+            seed = seed * 1103515245 + 12345;
+            record.addr = 0x900000 + ((seed >> 16) % 4096) * kLineSize;
+            record.timestamp += 3;
+            writer.write_miss_record(record);
+        }
+    }
+
+    cache_simulator_knobs_t knobs;
+    knobs.line_size = kLineSize;
+    knobs.LL_size = 1024 * 1024;
+    knobs.data_prefetcher = "none";
+    cache_miss_analyzer_t analyzer(&knobs, 1000, 0.01, 0.75);
+    if (!analyzer.analyze_miss_stream(kPath)) {
+        std::cerr << "one_dominant_stride_from_miss_stream test failed: "
+                  << analyzer.get_error_string() << std::endl;
+        return false;
+    }
+    std::remove(kPath.c_str());
+
+    std::vector<prefetching_recommendation_t *> recommendations =
+        analyzer.generate_recommendations();
+    if (recommendations.size() == 1 && recommendations[0]->pc == 0xAAAA &&
+        recommendations[0]->stride == (kStride * kLineSize)) {
+        std::cout << "one_dominant_stride_from_miss_stream test passed." << std::endl;
+        return true;
+    }
+    std::cerr << "one_dominant_stride_from_miss_stream test failed: "
+              << recommendations.size() << " recommendations" << std::endl;
+    return false;
+}
+
 int
 main(int argc, const char *argv[])
 {
-    if (no_dominant_stride() && one_dominant_stride() && two_dominant_strides()) {
+    if (no_dominant_stride() && one_dominant_stride() && two_dominant_strides() &&
+        one_dominant_stride_from_miss_stream()) {
         return 0;
     } else {
         std::cerr << "cache_miss_analyzer_test failed" << std::endl;
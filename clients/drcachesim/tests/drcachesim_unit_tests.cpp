@@ -32,9 +32,25 @@
 
 // Unit tests for drcachesim
 #include <iostream>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
 #include <assert.h>
+#ifdef HAS_ZLIB
+#    include <zlib.h>
+#endif
+#include "simulator/cache.h"
+#include "simulator/cache_lru.h"
+#include "simulator/cache_plru.h"
 #include "simulator/cache_simulator.h"
+#include "simulator/cache_stats.h"
+#include "simulator/snoop_filter.h"
+#include "simulator/stats_file.h"
 #include "../common/memref.h"
 
 static cache_simulator_knobs_t
@@ -52,12 +68,780 @@ make_test_knobs()
     return knobs;
 }
 
+// Feeds sim count references from a fixed mix of instruction fetches, a hot
+// data set, a streaming array and scattered heap accesses.
+static void
+run_mixed_trace(cache_simulator_t &sim, int count, std::uint32_t seed = 1)
+{
+    addr_t pc = 0x400000;
+    addr_t stream = 0x20000000;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        const std::uint32_t r = seed >> 8;
+        memref_t ref = {};
+        ref.data.pid = 4321;
+        ref.data.tid = 4321;
+        ref.data.size = 8;
+        ref.data.pc = pc;
+        if (r % 4 == 0) {
+            ref.data.type = TRACE_TYPE_INSTR;
+            ref.data.size = 4;
+            // Mostly straight-line code with the odd jump.
+            pc = r % 32 == 0 ? 0x400000 + (r >> 12) % 0x8000 : pc + 4;
+            ref.data.addr = pc;
+        } else {
+            ref.data.type = r % 3 == 0 ? TRACE_TYPE_WRITE : TRACE_TYPE_READ;
+            if (r % 8 < 5)
+                ref.data.addr = 0x10000000 + (r >> 10) % 0x4000;
+            else if (r % 8 < 7) {
+                ref.data.addr = stream;
+                stream += 24;
+            } else
+                ref.data.addr = 0x30000000 + ((addr_t)(r >> 4) << 6) % 0x1000000;
+        }
+        if (!sim.process_memref(ref)) {
+            std::cerr << "drcachesim run_mixed_trace failed: " << sim.get_error_string()
+                      << "\n";
+            exit(1);
+        }
+    }
+}
+
+static std::string
+read_file(const std::string &path)
+{
+    std::ifstream in(path);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+void
+unit_test_flat_block_storage()
+{
+    // The flat structure-of-arrays block storage must behave exactly like the
+    // per-block objects it replaces, utilization tracking included.
+    const metric_name_t metrics[] = {
+        metric_name_t::HITS,           metric_name_t::MISSES,
+        metric_name_t::HITS_AT_RESET,  metric_name_t::MISSES_AT_RESET,
+        metric_name_t::COMPULSORY_MISSES, metric_name_t::CHILD_HITS,
+        metric_name_t::CHILD_HITS_AT_RESET, metric_name_t::INCLUSIVE_INVALIDATES,
+        metric_name_t::COHERENCE_INVALIDATES, metric_name_t::PREFETCH_HITS,
+        metric_name_t::PREFETCH_MISSES, metric_name_t::FLUSHES,
+    };
+    for (const std::string policy : { "LRU", "FIFO", "LFU" }) {
+        std::vector<int_least64_t> results[2];
+        std::string utilization[2];
+        for (int flat = 0; flat < 2; flat++) {
+            const std::string dir =
+                "unit_test_flat_block_storage_" + policy + std::to_string(flat);
+            {
+                cache_simulator_knobs_t knobs = make_test_knobs();
+                knobs.L1I_size = 4 * 1024;
+                knobs.L1D_size = 4 * 1024;
+                knobs.L1I_assoc = 4;
+                knobs.L1D_assoc = 4;
+                knobs.LL_size = 64 * 1024;
+                knobs.LL_assoc = 8;
+                knobs.data_prefetcher = "nextline";
+                knobs.replace_policy = policy;
+                knobs.warmup_refs = 1000;
+                knobs.op_cache_line_utilization = true;
+                knobs.flat_block_storage = flat != 0;
+                knobs.stats_dir = dir;
+                cache_simulator_t cache_sim(&knobs);
+                run_mixed_trace(cache_sim, 200000);
+                for (const auto metric : metrics) {
+                    for (const auto split :
+                         { cache_split_t::DATA, cache_split_t::INSTRUCTION }) {
+                        results[flat].push_back(
+                            cache_sim.get_cache_metric(metric, 1, 0, split));
+                    }
+                    results[flat].push_back(cache_sim.get_cache_metric(metric, 2));
+                }
+            }
+            // The histograms are complete once the simulator is gone.
+            for (const std::string name : { "L1_I_Cache_0", "L1_D_Cache_0", "LL" })
+                utilization[flat] += read_file(dir + "/" + name + ".dat");
+        }
+        if (results[0] != results[1] || utilization[0] != utilization[1] ||
+            utilization[0].empty()) {
+            std::cerr << "drcachesim unit_test_flat_block_storage failed for " << policy
+                      << "\n";
+            exit(1);
+        }
+    }
+}
+
+// Records the ways a replacement policy picks, for fills and evictions alike.
+template <class policy_t> class victim_log_t : public policy_t {
+public:
+    std::vector<int> victims;
+
+protected:
+    int
+    replace_which_way(int line_idx) override
+    {
+        const int way = policy_t::replace_which_way(line_idx);
+        victims.push_back(way);
+        return way;
+    }
+};
+
+// An access to a line of a single-set cache, or, if invalidate is set, an
+// inclusive invalidation of it.
+struct line_access_t {
+    addr_t line;
+    bool invalidate;
+};
+
+// Returns the ways a single-set cache of the given policy and associativity
+// picks for accesses.
+template <class policy_t>
+static std::vector<int>
+replay_victims(int assoc, bool flat, const std::vector<line_access_t> &accesses)
+{
+    const int line_size = 64;
+    cache_stats_t stats("", "victims", false, line_size);
+    victim_log_t<policy_t> cache;
+    cache.set_flat_storage_use(flat);
+    if (!cache.init(cache_settings_t(assoc, line_size, assoc * line_size, false, nullptr),
+                    nullptr, &stats, nullptr)) {
+        std::cerr << "drcachesim replay_victims failed to init a " << assoc
+                  << "-way cache\n";
+        exit(1);
+    }
+    memref_t ref = {};
+    ref.data.type = TRACE_TYPE_READ;
+    ref.data.size = 1;
+    for (const line_access_t &access : accesses) {
+        if (access.invalidate)
+            cache.invalidate(access.line, INVALIDATION_INCLUSIVE);
+        else {
+            ref.data.addr = access.line * line_size;
+            cache.request(ref);
+        }
+    }
+    return cache.victims;
+}
+
+static std::vector<line_access_t>
+read_lines(const std::vector<addr_t> &lines)
+{
+    std::vector<line_access_t> accesses;
+    for (addr_t line : lines)
+        accesses.push_back({ line, false });
+    return accesses;
+}
+
+static void
+check_victims(const char *test, const char *what, int assoc,
+              const std::vector<int> &victims, const std::vector<int> &expect)
+{
+    if (victims != expect) {
+        std::cerr << "drcachesim " << test << " failed: " << what << " at " << assoc
+                  << " ways picked";
+        for (int way : victims)
+            std::cerr << " " << way;
+        std::cerr << "\n";
+        exit(1);
+    }
+}
+
+// The counter LRU that the packed ages replaced: the most recent line has
+// count 0, a hit ages the lines not older than it, and the victim is the
+// lowest empty way, else the lowest way of the largest count.  A filled or
+// invalidated way restarts at 0 without aging the others.
+static std::vector<int>
+reference_lru_victims(int assoc, const std::vector<line_access_t> &accesses)
+{
+    std::vector<addr_t> tags(assoc, TAG_INVALID);
+    std::vector<int> counters(assoc);
+    for (int way = 0; way < assoc; ++way)
+        counters[way] = way;
+    std::vector<int> victims;
+    for (const line_access_t &access : accesses) {
+        int way = 0;
+        while (way < assoc && tags[way] != access.line)
+            ++way;
+        if (access.invalidate) {
+            if (way < assoc) {
+                tags[way] = TAG_INVALID;
+                counters[way] = 0;
+            }
+            continue;
+        }
+        if (way == assoc) {
+            int max_counter = 0;
+            way = 0;
+            for (int i = 0; i < assoc; ++i) {
+                if (tags[i] == TAG_INVALID) {
+                    way = i;
+                    break;
+                }
+                if (counters[i] > max_counter) {
+                    max_counter = counters[i];
+                    way = i;
+                }
+            }
+            victims.push_back(way);
+            tags[way] = access.line;
+            counters[way] = 0;
+        }
+        const int cnt = counters[way];
+        if (cnt == 0)
+            continue;
+        for (int i = 0; i < assoc; ++i) {
+            if (i != way && counters[i] <= cnt)
+                counters[i]++;
+        }
+        counters[way] = 0;
+    }
+    return victims;
+}
+
+void
+unit_test_lru_victims()
+{
+    // 4 and 16 ways keep their ages packed, 256 keeps them in the counters.
+    for (int assoc : { 4, 16, 256 }) {
+        for (int flat = 0; flat < 2; flat++) {
+            // Filling the set takes the ways in order.  Every line then has
+            // count 0, so hits reorder nothing and misses take the lowest way,
+            // until invalidations open up ways to fill first, lowest first.
+            std::vector<line_access_t> accesses;
+            std::vector<int> expect;
+            for (int i = 0; i < assoc; i++) {
+                accesses.push_back({ (addr_t)i, false });
+                expect.push_back(i);
+            }
+            for (int i = assoc - 1; i >= 0; i--)
+                accesses.push_back({ (addr_t)i, false });
+            accesses.push_back({ (addr_t)assoc, false });
+            expect.push_back(0);
+            accesses.push_back({ (addr_t)assoc - 1, true });
+            accesses.push_back({ 1, true });
+            for (int i = 1; i <= 4; i++)
+                accesses.push_back({ (addr_t)(assoc + i), false });
+            expect.insert(expect.end(), { 1, assoc - 1, 0, 0 });
+            check_victims("unit_test_lru_victims", "known sequence", assoc,
+                          replay_victims<cache_lru_t>(assoc, flat != 0, accesses),
+                          expect);
+            check_victims("unit_test_lru_victims", "reference on known sequence",
+                          assoc, reference_lru_victims(assoc, accesses), expect);
+
+            // A random mix of hits, misses and invalidations over twice the
+            // set's lines must match the counter LRU.
+            accesses.clear();
+            std::uint32_t seed = assoc;
+            for (int i = 0; i < 40 * assoc; i++) {
+                seed = seed * 1103515245 + 12345;
+                const std::uint32_t r = seed >> 8;
+                accesses.push_back({ (addr_t)((r >> 4) % (2 * assoc)), r % 16 == 0 });
+            }
+            check_victims("unit_test_lru_victims", "random sequence", assoc,
+                          replay_victims<cache_lru_t>(assoc, flat != 0, accesses),
+                          reference_lru_victims(assoc, accesses));
+        }
+    }
+}
+
+// Returns way with its log2(assoc) bits reversed.
+static int
+reverse_way_bits(int way, int assoc)
+{
+    int reversed = 0;
+    for (int bit = 1; bit < assoc; bit <<= 1) {
+        reversed = 2 * reversed + (way & 1);
+        way >>= 1;
+    }
+    return reversed;
+}
+
+void
+unit_test_plru_victims()
+{
+    // 256 ways span several words of tree nodes per set.
+    for (int assoc : { 4, 16, 256 }) {
+        for (int flat = 0; flat < 2; flat++) {
+            // After an in-order fill every node points at its lower half.  Each
+            // replacement then flips the nodes on its path, so successive
+            // misses visit the ways in bit-reversed order: for 4 ways, 0 2 1 3.
+            std::vector<addr_t> lines;
+            std::vector<int> expect;
+            for (int i = 0; i < assoc; i++) {
+                lines.push_back(i);
+                expect.push_back(i);
+            }
+            for (int i = 0; i < assoc; i++) {
+                lines.push_back(assoc + i);
+                expect.push_back(reverse_way_bits(i, assoc));
+            }
+            check_victims("unit_test_plru_victims", "miss sequence", assoc,
+                          replay_victims<cache_plru_t>(assoc, flat != 0,
+                                                       read_lines(lines)),
+                          expect);
+
+            // A hit points the tree away from its way: hitting way 0 after the
+            // fill moves the victim to the upper half, and hitting that victim
+            // in turn moves it to the next way of the bit-reversed order.
+            lines.resize(assoc);
+            expect.resize(assoc);
+            lines.insert(lines.end(),
+                         { 0, (addr_t)assoc / 2, (addr_t)assoc, (addr_t)assoc + 1 });
+            expect.insert(expect.end(), { assoc / 4, 3 * assoc / 4 });
+            check_victims("unit_test_plru_victims", "hit sequence", assoc,
+                          replay_victims<cache_plru_t>(assoc, flat != 0,
+                                                       read_lines(lines)),
+                          expect);
+        }
+    }
+}
+
+// Reads a file that may be gzip-compressed, as the text miss file is when
+// zlib is available.
+static std::string
+read_maybe_gz_file(const std::string &path)
+{
+#ifdef HAS_ZLIB
+    std::string contents;
+    gzFile file = gzopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return contents;
+    char buf[4096];
+    int len;
+    while ((len = gzread(file, buf, sizeof(buf))) > 0)
+        contents.append(buf, len);
+    gzclose(file);
+    return contents;
+#else
+    return read_file(path);
+#endif
+}
+
+// Returns the text form of a binary stats or miss file, as stats2text prints it.
+static std::string
+convert_stats_file(const std::string &path)
+{
+    stats_file_reader_t reader(path);
+    std::stringstream text;
+    if (!reader.get_error().empty() || !reader.convert_to_text(text)) {
+        std::cerr << "drcachesim failed to convert " << path << ": "
+                  << reader.get_error() << "\n";
+        exit(1);
+    }
+    return text.str();
+}
+
+void
+unit_test_binary_stats_format()
+{
+    // Every binary stream must convert back to exactly what -stats_format text
+    // writes.  The text miss file carries only the pc and address, so the miss
+    // stream is compared on those two fields.
+    const std::string names[] = {
+        "L1_I_Cache_0",           "L1_D_Cache_0",           "LL",
+        "page_usage_unfiltered_4KiB", "page_usage_unfiltered_64KiB",
+        "page_usage_unfiltered_1MiB", "ll_cache_usage_4KiB",
+        "ll_cache_usage_64KiB",   "ll_cache_usage_1MiB",
+    };
+    std::string text_miss;
+    for (const std::string format : { "text", "binary", "binary_gz" }) {
+        const std::string dir = "unit_test_binary_stats_format_" + format;
+        const std::string miss_file = dir + "_misses";
+        {
+            cache_simulator_knobs_t knobs = make_test_knobs();
+            knobs.L1I_size = 4 * 1024;
+            knobs.L1D_size = 4 * 1024;
+            knobs.L1I_assoc = 4;
+            knobs.L1D_assoc = 4;
+            knobs.LL_size = 64 * 1024;
+            knobs.LL_assoc = 8;
+            knobs.op_cache_line_utilization = true;
+            knobs.stats_dir = dir;
+            knobs.stats_format = format;
+            knobs.LL_miss_file = miss_file;
+            cache_simulator_t cache_sim(&knobs);
+            run_mixed_trace(cache_sim, 200000);
+        }
+        if (format == "text") {
+            text_miss = read_maybe_gz_file(miss_file);
+            continue;
+        }
+        const std::string suffix = format == "binary" ? ".bin" : ".bin.gz";
+        for (const std::string name : names) {
+            const std::string text = read_file("unit_test_binary_stats_format_text/" +
+                                               name + ".dat");
+            if (text.empty() || convert_stats_file(dir + "/" + name + suffix) != text) {
+                std::cerr << "drcachesim unit_test_binary_stats_format failed for "
+                          << format << " " << name << "\n";
+                exit(1);
+            }
+        }
+        std::istringstream records(convert_stats_file(miss_file));
+        std::string misses;
+        std::string line;
+        while (std::getline(records, line))
+            misses += line.substr(0, line.find(',', line.find(',') + 1)) + "\n";
+        if (text_miss.empty() || misses != text_miss) {
+            std::cerr << "drcachesim unit_test_binary_stats_format failed for " << format
+                      << " misses\n";
+            exit(1);
+        }
+    }
+}
+
+// Exposes the snoop filter's counters and directory to the coherence test.
+class test_snoop_filter_t : public snoop_filter_t {
+public:
+    int_least64_t
+    writes() const
+    {
+        return num_writes_;
+    }
+    int_least64_t
+    invalidates() const
+    {
+        return num_invalidates_;
+    }
+    int_least64_t
+    writebacks() const
+    {
+        return num_writebacks_;
+    }
+    int_least64_t
+    directory_evictions() const
+    {
+        return num_directory_evictions_;
+    }
+    uint64_t
+    entries() const
+    {
+        return num_entries_;
+    }
+    bool
+    has_entry(addr_t tag) const
+    {
+        return slot_tag(find_slot(tag)) == tag;
+    }
+    // Returns the slot tag sits in, or -1.
+    int
+    entry_slot(addr_t tag) const
+    {
+        const size_t slot = find_slot(tag);
+        return slot_tag(slot) == tag ? (int)slot : -1;
+    }
+    // Returns count tags after first that share its home slot.
+    std::vector<addr_t>
+    colliding_tags(addr_t first, int count) const
+    {
+        std::vector<addr_t> tags;
+        for (addr_t tag = first + 1; (int)tags.size() < count; tag++) {
+            if (home_slot(tag) == home_slot(first))
+                tags.push_back(tag);
+        }
+        return tags;
+    }
+};
+
+// Records the coherence invalidations the snoop filter sends to a cache.
+class invalidation_log_t : public cache_t {
+public:
+    void
+    invalidate(addr_t tag, invalidation_type_t invalidation_type) override
+    {
+        if (invalidation_type == INVALIDATION_COHERENCE)
+            tags.push_back(tag);
+    }
+    std::vector<addr_t> tags;
+};
+
+static void
+check_snoop_filter(bool ok, const char *what)
+{
+    if (!ok) {
+        std::cerr << "drcachesim unit_test_snoop_filter failed: " << what << "\n";
+        exit(1);
+    }
+}
+
+void
+unit_test_snoop_filter()
+{
+    invalidation_log_t log[2];
+    cache_t *caches[2] = { &log[0], &log[1] };
+    {
+        // An unbounded directory: a write invalidates the other sharer, and a
+        // dirty line is written back when another cache reads it or when its
+        // owner evicts it.
+        test_snoop_filter_t filter;
+        filter.init(caches, 2);
+        const addr_t a = 0x100, b = 0x200;
+        filter.snoop(a, 0, false);
+        filter.snoop(a, 1, false);
+        filter.snoop(a, 0, true);
+        filter.snoop(a, 1, false);
+        filter.snoop(b, 1, true);
+        filter.snoop_eviction(b, 1);
+        check_snoop_filter(!filter.has_entry(b), "entry kept without sharers");
+        filter.snoop(b, 0, false);
+        check_snoop_filter(filter.writes() == 2 && filter.invalidates() == 1 &&
+                               filter.writebacks() == 2 &&
+                               filter.directory_evictions() == 0 &&
+                               filter.entries() == 2,
+                           "unbounded counts");
+        check_snoop_filter(log[0].tags.empty() &&
+                               log[1].tags == std::vector<addr_t>({ a }),
+                           "unbounded invalidations");
+    }
+    log[0].tags.clear();
+    log[1].tags.clear();
+    {
+        // A directory bounded to 3 entries, all with one home slot so that they
+        // form one probe run.  Each new line evicts the entry in the home slot,
+        // which invalidates its sharers, and the backward-shift delete moves
+        // the rest of the run up behind it.
+        test_snoop_filter_t filter;
+        filter.init(caches, 2, 3);
+        const addr_t a = 0x1000;
+        const std::vector<addr_t> more = filter.colliding_tags(a, 4);
+        const addr_t b = more[0], c = more[1], d = more[2], e = more[3];
+        filter.snoop(a, 0, true);
+        filter.snoop(a, 1, false); // Writes a back.
+        filter.snoop(b, 1, true);
+        filter.snoop(c, 0, false);
+        const int home = filter.entry_slot(a);
+        filter.snoop(d, 0, false); // Evicts a, shared by both caches.
+        check_snoop_filter(!filter.has_entry(a) && filter.entry_slot(b) == home &&
+                               filter.has_entry(c) && filter.has_entry(d),
+                           "first directory eviction");
+        filter.snoop(d, 1, true);
+        filter.snoop(e, 1, false); // Evicts b, dirty in cache 1.
+        check_snoop_filter(!filter.has_entry(b) && filter.entry_slot(c) == home &&
+                               filter.has_entry(d) && filter.has_entry(e),
+                           "second directory eviction");
+        // d stays dirty after being shifted, so evicting it writes it back, and
+        // the hole it leaves is filled by e.
+        filter.snoop_eviction(d, 1);
+        check_snoop_filter(filter.entry_slot(e) == filter.entry_slot(c) + 1 &&
+                               filter.entries() == 2,
+                           "sharer eviction");
+        check_snoop_filter(filter.writes() == 3 && filter.invalidates() == 4 &&
+                               filter.writebacks() == 3 &&
+                               filter.directory_evictions() == 2,
+                           "bounded counts");
+        check_snoop_filter(log[0].tags == std::vector<addr_t>({ a, d }) &&
+                               log[1].tags == std::vector<addr_t>({ a, b }),
+                           "bounded invalidations");
+    }
+}
+
+// Returns the number after label on its line of the stats text, ignoring
+// thousands separators and a leading "+/-".
+static double
+read_stats_value(const std::string &text, const std::string &label)
+{
+    const size_t pos = text.find(label);
+    if (pos == std::string::npos)
+        return -1.;
+    std::string value;
+    for (size_t i = pos + label.size(); i < text.size() && text[i] != '\n'; i++) {
+        if (std::isdigit((unsigned char)text[i]) || text[i] == '.')
+            value += text[i];
+    }
+    return value.empty() ? -1. : std::stod(value);
+}
+
+void
+unit_test_sampled_miss_estimate()
+{
+    // The misses estimated from one set in 8 must fall within the reported 95%
+    // interval of the misses of the full run, on a trace spread uniformly over
+    // twice the LLC.
+    const int count = 400000;
+    double full_misses = 0., full_accesses = 0.;
+    for (const unsigned int ratio : { 1, 8 }) {
+        const std::string dir = "unit_test_sampled_miss_estimate_" + std::to_string(ratio);
+        double misses, accesses;
+        {
+            cache_simulator_knobs_t knobs = make_test_knobs();
+            knobs.L1D_size = 4 * 1024;
+            knobs.L1D_assoc = 4;
+            knobs.LL_size = 1024 * 1024;
+            knobs.LL_assoc = 16;
+            knobs.LL_sample_ratio = ratio;
+            knobs.stats_dir = dir;
+            cache_simulator_t cache_sim(&knobs);
+            std::uint32_t seed = 7;
+            for (int i = 0; i < count; i++) {
+                seed = seed * 1103515245 + 12345;
+                memref_t ref = {};
+                ref.data.pid = 4321;
+                ref.data.tid = 4321;
+                ref.data.type = TRACE_TYPE_READ;
+                ref.data.size = 8;
+                ref.data.addr = 0x10000000 + ((addr_t)(seed >> 8) << 3) % (2 << 20);
+                if (!cache_sim.process_memref(ref)) {
+                    std::cerr << "drcachesim unit_test_sampled_miss_estimate failed: "
+                              << cache_sim.get_error_string() << "\n";
+                    exit(1);
+                }
+            }
+            misses = (double)cache_sim.get_cache_metric(metric_name_t::MISSES, 2);
+            accesses = misses + cache_sim.get_cache_metric(metric_name_t::HITS, 2);
+            cache_sim.print_results();
+        }
+        if (ratio == 1) {
+            full_misses = misses;
+            full_accesses = accesses;
+            continue;
+        }
+        const std::string stats = read_file(dir + "/LL.txt");
+        const double estimate = read_stats_value(stats, "Est. misses:");
+        // The interval is on the miss rate, in percent.
+        const double interval = read_stats_value(stats, "Miss rate 95% CI:") / 100.;
+        if (estimate < 0. || interval <= 0. || full_accesses == 0. ||
+            std::abs(misses / accesses - full_misses / full_accesses) > interval ||
+            std::abs(estimate - full_misses) > interval * full_accesses) {
+            std::cerr << "drcachesim unit_test_sampled_miss_estimate failed: estimate "
+                      << estimate << " +/- " << interval * full_accesses
+                      << " vs full run " << full_misses << "\n";
+            exit(1);
+        }
+    }
+}
+
+void
+unit_test_checkpoint()
+{
+    // A run restored from a checkpoint taken at the end of warmup must end with
+    // the same stats, page usage and region stats as one that never stopped,
+    // including where -sim_refs ends the simulation.
+    const metric_name_t metrics[] = {
+        metric_name_t::HITS,           metric_name_t::MISSES,
+        metric_name_t::HITS_AT_RESET,  metric_name_t::MISSES_AT_RESET,
+        metric_name_t::COMPULSORY_MISSES, metric_name_t::CHILD_HITS,
+        metric_name_t::CHILD_HITS_AT_RESET, metric_name_t::INCLUSIVE_INVALIDATES,
+        metric_name_t::COHERENCE_INVALIDATES, metric_name_t::PREFETCH_HITS,
+        metric_name_t::PREFETCH_MISSES, metric_name_t::FLUSHES,
+    };
+    const std::string checkpoint = "unit_test_checkpoint.bin";
+    std::vector<int_least64_t> results[2];
+    std::string files[2];
+    for (int pass = 0; pass < 3; pass++) {
+        const std::string dir = "unit_test_checkpoint_" + std::to_string(pass);
+        {
+            cache_simulator_knobs_t knobs = make_test_knobs();
+            knobs.L1I_size = 4 * 1024;
+            knobs.L1D_size = 4 * 1024;
+            knobs.L1I_assoc = 4;
+            knobs.L1D_assoc = 4;
+            knobs.LL_size = 64 * 1024;
+            knobs.LL_assoc = 8;
+            knobs.data_prefetcher = "nextline";
+            knobs.warmup_refs = 20000;
+            knobs.sim_refs = 50000;
+            knobs.region_stats = true;
+            knobs.stats_dir = dir;
+            // Pass 0 runs straight through, pass 1 writes the checkpoint and pass 2
+            // resumes from it.
+            if (pass == 1)
+                knobs.checkpoint_out = checkpoint;
+            else if (pass == 2)
+                knobs.checkpoint_in = checkpoint;
+            cache_simulator_t cache_sim(&knobs);
+            if (!cache_sim) {
+                std::cerr << "drcachesim unit_test_checkpoint failed: "
+                          << cache_sim.get_error_string() << "\n";
+                exit(1);
+            }
+            run_mixed_trace(cache_sim, 100000);
+            if (pass == 1)
+                continue;
+            for (const auto metric : metrics) {
+                for (const auto split :
+                     { cache_split_t::DATA, cache_split_t::INSTRUCTION }) {
+                    results[pass / 2].push_back(
+                        cache_sim.get_cache_metric(metric, 1, 0, split));
+                }
+                results[pass / 2].push_back(cache_sim.get_cache_metric(metric, 2));
+            }
+            cache_sim.print_results();
+        }
+        if (pass == 1)
+            continue;
+        // The page usage is complete once the simulator is gone.
+        for (const std::string name :
+             { "region_stats.txt", "page_usage_unfiltered_4KiB.dat",
+               "ll_cache_usage_4KiB.dat" })
+            files[pass / 2] += read_file(dir + "/" + name);
+    }
+    if (results[0] != results[1] || files[0] != files[1] || files[0].empty()) {
+        std::cerr << "drcachesim unit_test_checkpoint failed: the restored run differs\n";
+        exit(1);
+    }
+}
+
+void
+unit_test_checkpoint_region_stats()
+{
+    // The region stats counted before a checkpoint taken past the warmup must be
+    // carried over to the restored run.
+    const addr_t start = 0x401000;
+    const std::string checkpoint = "unit_test_checkpoint_region_stats.bin";
+    std::string stats[2];
+    for (int pass = 0; pass < 3; pass++) {
+        const std::string dir =
+            "unit_test_checkpoint_region_stats_" + std::to_string(pass);
+        {
+            cache_simulator_knobs_t knobs = make_test_knobs();
+            knobs.region_stats = true;
+            knobs.stats_dir = dir;
+            knobs.start_pc = start;
+            knobs.checkpoint_at = "start";
+            if (pass == 1)
+                knobs.checkpoint_out = checkpoint;
+            else if (pass == 2)
+                knobs.checkpoint_in = checkpoint;
+            cache_simulator_t cache_sim(&knobs);
+            if (!cache_sim) {
+                std::cerr << "drcachesim unit_test_checkpoint_region_stats failed: "
+                          << cache_sim.get_error_string() << "\n";
+                exit(1);
+            }
+            // Reads over twice the LLC on either side of the start instruction.
+            memref_t ref = {};
+            ref.data.pid = 4321;
+            ref.data.tid = 4321;
+            ref.data.size = 8;
+            for (int i = 0; i < 2 * 128; i++) {
+                if (i == 128) {
+                    ref.data.type = TRACE_TYPE_INSTR;
+                    ref.data.addr = start;
+                    cache_sim.process_memref(ref);
+                }
+                ref.data.type = TRACE_TYPE_READ;
+                ref.data.addr = 0x10000 + (i % 64) * 64;
+                cache_sim.process_memref(ref);
+            }
+            cache_sim.print_results();
+        }
+        if (pass != 1)
+            stats[pass / 2] = read_file(dir + "/region_stats.txt");
+    }
+    if (stats[0] != stats[1] || stats[0].empty()) {
+        std::cerr << "drcachesim unit_test_checkpoint_region_stats failed: the restored "
+                     "run differs\n";
+        exit(1);
+    }
+}
+
 void
 unit_test_warmup_fraction()
 {
     cache_simulator_knobs_t knobs = make_test_knobs();
     knobs.warmup_fraction = 0.5;
-    cache_simulator_t cache_sim(knobs);
+    cache_simulator_t cache_sim(&knobs);
 
     // Feed it some memrefs, warmup fraction is set to 0.5 where the capacity at
     // each level is 32 lines each. The first 16 memrefs warm up the cache and
@@ -86,7 +870,7 @@ unit_test_warmup_refs()
 {
     cache_simulator_knobs_t knobs = make_test_knobs();
     knobs.warmup_refs = 16;
-    cache_simulator_t cache_sim(knobs);
+    cache_simulator_t cache_sim(&knobs);
 
     // Feed it some memrefs, warmup refs = 16 where the capacity at
     // each level is 32 lines each. The first 16 memrefs warm up the cache and
@@ -115,7 +899,7 @@ unit_test_sim_refs()
 {
     cache_simulator_knobs_t knobs = make_test_knobs();
     knobs.sim_refs = 8;
-    cache_simulator_t cache_sim(knobs);
+    cache_simulator_t cache_sim(&knobs);
 
     std::string error;
     for (int i = 0; i < 16; i++) {
@@ -140,7 +924,7 @@ void
 unit_test_metrics_API()
 {
     cache_simulator_knobs_t knobs = make_test_knobs();
-    cache_simulator_t cache_sim(knobs);
+    cache_simulator_t cache_sim(&knobs);
 
     memref_t ref;
     ref.data.type = TRACE_TYPE_WRITE;
@@ -212,7 +996,7 @@ unit_test_compulsory_misses()
     cache_simulator_knobs_t knobs = make_test_knobs();
     knobs.L1I_size = 4 * 64;
     knobs.L1I_assoc = 4;
-    cache_simulator_t cache_sim(knobs);
+    cache_simulator_t cache_sim(&knobs);
 
     memref_t ref;
     ref.data.type = TRACE_TYPE_INSTR;
@@ -275,6 +1059,12 @@ LLC {
 )MYCONFIG";
     std::istringstream config_in(config);
     cache_simulator_t cache_sim(&config_in);
+    if (!cache_sim) {
+        // Configuration files are disabled in this simulator.
+        std::cerr << "drcachesim unit_test_child_hits skipped: "
+                  << cache_sim.get_error_string() << "\n";
+        return;
+    }
 
     memref_t ref;
     ref.data.type = TRACE_TYPE_READ;
@@ -304,6 +1094,93 @@ LLC {
            num_accesses - 1);
 }
 
+void
+unit_test_child_hits_knobs()
+{
+    // The knobs-based twin of unit_test_child_hits: hits in the L1 caches must
+    // reach the LLC's child hits across a warmup reset, and across a checkpoint
+    // written while L1 hits are still unreported.
+    const addr_t data = 0x10000, instr = 0x400000, start = 0x401000;
+    const std::string checkpoint = "unit_test_child_hits_knobs.bin";
+    for (int pass = 0; pass < 3; pass++) {
+        cache_simulator_knobs_t knobs = make_test_knobs();
+        // The warmup ends when the second of the LLC's 32 lines is loaded.
+        knobs.warmup_fraction = 2.0 / 32;
+        // The checkpoint is written once the instruction at start is simulated.
+        knobs.start_pc = start;
+        knobs.checkpoint_at = "start";
+        if (pass == 1)
+            knobs.checkpoint_out = checkpoint;
+        else if (pass == 2)
+            knobs.checkpoint_in = checkpoint;
+        cache_simulator_t cache_sim(&knobs);
+        if (!cache_sim) {
+            std::cerr << "drcachesim unit_test_child_hits_knobs failed: "
+                      << cache_sim.get_error_string() << "\n";
+            exit(1);
+        }
+        // A data miss and 10 hits, an instruction miss that ends the warmup, 10
+        // hits on each L1, the start instruction's miss, and 15 more on each.
+        std::vector<memref_t> refs;
+        memref_t ref = {};
+        ref.data.pid = 4321;
+        ref.data.tid = 4321;
+        ref.data.size = 4;
+        auto add_ref = [&refs, &ref](trace_type_t type, addr_t addr) {
+            ref.data.type = type;
+            ref.data.addr = addr;
+            refs.push_back(ref);
+        };
+        for (int i = 0; i < 1 + 10; i++)
+            add_ref(TRACE_TYPE_READ, data);
+        add_ref(TRACE_TYPE_INSTR, instr);
+        for (int i = 0; i < 10 + 15; i++) {
+            if (i == 10)
+                add_ref(TRACE_TYPE_INSTR, start);
+            add_ref(TRACE_TYPE_READ, data);
+            add_ref(TRACE_TYPE_INSTR, instr);
+        }
+        for (const memref_t &memref : refs) {
+            if (!cache_sim.process_memref(memref)) {
+                std::cerr << "drcachesim unit_test_child_hits_knobs failed: "
+                          << cache_sim.get_error_string() << "\n";
+                exit(1);
+            }
+        }
+        struct {
+            metric_name_t metric;
+            unsigned level;
+            cache_split_t split;
+            int_least64_t expect;
+        } checks[] = {
+            { metric_name_t::HITS_AT_RESET, 1, cache_split_t::DATA, 10 },
+            { metric_name_t::HITS, 1, cache_split_t::DATA, 25 },
+            { metric_name_t::MISSES_AT_RESET, 1, cache_split_t::INSTRUCTION, 1 },
+            { metric_name_t::HITS, 1, cache_split_t::INSTRUCTION, 25 },
+            { metric_name_t::MISSES, 1, cache_split_t::INSTRUCTION, 1 },
+            { metric_name_t::CHILD_HITS_AT_RESET, 1, cache_split_t::DATA, 0 },
+            { metric_name_t::CHILD_HITS, 1, cache_split_t::DATA, 0 },
+            { metric_name_t::CHILD_HITS, 1, cache_split_t::INSTRUCTION, 0 },
+            { metric_name_t::MISSES_AT_RESET, 2, cache_split_t::DATA, 2 },
+            { metric_name_t::MISSES, 2, cache_split_t::DATA, 1 },
+            { metric_name_t::HITS, 2, cache_split_t::DATA, 0 },
+            { metric_name_t::CHILD_HITS_AT_RESET, 2, cache_split_t::DATA, 10 },
+            { metric_name_t::CHILD_HITS, 2, cache_split_t::DATA, 50 },
+        };
+        for (const auto &check : checks) {
+            const int_least64_t value =
+                cache_sim.get_cache_metric(check.metric, check.level, 0, check.split);
+            if (value != check.expect) {
+                std::cerr << "drcachesim unit_test_child_hits_knobs failed in pass "
+                          << pass << ": metric " << (int)check.metric << " at level "
+                          << check.level << " is " << value << ", not " << check.expect
+                          << "\n";
+                exit(1);
+            }
+        }
+    }
+}
+
 int
 main(int argc, const char *argv[])
 {
@@ -313,5 +1190,14 @@ main(int argc, const char *argv[])
     unit_test_warmup_refs();
     unit_test_sim_refs();
     unit_test_child_hits();
+    unit_test_child_hits_knobs();
+    unit_test_flat_block_storage();
+    unit_test_lru_victims();
+    unit_test_plru_victims();
+    unit_test_binary_stats_format();
+    unit_test_snoop_filter();
+    unit_test_sampled_miss_estimate();
+    unit_test_checkpoint();
+    unit_test_checkpoint_region_stats();
     return 0;
 }
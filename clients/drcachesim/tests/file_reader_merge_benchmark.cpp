@@ -0,0 +1,199 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+// Benchmark for the timestamp merge in file_reader_t::read_next_entry(), as
+// used by serial analysis.  For each thread count it writes that many
+// per-thread trace files, each a sequence of short timestamped chunks with
+// the chunks of different threads interleaved in time, and reads them back
+// through the reader interface.  The merged stream is checked for timestamp
+// order and completeness and the merge throughput is reported.  The total
+// number of entries is the same for every thread count.  Usage:
+//   file_reader_merge_benchmark [entries_per_config] [scratch_dir]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#ifndef WINDOWS
+#    include <sys/resource.h>
+#endif
+#include "reader/file_reader.h"
+#include "common/memref.h"
+#include "common/trace_entry.h"
+
+static const int thread_counts[] = { 1, 4, 16, 64, 256, 1024, 4096 };
+// Instructions per timestamped chunk: kept small so that the merge dominates.
+static const int CHUNK_INSTRS = 8;
+static const int TIMESTAMP_STRIDE = 100;
+
+static std::string
+thread_path(const std::string &dir, int index)
+{
+    return dir + "/merge_benchmark." + std::to_string(index) + ".trace";
+}
+
+static void
+write_entry(std::ofstream &out, unsigned short type, unsigned short size, addr_t addr)
+{
+    trace_entry_t entry;
+    entry.type = type;
+    entry.size = size;
+    entry.addr = addr;
+    out.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+}
+
+static bool
+write_traces(const std::string &dir, int num_threads, int chunks_per_thread,
+             std::vector<std::string> *paths)
+{
+    paths->clear();
+    for (int i = 0; i < num_threads; ++i) {
+        paths->push_back(thread_path(dir, i));
+        std::ofstream out(paths->back(), std::ofstream::binary);
+        if (!out)
+            return false;
+        const addr_t tid = 1000 + i;
+        write_entry(out, TRACE_TYPE_HEADER, 0, TRACE_ENTRY_VERSION);
+        write_entry(out, TRACE_TYPE_THREAD, sizeof(int), tid);
+        write_entry(out, TRACE_TYPE_PID, sizeof(int), 1);
+        for (int c = 0; c < chunks_per_thread; ++c) {
+            // Threads interleave within each stride, with some ties.
+            const addr_t timestamp =
+                TIMESTAMP_STRIDE * (c + 1) + (i * 37) % TIMESTAMP_STRIDE;
+            write_entry(out, TRACE_TYPE_MARKER, TRACE_MARKER_TYPE_TIMESTAMP, timestamp);
+            for (int j = 0; j < CHUNK_INSTRS; ++j)
+                write_entry(out, TRACE_TYPE_INSTR, 4, 0x400000 + 4 * j);
+        }
+        write_entry(out, TRACE_TYPE_THREAD_EXIT, sizeof(int), tid);
+        write_entry(out, TRACE_TYPE_FOOTER, 0, 0);
+        if (!out)
+            return false;
+    }
+    return true;
+}
+
+// Returns false if the merged stream is out of order or incomplete.
+static bool
+run_config(const std::vector<std::string> &paths, int chunks_per_thread,
+           double *seconds, uint64_t *entries)
+{
+    const auto start = std::chrono::steady_clock::now();
+    file_reader_t<std::ifstream *> reader(paths);
+    file_reader_t<std::ifstream *> end;
+    if (!reader.init()) {
+        std::cerr << "Failed to open the trace files\n";
+        return false;
+    }
+    uint64_t last_timestamp = 0, instrs = 0, timestamps = 0, exits = 0;
+    *entries = 0;
+    for (; reader != end; ++reader) {
+        const memref_t &memref = *reader;
+        ++*entries;
+        if (memref.marker.type == TRACE_TYPE_MARKER &&
+            memref.marker.marker_type == TRACE_MARKER_TYPE_TIMESTAMP) {
+            if (memref.marker.marker_value < last_timestamp) {
+                std::cerr << "Timestamp " << memref.marker.marker_value
+                          << " out of order after " << last_timestamp << "\n";
+                return false;
+            }
+            last_timestamp = memref.marker.marker_value;
+            ++timestamps;
+        } else if (type_is_instr(memref.instr.type))
+            ++instrs;
+        else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT)
+            ++exits;
+    }
+    *seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const uint64_t expect_chunks = (uint64_t)paths.size() * chunks_per_thread;
+    if (timestamps != expect_chunks || instrs != expect_chunks * CHUNK_INSTRS ||
+        exits != paths.size()) {
+        std::cerr << "Incomplete merge: " << timestamps << " timestamps, " << instrs
+                  << " instrs, " << exits << " exits\n";
+        return false;
+    }
+    return true;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    uint64_t total_entries = argc > 1 ? strtoull(argv[1], nullptr, 0) : 4 * 1024 * 1024;
+    const std::string dir = argc > 2 ? argv[2] : ".";
+    // Each thread file stays open for the whole merge.
+    uint64_t max_files = 1 << 20;
+#ifndef WINDOWS
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+        max_files = limit.rlim_cur > 64 ? limit.rlim_cur - 64 : 0;
+#endif
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "entries"
+              << std::setw(12) << "seconds" << std::setw(16) << "entries/sec" << "\n";
+    bool ok = true;
+    std::vector<std::string> paths;
+    for (int num_threads : thread_counts) {
+        if ((uint64_t)num_threads > max_files) {
+            std::cout << std::setw(8) << num_threads << "  skipped: too many open files\n";
+            continue;
+        }
+        int chunks_per_thread =
+            (int)(total_entries / (num_threads * (CHUNK_INSTRS + 1)));
+        if (chunks_per_thread < 1)
+            chunks_per_thread = 1;
+        double seconds = 0;
+        uint64_t entries = 0;
+        if (!write_traces(dir, num_threads, chunks_per_thread, &paths)) {
+            std::cerr << "Failed to write trace files to " << dir << "\n";
+            ok = false;
+        } else if (!run_config(paths, chunks_per_thread, &seconds, &entries))
+            ok = false;
+        else {
+            std::cout << std::setw(8) << num_threads << std::setw(14) << entries
+                      << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+                      << std::setw(16) << std::setprecision(0) << entries / seconds
+                      << "\n";
+        }
+        for (const std::string &path : paths)
+            std::remove(path.c_str());
+        if (!ok)
+            break;
+    }
+    if (!ok) {
+        std::cerr << "FAILED\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+// Microbenchmark for the set-wide tag comparison kernels in tag_match.h.
+// Each kernel supported by the host is first checked against the scalar
+// kernel and then timed on sets of 4, 8, 16 and 32 ways.  Usage:
+//   tag_match_benchmark [lookups_per_config]
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "simulator/tag_match.h"
+
+static const tag_match_kernel_t kernels[] = { TAG_MATCH_SCALAR, TAG_MATCH_SSE42,
+                                              TAG_MATCH_AVX2, TAG_MATCH_NEON };
+static const int way_counts[] = { 4, 8, 16, 32 };
+static const int NUM_SETS = 1024;
+
+static void
+check_kernel(tag_match_kernel_t kernel, tag_match_func_t func)
+{
+    tag_match_func_t scalar = tag_match_get_kernel(TAG_MATCH_SCALAR);
+    std::mt19937_64 rng(42);
+    std::vector<addr_t> tags(TAG_MATCH_MAX_WAYS);
+    for (int num_ways = 1; num_ways <= TAG_MATCH_MAX_WAYS; ++num_ways) {
+        for (int trial = 0; trial < 64; ++trial) {
+            // Use a small tag range so that duplicates and hits are common.
+            for (int i = 0; i < num_ways; ++i)
+                tags[i] = rng() % 8;
+            addr_t tag = rng() % 8;
+            if (func(tags.data(), num_ways, tag) != scalar(tags.data(), num_ways, tag)) {
+                std::cerr << "tag_match_benchmark: " << tag_match_kernel_name(kernel)
+                          << " kernel mismatch at " << num_ways << " ways\n";
+                exit(1);
+            }
+        }
+    }
+}
+
+static double
+time_kernel(tag_match_func_t func, int num_ways, std::uint64_t lookups,
+            std::uint64_t *hits)
+{
+    std::mt19937_64 rng(7);
+    std::vector<addr_t> tags(NUM_SETS * num_ways);
+    for (auto &tag : tags)
+        tag = rng() >> 8;
+    // Pre-generate probes so that random number generation stays out of the
+    // timed loop: roughly half hit some way, the rest miss.
+    std::vector<addr_t> probes(4096);
+    for (size_t i = 0; i < probes.size(); ++i) {
+        if (i % 2 == 0)
+            probes[i] = tags[rng() % tags.size()];
+        else
+            probes[i] = ~(rng() >> 8);
+    }
+    std::uint64_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::uint64_t i = 0; i < lookups; ++i) {
+        addr_t tag = probes[i % probes.size()];
+        const addr_t *set = &tags[(i % NUM_SETS) * num_ways];
+        found += func(set, num_ways, tag) != 0;
+    }
+    auto end = std::chrono::steady_clock::now();
+    *hits = found;
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int
+main(int argc, const char *argv[])
+{
+    std::uint64_t lookups = 10000000;
+    if (argc > 1)
+        lookups = strtoull(argv[1], nullptr, 0);
+
+    std::cout << std::left << std::setw(10) << "kernel" << std::right << std::setw(6)
+              << "ways" << std::setw(16) << "Mlookups/sec" << "\n";
+    for (tag_match_kernel_t kernel : kernels) {
+        tag_match_func_t func = tag_match_get_kernel(kernel);
+        if (func == nullptr) {
+            std::cout << std::left << std::setw(10) << tag_match_kernel_name(kernel)
+                      << "unsupported\n";
+            continue;
+        }
+        check_kernel(kernel, func);
+        for (int num_ways : way_counts) {
+            std::uint64_t hits;
+            double secs = time_kernel(func, num_ways, lookups, &hits);
+            std::cout << std::left << std::setw(10) << tag_match_kernel_name(kernel)
+                      << std::right << std::setw(6) << num_ways << std::setw(16)
+                      << std::fixed << std::setprecision(1)
+                      << (secs > 0 ? lookups / secs / 1e6 : 0.0) << "\n";
+            // Keep the result live so the loop is not optimized away.
+            if (hits > lookups)
+                return 1;
+        }
+    }
+    for (tag_match_kernel_t kernel : kernels) {
+        if (tag_match_ways == tag_match_get_kernel(kernel))
+            std::cout << "selected kernel: " << tag_match_kernel_name(kernel) << "\n";
+    }
+    return 0;
+}
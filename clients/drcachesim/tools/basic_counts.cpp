@@ -88,10 +88,9 @@ basic_counts_t::parallel_shard_error(void *shard_data)
     return counters->error;
 }
 
-bool
-basic_counts_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
+inline void
+basic_counts_t::count_memref(counters_t *counters, const memref_t &memref)
 {
-    counters_t *counters = reinterpret_cast<counters_t *>(shard_data);
     if (type_is_instr(memref.instr.type)) {
         ++counters->instrs;
         counters->unique_pc_addrs.insert(memref.instr.addr);
@@ -126,6 +125,22 @@ basic_counts_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
     } else if (memref.data.type == TRACE_TYPE_DATA_FLUSH) {
         counters->dcache_flushes++;
     }
+}
+
+bool
+basic_counts_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
+{
+    count_memref(reinterpret_cast<counters_t *>(shard_data), memref);
+    return true;
+}
+
+bool
+basic_counts_t::parallel_shard_memref_batch(void *shard_data, const memref_t *memrefs,
+                                            size_t count)
+{
+    counters_t *counters = reinterpret_cast<counters_t *>(shard_data);
+    for (size_t i = 0; i < count; ++i)
+        count_memref(counters, memrefs[i]);
     return true;
 }
 
@@ -146,6 +161,28 @@ basic_counts_t::process_memref(const memref_t &memref)
     return true;
 }
 
+bool
+basic_counts_t::process_memref_batch(const memref_t *memrefs, size_t count)
+{
+    // Entries come in runs from one thread, so we look up the thread's counters
+    // only when the tid changes.
+    memref_tid_t tid = 0;
+    counters_t *counters = nullptr;
+    for (size_t i = 0; i < count; ++i) {
+        if (counters == nullptr || memrefs[i].data.tid != tid) {
+            tid = memrefs[i].data.tid;
+            const auto &lookup = shard_map_.find(tid);
+            if (lookup == shard_map_.end()) {
+                counters = new counters_t;
+                shard_map_[tid] = counters;
+            } else
+                counters = lookup->second;
+        }
+        count_memref(counters, memrefs[i]);
+    }
+    return true;
+}
+
 bool
 basic_counts_t::cmp_counters(const std::pair<memref_tid_t, counters_t *> &l,
                              const std::pair<memref_tid_t, counters_t *> &r)
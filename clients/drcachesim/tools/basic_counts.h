@@ -47,6 +47,8 @@ public:
     bool
     process_memref(const memref_t &memref) override;
     bool
+    process_memref_batch(const memref_t *memrefs, size_t count) override;
+    bool
     print_results() override;
     bool
     parallel_shard_supported() override;
@@ -56,6 +58,9 @@ public:
     parallel_shard_exit(void *shard_data) override;
     bool
     parallel_shard_memref(void *shard_data, const memref_t &memref) override;
+    bool
+    parallel_shard_memref_batch(void *shard_data, const memref_t *memrefs,
+                                size_t count) override;
     std::string
     parallel_shard_error(void *shard_data) override;
 
@@ -104,6 +109,9 @@ protected:
         std::unordered_set<uint64_t> unique_pc_addrs;
         std::string error;
     };
+    // The per-entry work shared by the serial, parallel, and batched paths.
+    void
+    count_memref(counters_t *counters, const memref_t &memref);
     static bool
     cmp_counters(const std::pair<memref_tid_t, counters_t *> &l,
                  const std::pair<memref_tid_t, counters_t *> &r);
@@ -111,6 +111,46 @@ histogram_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
     return true;
 }
 
+bool
+histogram_t::parallel_shard_memref_batch(void *shard_data, const memref_t *memrefs,
+                                         size_t count)
+{
+    shard_data_t *shard = reinterpret_cast<shard_data_t *>(shard_data);
+    // Consecutive references mostly hit the same line, so we count runs of the same
+    // line and update the map once per run.  The pending line is only valid with a
+    // nonzero count.
+    addr_t iline = 0, dline = 0;
+    uint64_t icount = 0, dcount = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const memref_t &memref = memrefs[i];
+        if (type_is_instr(memref.instr.type) ||
+            memref.instr.type == TRACE_TYPE_PREFETCH_INSTR) {
+            addr_t line = memref.instr.addr >> line_size_bits_;
+            if (icount > 0 && line != iline) {
+                shard->icache_map[iline] += icount;
+                icount = 0;
+            }
+            iline = line;
+            ++icount;
+        } else if (memref.data.type == TRACE_TYPE_READ ||
+                   memref.data.type == TRACE_TYPE_WRITE ||
+                   type_is_prefetch(memref.data.type)) {
+            addr_t line = memref.data.addr >> line_size_bits_;
+            if (dcount > 0 && line != dline) {
+                shard->dcache_map[dline] += dcount;
+                dcount = 0;
+            }
+            dline = line;
+            ++dcount;
+        }
+    }
+    if (icount > 0)
+        shard->icache_map[iline] += icount;
+    if (dcount > 0)
+        shard->dcache_map[dline] += dcount;
+    return true;
+}
+
 std::string
 histogram_t::parallel_shard_error(void *shard_data)
 {
@@ -128,6 +168,17 @@ histogram_t::process_memref(const memref_t &memref)
     return true;
 }
 
+bool
+histogram_t::process_memref_batch(const memref_t *memrefs, size_t count)
+{
+    if (!parallel_shard_memref_batch(reinterpret_cast<void *>(&serial_shard_), memrefs,
+                                     count)) {
+        error_string_ = serial_shard_.error;
+        return false;
+    }
+    return true;
+}
+
 bool
 cmp(const std::pair<addr_t, uint64_t> &l, const std::pair<addr_t, uint64_t> &r)
 {
@@ -0,0 +1,70 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Converts a binary stats dump or miss file written by the cache simulator
+ * with -stats_format binary or binary_gz back into the text format.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "../simulator/stats_file.h"
+
+int
+main(int argc, const char *argv[])
+{
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " <input.bin[.gz]> [output.dat]\n";
+        return 1;
+    }
+    stats_file_reader_t reader(argv[1]);
+    if (!reader.get_error().empty()) {
+        std::cerr << "Failed to open " << argv[1] << ": " << reader.get_error() << "\n";
+        return 1;
+    }
+    std::ofstream outfile;
+    if (argc == 3) {
+        outfile.open(argv[2], std::ofstream::out | std::ofstream::trunc);
+        if (!outfile.is_open()) {
+            std::cerr << "Failed to open " << argv[2] << " for writing\n";
+            return 1;
+        }
+    }
+    std::ostream &out = argc == 3 ? outfile : std::cout;
+    if (!reader.convert_to_text(out) || !out.good()) {
+        std::cerr << "Failed to convert " << argv[1] << ": " << reader.get_error()
+                  << "\n";
+        return 1;
+    }
+    return 0;
+}
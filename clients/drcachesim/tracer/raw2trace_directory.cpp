@@ -106,7 +106,8 @@ raw2trace_directory_t::open_thread_log_file(const char *basename)
           basename);
     // Skip the auxiliary files.
     if (strcmp(basename, DRMEMTRACE_MODULE_LIST_FILENAME) == 0 ||
-        strcmp(basename, DRMEMTRACE_FUNCTION_LIST_FILENAME) == 0)
+        strcmp(basename, DRMEMTRACE_FUNCTION_LIST_FILENAME) == 0 ||
+        strcmp(basename, DRMEMTRACE_VM_MAPS_FILENAME) == 0)
         return "";
     // Skip any non-.raw in case someone put some other file in there.
     const char *basename_dot = strrchr(basename, '.');
@@ -59,6 +59,7 @@
 #include "../common/named_pipe.h"
 #include "../common/options.h"
 #include "../common/utils.h"
+#include "../common/vm_maps_snapshot.h"
 
 #ifdef ARM
 #    include "../../../core/unix/include/syscall_linux_arm.h" // for SYS_cacheflush
@@ -97,6 +98,14 @@ static char logsubdir[MAXIMUM_PATH];
 static char subdir_prefix[MAXIMUM_PATH]; /* Holds op_subdir_prefix. */
 static file_t module_file;
 static file_t funclist_file = INVALID_FILE;
+#ifdef LINUX
+static file_t vm_maps_file = INVALID_FILE;
+/* Guards the snapshots, so taking one does not hold up tracing threads. */
+static void *vm_maps_mutex;
+/* A hash of the maps text of the last snapshot written to vm_maps_file. */
+static uint64 vm_maps_last_hash;
+static bool vm_maps_have_last;
+#endif
 static int notify_beyond_global_max_once;
 
 /* Max number of entries a buffer can have. It should be big enough
@@ -1931,6 +1940,95 @@ event_thread_exit(void *drcontext)
     dr_thread_free(drcontext, data, sizeof(per_thread_t));
 }
 
+#ifdef LINUX
+static uint64
+hash_vm_maps_text(const char *text, size_t size)
+{
+    /* FNV-1a. */
+    uint64 hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ (unsigned char)text[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+/* Appends /proc/self/maps in compact form to the snapshot file next to the module
+ * list so that the simulators can locate our segments long after this process is
+ * gone.  We take one at attach, before each module unload and at exit, and skip
+ * it when the maps are unchanged since the last one, as when a library is loaded
+ * and unloaded in a loop.
+ */
+static void
+write_vm_maps_snapshot(void)
+{
+    if (vm_maps_file == INVALID_FILE)
+        return;
+    /* The lock keeps the snapshots whole and in the order they were taken. */
+    dr_mutex_lock(vm_maps_mutex);
+    /* /proc files report a size of 0, so we grow the buffer until a read falls
+     * short.  We cannot use malloc here (to support static client use).
+     */
+    file_t maps = dr_open_file("/proc/self/maps", DR_FILE_READ);
+    if (maps == INVALID_FILE) {
+        dr_mutex_unlock(vm_maps_mutex);
+        return;
+    }
+    size_t capacity = 64 * 1024;
+    size_t size = 0;
+    char *text = (char *)dr_global_alloc(capacity);
+    for (;;) {
+        ssize_t len = dr_read_file(maps, text + size, capacity - size);
+        if (len <= 0)
+            break;
+        size += len;
+        if (size == capacity) {
+            char *bigger = (char *)dr_global_alloc(capacity * 2);
+            memcpy(bigger, text, size);
+            dr_global_free(text, capacity);
+            text = bigger;
+            capacity *= 2;
+        }
+    }
+    dr_close_file(maps);
+    uint64 hash = hash_vm_maps_text(text, size);
+    if (vm_maps_have_last && hash == vm_maps_last_hash) {
+        dr_global_free(text, capacity);
+        dr_mutex_unlock(vm_maps_mutex);
+        return;
+    }
+
+    const char *bin_path = "";
+    module_data_t *exe = dr_get_main_module();
+    if (exe != NULL)
+        bin_path = exe->full_path;
+    size_t max_size = vm_maps_snapshot_max_size(bin_path, size);
+    char *encoded = (char *)dr_global_alloc(max_size);
+    size_t encoded_size = vm_maps_snapshot_encode(dr_get_process_id(), bin_path, text,
+                                                  size, encoded, max_size);
+    if (exe != NULL)
+        dr_free_module_data(exe);
+    dr_global_free(text, capacity);
+
+    if (encoded_size > 0) {
+        if (file_ops_func.write_file(vm_maps_file, encoded, encoded_size) !=
+            (ssize_t)encoded_size)
+            NOTIFY(0, "Failed to write %s\n", DRMEMTRACE_VM_MAPS_FILENAME);
+        else {
+            vm_maps_last_hash = hash;
+            vm_maps_have_last = true;
+        }
+    }
+    dr_global_free(encoded, max_size);
+    dr_mutex_unlock(vm_maps_mutex);
+}
+
+static void
+event_module_unload(void *drcontext, const module_data_t *info)
+{
+    /* The module is still mapped, so this snapshot has it. */
+    write_vm_maps_snapshot();
+}
+#endif
+
 static void
 event_exit(void)
 {
@@ -1945,6 +2043,15 @@ event_exit(void)
     dr_global_free(instru, MAX_INSTRU_SIZE);
 
     if (op_offline.get_value()) {
+#ifdef LINUX
+        write_vm_maps_snapshot();
+        if (vm_maps_file != INVALID_FILE) {
+            file_ops_func.close_file(vm_maps_file);
+            vm_maps_file = INVALID_FILE;
+        }
+        if (!drmgr_unregister_module_unload_event(event_module_unload))
+            DR_ASSERT(false);
+#endif
         file_ops_func.close_file(module_file);
         if (funclist_file != INVALID_FILE)
             file_ops_func.close_file(funclist_file);
@@ -1994,6 +2101,9 @@ event_exit(void)
     notify_beyond_global_max_once = 0;
 
     dr_mutex_destroy(mutex);
+#ifdef LINUX
+    dr_mutex_destroy(vm_maps_mutex);
+#endif
     drutil_exit();
     if (op_trace_after_instrs.get_value() > 0)
         exit_delay_instrumentation();
@@ -2059,6 +2169,18 @@ init_offline_dir(void)
     funclist_file = file_ops_func.open_file(
         funclist_path, DR_FILE_WRITE_REQUIRE_NEW IF_UNIX(| DR_FILE_CLOSE_ON_FORK));
 
+#ifdef LINUX
+    /* The snapshots are optional: without them the simulators fall back to /proc. */
+    char vm_maps_path[MAXIMUM_PATH];
+    dr_snprintf(vm_maps_path, BUFFER_SIZE_ELEMENTS(vm_maps_path), "%s%s%s", logsubdir,
+                DIRSEP, DRMEMTRACE_VM_MAPS_FILENAME);
+    NULL_TERMINATE_BUFFER(vm_maps_path);
+    vm_maps_file = file_ops_func.open_file(vm_maps_path,
+                                           DR_FILE_WRITE_REQUIRE_NEW | DR_FILE_CLOSE_ON_FORK);
+    /* A new file, as after a fork, starts with a full snapshot. */
+    vm_maps_have_last = false;
+#endif
+
     return (module_file != INVALID_FILE && funclist_file != INVALID_FILE);
 }
 
@@ -2080,6 +2202,9 @@ fork_init(void *drcontext)
         if (!init_offline_dir()) {
             FATAL("Failed to create a subdir in %s\n", op_outdir.get_value().c_str());
         }
+#ifdef LINUX
+        write_vm_maps_snapshot();
+#endif
     }
     init_thread_in_process(drcontext);
 }
@@ -2236,6 +2361,17 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
 
     client_id = id;
     mutex = dr_mutex_create();
+#ifdef LINUX
+    vm_maps_mutex = dr_mutex_create();
+#endif
+
+#ifdef LINUX
+    if (op_offline.get_value()) {
+        write_vm_maps_snapshot();
+        if (!drmgr_register_module_unload_event(event_module_unload))
+            DR_ASSERT(false);
+    }
+#endif
 
     tls_idx = drmgr_register_tls_field();
     DR_ASSERT(tls_idx != -1);